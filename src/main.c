@@ -11,30 +11,78 @@
      except .txt) in parameters, or drag this file onto the main window.
   3. By pressing [SPACE] you can regenerate the map, which is automatically
      serialized.
-  4. The map is generated using the diamond-square algorithm.
+  4. The map is generated using the diamond-square algorithm, or from fBm
+     gradient noise with a warped domain, which [M] switches to and back.
+  5. The world is a torus of DEF_WCHK x DEF_WCHK chunks of 2^DEF_LPWR x
+     2^DEF_LPWR elemental squares; diamond-square needs the count to be a
+     power of 2 and rounds it up, fBm noise takes it as is. Chunks are
+     generated on demand around the camera and evicted (least recently used
+     first) as soon as the cache runs out of slots, so the memory footprint
+     does not depend on the world size. DEF_WCHK == 1 gives the classic
+     single tile map.
+  6. Chunks are generated by a pool of worker threads; the window thread only
+     uploads them to OpenGL. A regenerated map replaces the current one when
+     all of its visible chunks are ready, so the window never hangs.
+  7. Every packed chunk is stored to the tile cache (the "tiles" directory)
+     once generated, and mapped back from there the next time it is needed,
+     be it after a restart or in a world loaded from the same config again.
 
   [ENTER] resets the orientation of the camera.\n
-  Use [W]/[A]/[S]/[D] and mouse (with the left button pressed) to move.
+  Use [W]/[A]/[S]/[D] and mouse (with the left button pressed) to move;
+  the camera does not go below the ground.
 
-  By pressing [Z]/[X]/[C]/[V]/[B]/[N], you can toggle various drawing modes:
+  By pressing [Z]/[X]/[C]/[V]/[B]/[N]/[L]/[P]/[I]/[H]/[R]/[J], you can toggle various drawing modes:
 
-  &nbsp;&nbsp;&nbsp;&nbsp;[Z]: Vertex arrays / VBO\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[Z]: Vertex arrays (regenerates the chunks, which only keep their data in VBOs) / VBO\n
   &nbsp;&nbsp;&nbsp;&nbsp;[X]: Wireframe / filled polygons\n
   &nbsp;&nbsp;&nbsp;&nbsp;[C]: Shading on / off\n
   &nbsp;&nbsp;&nbsp;&nbsp;[V]: Coloring on / off\n
   &nbsp;&nbsp;&nbsp;&nbsp;[B]: Texturing on / off\n
   &nbsp;&nbsp;&nbsp;&nbsp;[N]: Objects on / off\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[L]: Distant chunk LODs on / off\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[P]: Separate float arrays / packed interleaved vertices\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[I]: Instanced drawing of repeated chunks on / off\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[H]: Vertex arrays / height texture displaced by a shader\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[R]: Reflection redrawn in full / rendered to a smaller texture\n
+  &nbsp;&nbsp;&nbsp;&nbsp;[J]: GL lighting / light baked with shadows and ambient occlusion\n
+
+  [G] digs a crater under the camera; only the vertices and the firs around
+  it are remade and uploaded (see EditMap()), until the chunks are evicted.
+
+  [O] shows or hides the profiler overlay: CPU and GPU (with ARB_timer_query)
+  min / avg / p99 times of every frame phase over the last DEF_PWIN frames,
+  and the draw call and triangle counts. [K] appends them to DEF_PLOG.
+
+  Running with "-bench [file]" instead of the config file performs a benchmark:
+  single tile maps from 2^DEF_BPMN to 2^DEF_BPMX are generated for DEF_BNUM
+  fixed seeds, each timed by stage and then flown around for DEF_BFRM frames.
+  The results go to the file (bench.csv by default; .json selects JSON), and
+  the program quits when done.
+
+  Running with "-batch [file]" generates a world for every seed listed in the
+  file (seeds.txt by default, a seed per line) on the worker threads, with
+  the window never shown: the chunks around the start camera are stored to
+  the tile cache, and a thumbnail of the start view goes to the "thumbs"
+  directory. The program quits when done.
 **/
 
 
 
 #include <time.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <gl/gl.h>
 #include <gl/glu.h>
 #include <windows.h>
 #include <mmsystem.h>
+#include <float.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 
@@ -49,14 +97,20 @@
 #define tr(f) ((LONG)(f))
 
 /**
-  @brief frand: inline function that generates a random value between -f and f.
+  @brief hrand: inline function that generates a random value between -f and f.
+  The value is taken from HashRand(), so it only depends on the key and can be
+  safely computed from any thread in any order.
 
   @param f - defines the range that the value generated shall fall into.
+  @param s - PRNG seed.
+  @param x - first coordinate of the key.
+  @param y - second coordinate of the key.
+  @param o - third coordinate of the key (e.g. octave).
 
   @return random value from the range.
 **/
-#define frand(f) (2.0 * ((FLOAT)(rand() & 0x7FFF) / (FLOAT)0x7FFF) * (FLOAT)(f) - (FLOAT)(f))
-
+#define hrand(f, s, x, y, o) (2.0 * ((FLOAT)(HashRand(s, x, y, o) & 0x7FFF) / (FLOAT)0x7FFF) * (FLOAT)(f) - (FLOAT)(f))
+
 
 /**
   GL_ARRAY_BUFFER_ARB
@@ -73,7 +127,222 @@
   - OpenGL constant not present in any header shipped with Code::Blocks.
 **/
 #define GL_STATIC_DRAW_ARB  0x88E4
-
+/**
+  GL_VERTEX_SHADER_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_VERTEX_SHADER_ARB 0x8B31
+/**
+  GL_FRAGMENT_SHADER_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_FRAGMENT_SHADER_ARB 0x8B30
+/**
+  GL_OBJECT_LINK_STATUS_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_OBJECT_LINK_STATUS_ARB 0x8B82
+/**
+  GL_TEXTURE0_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TEXTURE0_ARB 0x84C0
+/**
+  GL_TEXTURE1_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TEXTURE1_ARB 0x84C1
+/**
+  GL_TEXTURE2_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TEXTURE2_ARB 0x84C2
+/**
+  GL_TEXTURE3_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TEXTURE3_ARB 0x84C3
+/**
+  GL_MAX_TEXTURE_UNITS_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAX_TEXTURE_UNITS_ARB 0x84E2
+/**
+  GL_CLAMP_TO_EDGE
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_CLAMP_TO_EDGE 0x812F
+/**
+  GL_DEPTH_COMPONENT24_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_DEPTH_COMPONENT24_ARB 0x81A6
+/**
+  GL_COMBINE_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COMBINE_ARB 0x8570
+/**
+  GL_COMBINE_RGB_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COMBINE_RGB_ARB 0x8571
+/**
+  GL_COMBINE_ALPHA_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COMBINE_ALPHA_ARB 0x8572
+/**
+  GL_INTERPOLATE_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_INTERPOLATE_ARB 0x8575
+/**
+  GL_CONSTANT_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_CONSTANT_ARB 0x8576
+/**
+  GL_PRIMARY_COLOR_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_PRIMARY_COLOR_ARB 0x8577
+/**
+  GL_PREVIOUS_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_PREVIOUS_ARB 0x8578
+/**
+  GL_SOURCE0_RGB_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SOURCE0_RGB_ARB 0x8580
+/**
+  GL_SOURCE1_RGB_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SOURCE1_RGB_ARB 0x8581
+/**
+  GL_SOURCE2_RGB_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SOURCE2_RGB_ARB 0x8582
+/**
+  GL_SOURCE0_ALPHA_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SOURCE0_ALPHA_ARB 0x8588
+/**
+  GL_OPERAND2_RGB_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_OPERAND2_RGB_ARB 0x8592
+/**
+  GL_FRAMEBUFFER_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_FRAMEBUFFER_EXT 0x8D40
+/**
+  GL_RENDERBUFFER_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_RENDERBUFFER_EXT 0x8D41
+/**
+  GL_COLOR_ATTACHMENT0_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COLOR_ATTACHMENT0_EXT 0x8CE0
+/**
+  GL_DEPTH_ATTACHMENT_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_DEPTH_ATTACHMENT_EXT 0x8D00
+/**
+  GL_FRAMEBUFFER_COMPLETE_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_FRAMEBUFFER_COMPLETE_EXT 0x8CD5
+/**
+  GL_TIME_ELAPSED
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TIME_ELAPSED 0x88BF
+/**
+  GL_QUERY_RESULT_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_QUERY_RESULT_ARB 0x8866
+/**
+  GL_LUMINANCE32F_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_LUMINANCE32F_ARB 0x8818
+/**
+  GL_RGBA32F_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_RGBA32F_ARB 0x8814
+/**
+  GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS_ARB 0x8B4C
+/**
+  GL_WRITE_ONLY_ARB
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_WRITE_ONLY_ARB 0x88B9
+/**
+  GL_MAP_WRITE_BIT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAP_WRITE_BIT 0x0002
+/**
+  GL_MAP_INVALIDATE_RANGE_BIT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+/**
+  GL_MAP_INVALIDATE_BUFFER_BIT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+/**
+  GL_MAP_UNSYNCHRONIZED_BIT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+/**
+  GL_SYNC_GPU_COMMANDS_COMPLETE
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+/**
+  GL_SYNC_FLUSH_COMMANDS_BIT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+/**
+  GL_TIMEOUT_EXPIRED
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_TIMEOUT_EXPIRED 0x911B
+/**
+  GL_GENERATE_MIPMAP
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_GENERATE_MIPMAP 0x8191
+/**
+  GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+/**
+  GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+  - OpenGL constant not present in any header shipped with Code::Blocks.
+**/
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
 
 /// USE_NONE - we don`t want our VBO to be capable of anything.
 #define USE_NONE 0
@@ -89,21 +358,40 @@
 #define USE_CLRS (1 << 4)
 /// USE_OBJS - create some objects resting on the surface.
 #define USE_OBJS (1 << 5)
+/// USE_LODS - draw distant chunks with fewer polygons.
+#define USE_LODS (1 << 6)
+/// USE_PACK - store vertices interleaved, in a compact fixed point format.
+#define USE_PACK (1 << 7)
+/// USE_INST - draw all copies of a VBO with a single instanced call.
+#define USE_INST (1 << 8)
+/// USE_DISP - displace the landscape in the vertex shader (takes effect on creation).
+#define USE_DISP (1 << 9)
+/// USE_REFL - render the water reflection to a texture (see DrawReflection()).
+#define USE_REFL (1 << 10)
+/// USE_BAKE - shade the landscape by its baked light texture (see BakeMap()).
+#define USE_BAKE (1 << 11)
+/// USE_FBMN - take the heights from fBm noise instead of diamond-square (takes effect on creation).
+#define USE_FBMN (1 << 12)
+
+/// GLS_NONE - value of an FGLS field whose state is unknown and shall be set anew.
+#define GLS_NONE (~0U)
 
 /// DEG_CRAD - converts degrees into radians.
 #define DEG_CRAD (M_PI / 180.0)
 /// RAD_CDEG - converts radians into degrees.
 #define RAD_CDEG (180.0 / M_PI)
 
-/// DEF_TMRP - repainting timer delay.
-#define DEF_TMRP 16
-/// DEF_TMRC - recomputing timer delay.
-#define DEF_TMRC 32
+/// DEF_FMIN - minimal frame time in ms, kept when the vertical sync cannot be enabled.
+#define DEF_FMIN 7
+/// DEF_FDLT - maximal time step in seconds the camera moves by, so that it never jumps.
+#define DEF_FDLT 0.1
 
 /// DEF_FANG - accuracy coefficient for rotation; accuracy * speed = const.
 #define DEF_FANG 0.5
-/// DEF_FTRN - accuracy coefficient for movement; accuracy * speed = const.
-#define DEF_FTRN 15.0
+/// DEF_FTRN - camera speed, in units per second.
+#define DEF_FTRN 470.0
+/// DEF_FCAM - lowest height of the camera above the landscape it flies over (see MoveCamera()).
+#define DEF_FCAM 8.0
 
 /// DEF_FFOV - field of view (perspective coefficient).
 #define DEF_FFOV 45.0
@@ -112,14 +400,71 @@
 /// DEF_ZFAR - far clipping plane (perspective coefficient).
 #define DEF_ZFAR 8000.0
 
-/// DEF_LPWR - log2 of the total number of unique vertices in the landscape VBO.
+/// DEF_LPWR - log2 of the size of a landscape chunk, in elemental squares.
 #define DEF_LPWR 7
+/// DEF_WCHK - size of the whole world, in chunks; rounded up to a power of 2 for diamond-square.
+#define DEF_WCHK 24
 /// DEF_GRID - size of elemental squares that build our landscape.
 #define DEF_GRID 16.0
 /// DEF_FHEI - landscape height multiplier; peak height is DEF_FHEI / 2.
 #define DEF_FHEI 600.0
 /// DEF_WLVL - "sea level", i.e. minimal height; should be > -DEF_FHEI / 2.
 #define DEF_WLVL (-0.25 * DEF_FHEI)
+/// DEF_DMPF - "sharpness" of the heightmap (see MakeHeightmap).
+#define DEF_DMPF 1.0
+/// DEF_BLUR - strength of heightmap smoothing (see BlurHeightmap).
+#define DEF_BLUR 1.5
+/// DEF_NBAS - number of lattice cells along the world in the coarsest fBm octave.
+#define DEF_NBAS 4
+/// DEF_NOCT - maximum number of fBm octaves; the finest one is at least 2 squares wide.
+#define DEF_NOCT 24
+/// DEF_NWOC - number of octaves of the noise that warps the domain of the fBm noise.
+#define DEF_NWOC 4
+/// DEF_NWRP - strength of the domain warping, in lattice cells of the coarsest octave.
+#define DEF_NWRP 0.5
+/// DEF_NKEY - HashRand() key offset of the warping octaves, to differ from the height ones.
+#define DEF_NKEY 32
+/// DEF_CRAD - radius of the crater that [G] digs under the camera, in elemental squares.
+#define DEF_CRAD 6.0
+/// DEF_CDEP - depth of the crater that [G] digs, relative to the height range.
+#define DEF_CDEP 0.05
+
+/// DEF_DRAW - number of chunks drawn along each axis around the camera.
+#define DEF_DRAW 4
+/// DEF_NCHK - capacity of the chunk cache, with a prefetch ring; sizes oofs[] in vobs.
+#define DEF_NCHK ((DEF_DRAW + 2) * (DEF_DRAW + 2))
+/// DEF_CGEN - number of prefetched chunks that may be generated per frame.
+#define DEF_CGEN 1
+/// DEF_UPLB - number of bytes that finished chunks may upload per frame (see CollectChunks()).
+#define DEF_UPLB (2 << 20)
+/// DEF_NTHR - maximum number of worker threads generating chunks.
+#define DEF_NTHR 8
+/// DEF_NCEL - minimum number of heightmap points processed by a single thread.
+#define DEF_NCEL 65536
+/// DEF_HBLR - number of blur weights in hshd; shall match the size of gblr[] in fgen.
+#define DEF_HBLR 8
+/// DEF_NLOD - number of LOD levels per chunk, including the full-detail one.
+#define DEF_NLOD 4
+/// DEF_LODD - distance to a chunk (in chunks) at which each next LOD level starts.
+#define DEF_LODD 0.5
+/// DEF_HBIN - number of azimuth sectors of the occlusion horizon (see HorizonHide()).
+#define DEF_HBIN 256
+/// DEF_RLOD - LOD levels added to every chunk drawn to the reflection texture.
+#define DEF_RLOD 1
+/// DEF_RSHF - log2 of how many times the reflection texture is smaller than the window.
+#define DEF_RSHF 1
+/// DEF_ROFS - height of the oblique near plane of the reflection above the water.
+#define DEF_ROFS 1.0
+/// DEF_BAOD - number of directions the ambient occlusion of a baked corner is sampled in.
+#define DEF_BAOD 8
+/// DEF_BAOR - distance, in elemental squares, up to which the ambient occlusion is sampled.
+#define DEF_BAOR 8
+/// DEF_BAMB - ambient part of the baked light; the same as the default ambient light of OpenGL.
+#define DEF_BAMB 0.2
+/// DEF_BAKN - number of chunks whose light may be baked per frame.
+#define DEF_BAKN 2
+/// DEF_BTOL - light movement, in elemental squares, that makes the chunks be baked anew.
+#define DEF_BTOL 0.01
 
 /// DEF_ANGU - default camera direction, U component
 #define DEF_ANGU   0.0
@@ -155,9 +500,107 @@
 #define DEF_FILE "conf"DEF_FEXT
 /// DEF_FRMT - default serialization format.
 #define DEF_FRMT "%u %u %f %f %f %f %f %f %f %f %f %f %f"
+/// DEF_FLGS - default display flags of a newly created map.
+#define DEF_FLGS (USE_ARBV | USE_FILL | USE_NORM | USE_TEXC | USE_CLRS | USE_OBJS | USE_LODS | USE_PACK | USE_INST | USE_REFL)
+
+/// DEF_BARG - command line switch that starts the benchmark.
+#define DEF_BARG "-bench"
+/// DEF_BOUT - default file to write the benchmark results to.
+#define DEF_BOUT "bench.csv"
+/// DEF_BJSN - extension of the benchmark file that selects JSON instead of CSV.
+#define DEF_BJSN ".json"
+/// DEF_BNUM - number of seeds the benchmark runs; the seeds are 1, 2, ... DEF_BNUM.
+#define DEF_BNUM 3
+
+/// DEF_GARG - command line switch that starts the batch mode.
+#define DEF_GARG "-batch"
+/// DEF_GLST - default seed list of the batch mode.
+#define DEF_GLST "seeds"DEF_FEXT
+/// DEF_GDIR - directory of the thumbnails made by the batch mode, relative to the current one.
+#define DEF_GDIR "thumbs"
+/// DEF_GDIM - width and height of a thumbnail, in pixels.
+#define DEF_GDIM 256
+/// DEF_GMAP - number of worlds the batch mode generates at once, so that the workers never idle.
+#define DEF_GMAP 2
+/// DEF_GLOG - file in DEF_GDIR that the batch mode reports the skipped seeds to.
+#define DEF_GLOG "batch.log"
+/// DEF_BPMN - log2 of the smallest map the benchmark generates.
+#define DEF_BPMN 7
+/// DEF_BPMX - log2 of the largest map the benchmark generates.
+#define DEF_BPMX 10
+/// DEF_BFRM - number of frames in the benchmark camera flight.
+#define DEF_BFRM 600
+
+/// BEN_HMAP - benchmark stage: diamond-square heightmap.
+#define BEN_HMAP 0
+/// BEN_BLUR - benchmark stage: heightmap blur.
+#define BEN_BLUR 1
+/// BEN_SURF - benchmark stage: vertices, normals, colors, texture coords and LODs.
+#define BEN_SURF 2
+/// BEN_OBJS - benchmark stage: objects.
+#define BEN_OBJS 3
+/// BEN_UPLD - benchmark stage: upload to OpenGL.
+#define BEN_UPLD 4
+/// BEN_NSTG - number of benchmark stages.
+#define BEN_NSTG 5
+
+/// PRF_STRM - profiled frame phase: streaming and uploading chunks.
+#define PRF_STRM 0
+/// PRF_REFL - profiled frame phase: the reflection, whichever way it is drawn.
+#define PRF_REFL 1
+/// PRF_LAND - profiled frame phase: landscape chunks of the main pass.
+#define PRF_LAND 2
+/// PRF_OBJS - profiled frame phase: objects of the main pass.
+#define PRF_OBJS 3
+/// PRF_MINI - profiled frame phase: the minimap.
+#define PRF_MINI 4
+/// PRF_SWAP - profiled frame phase: the profiler overlay and SwapBuffers().
+#define PRF_SWAP 5
+/// PRF_NPHS - number of profiled frame phases.
+#define PRF_NPHS 6
+
+/// DEF_PWIN - number of the last frames the profiler statistics are taken over (see ProfFrame()).
+#define DEF_PWIN 256
+/// DEF_PQRY - number of frames a GPU timer query is given to finish before it is read.
+#define DEF_PQRY 4
+/// DEF_PLOG - file the profiler statistics are appended to.
+#define DEF_PLOG "profile.log"
 
 /// DEF_NOBJ - default number of objects.
-#define DEF_NOBJ 50
+#define DEF_NOBJ 400
+/// DEF_NATL - number of cells along each side of the object texture atlas, one per chunk.
+#define DEF_NATL 4
+/// DEF_PTEX - fixed point scale of the texture coords in packed vertices.
+#define DEF_PTEX 8.0
+/// DEF_IBLK - width of the columns (in squares) the landscape is indexed by.
+#define DEF_IBLK 4
+/// DEF_TPWR - log2 of the size of facet textures.
+#define DEF_TPWR 8
+/// DEF_NFAC - capacity of the facet texture cache (see FacetTex()).
+#define DEF_NFAC 8
+/// DEF_FDXT - nonzero to keep facet textures DXT compressed, if supported.
+#define DEF_FDXT 1
+/// DEF_KTEX - third HashRand() key coordinate of facet texture pixels; not a power of 2.
+#define DEF_KTEX 3
+/// DEF_KOBJ - third HashRand() key coordinate of object placement; not a power of 2.
+#define DEF_KOBJ 5
+/// DEF_KTIL - third HashRand() key coordinate of tile cache file names; not a power of 2.
+#define DEF_KTIL 7
+/// DEF_NINS - maximum number of instances per draw call; sizes fofs[] in vins.
+#define DEF_NINS 16
+/// DEF_NCLR - maximum number of colors in vdsp; shall match the size of dclr[] there.
+#define DEF_NCLR 8
+
+/// DEF_TDIR - directory of the tile cache, relative to the current one.
+#define DEF_TDIR "tiles"
+/// DEF_TVER - version of the tile cache format; shall grow when FTHD, FVBO or the chunks change.
+#define DEF_TVER 8
+/// DEF_TALN - alignment of everything in tile cache files, in bytes.
+#define DEF_TALN 64
+/// DEF_PALN - alignment of PoolAlloc() blocks and of the arrays within VBOs, in bytes.
+#define DEF_PALN 64
+/// DEF_PMAX - total size of the free blocks that the pool may keep, in bytes.
+#define DEF_PMAX (64 << 20)
 
 
 
@@ -217,6 +660,28 @@ typedef struct _FVEC {
 typedef struct _FTEX {
     FLOAT u, v;
 } FTEX;
+
+/**
+  @struct FQTN
+  A node of the height quadtree of a landscape (see QuadTree()): the range
+  of heights of the square corners within the area the node spans.
+**/
+typedef struct _FQTN {
+    FLOAT hmin, hmax;
+} FQTN;
+
+/**
+  @struct FVTX
+  A packed vertex that interleaves all per-vertex data in 20 bytes.\n
+  Position is in units of FVBO::vscl (the 4th component is padding),
+  texture coords are in units of 1 / DEF_PTEX, normal is scaled by 127.
+**/
+typedef struct _FVTX {
+    SHORT x, y, z, w;
+    SHORT u, v;
+    CHAR nx, ny, nz, nw;
+    FCLR c;
+} FVTX;
 #pragma pack(pop)
 
 /**
@@ -234,7 +699,14 @@ typedef struct _FVBO {
         &nbsp;&nbsp;&nbsp;&nbsp;USE_NORM: +normals\n
         &nbsp;&nbsp;&nbsp;&nbsp;USE_TEXC: +texture coordinates\n
         &nbsp;&nbsp;&nbsp;&nbsp;USE_CLRS: +colors\n
-        &nbsp;&nbsp;&nbsp;&nbsp;USE_OBJS: +objects
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_OBJS: +objects\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_LODS: +LODs\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_PACK: +packed vertices (takes effect on creation)\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_INST: +instancing\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_DISP: +displacement shader (takes effect on creation)\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_REFL: +reflection rendered to a texture (only looked at in FMAP::flgs)\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_BAKE: +baked light instead of GL lighting\n
+        &nbsp;&nbsp;&nbsp;&nbsp;USE_FBMN: +fBm noise heights instead of diamond-square (takes effect on creation)
     **/
     UINT flgs;
     /// horizontal and vertical dimension of the landscape map.
@@ -243,10 +715,27 @@ typedef struct _FVBO {
     UINT ndot;
     /// number of polygons; shall be passed to glDrawElements().
     UINT npol;
+    /// number of elements in the index array (FVBO::npol + stitched edges).
+    UINT nind;
+    /// type of the elements in the index array: GL_UNSIGNED_INT or GL_UNSIGNED_SHORT.
+    UINT ityp;
     /// ID of the facet texture associated with the landscape.
     UINT ntex;
     /// PRNG seed that was used to create the map.
     UINT seed;
+    /// amplitude of the facet texture; passed to FacetTex() with FVBO::tsed, 0 to use otex.
+    LONG trnd;
+    /// PRNG seed of the facet texture.
+    UINT tsed;
+    /** LOD level: each square of the VBO spans 2^nlod squares of the map.\n
+        Non-zero levels share all vertex data with the level 0 VBO that
+        precedes them in the FVBO::next chain; they only own the indices.
+    **/
+    UINT nlod;
+    /** edges that shall be stitched to a neighbour one LOD level coarser,
+        bit N set = edge N (bottom, right, top, left); set before drawing.
+    **/
+    UINT emsk;
 
     /// VBO ID for indices.
     UINT iind;
@@ -258,13 +747,34 @@ typedef struct _FVBO {
     UINT iclr;
     /// VBO ID for texture coords.
     UINT itex;
+    /// VBO ID for packed vertices.
+    UINT ivtx;
+    /// ID of the height texture; non-zero if the VBO is drawn by the displacement shader.
+    UINT ihgt;
+    /// ID of the baked light texture (see BakeLight()); 0 if the light has not been baked yet.
+    UINT ilgt;
+    /// number of color bands in FVBO::dscp, not counting the water color that follows them.
+    UINT nclr;
 
     /// width and height of the whole map grid.
     FLOAT grid;
     /// lowest point on the map; "sea level".
     FLOAT wlvl;
-
-    /// array with indices.
+    /// size of the unit of packed vertex positions.
+    FLOAT vscl;
+
+    /// lower corner of the bounding box.
+    FVEC bmin;
+    /// upper corner of the bounding box.
+    FVEC bmax;
+    /// lower corner of the box around the water; bigger than wmax if there is no water.
+    FVEC wmin;
+    /// upper corner of the box around the water.
+    FVEC wmax;
+    /// light position, relative to the center of the landscape, that FVBO::ilgt was baked for.
+    FVEC lbak;
+
+    /// array with indices; its elements are of FVBO::ityp type.
     FTRI *indx;
     /// array with vertices.
     FVEC *vect;
@@ -274,6 +784,40 @@ typedef struct _FVBO {
     FCLR *clrs;
     /// array with texture coords.
     FTEX *texc;
+    /// array with packed vertices; NULL if the VBO is not packed, or after ReleaseVBO().
+    FVTX *vtxs;
+    /// (ndim + 3) x (ndim + 3) heights for the height texture; NULL once it is uploaded.
+    FLOAT *hpix;
+    /** colors of the displacement shader: bands with the absolute heights
+        they end at, then the water color; NULL without the height texture.
+        Owned by the level 0 VBO.
+    **/
+    struct _FHEI *dscp;
+    /** file view that the indices and packed vertices of the whole chain
+        point into if it was loaded by LoadTile(); NULL if they are allocated.
+        Only set in the first VBO of the chain, which unmaps it when freed.
+    **/
+    LPVOID view;
+    /** (ndim + 1) x (ndim + 1) heights of the square corners of a landscape,
+        kept for height queries (see MapHeight()) when the rest of the CPU
+        data is released by ReleaseVBO(); NULL in LODs and objects.
+    **/
+    FLOAT *hgts;
+    /** quadtree over FVBO::hgts, see QuadTree(); kept and dropped with
+        them. Not stored in the tile cache, LoadTile() rebuilds it.
+    **/
+    FQTN *qtre;
+    /** (ndim + 1) x (ndim + 1) ambient occlusion of the square corners, 255
+        meaning the whole sky is seen (see MakeOcclusion()); kept and dropped
+        with FVBO::hgts, NULL until the light is first baked, unless USE_BAKE
+        was set on creation. Not stored in the tile cache.
+    **/
+    BYTE *aocc;
+    /** vertex indices of the square centers of the parent landscape that
+        the objects stand on, one per object (see PlaceFir()); NULL in
+        landscapes and LODs.
+    **/
+    UINT *ocel;
 } FVBO;
 
 /**
@@ -313,6 +857,386 @@ typedef struct _FHEI {
     FCLR fclr;
 } FHEI;
 
+/**
+  @struct FCHK
+  A slot of the chunk cache: the landscape VBO of the chunk and its position.
+**/
+typedef struct _FCHK {
+    /// landscape VBO of the chunk; NULL if the slot is free or the chunk is not ready yet.
+    FVBO *vobj;
+    /// horizontal index of the chunk within the world.
+    LONG xpos;
+    /// vertical index of the chunk within the world.
+    LONG ypos;
+    /// the last frame in which the chunk was needed; used for LRU eviction.
+    UINT used;
+    /// nonzero while the chunk is being generated by a worker thread.
+    UINT load;
+    /// number of indices of the objects of the chunk in the shared buffers; 0 if not there.
+    UINT nobj;
+    /// number of those indices that are not padding; only valid if FCHK::nobj is nonzero.
+    UINT nind;
+} FCHK;
+
+/**
+  @struct FMAP
+  The world: a toroidal map made of equal chunks that are generated when they
+  approach the camera and evicted when the cache needs their slots.
+**/
+typedef struct _FMAP {
+    /// display flags that are passed to every chunk (see FVBO::flgs).
+    UINT flgs;
+    /// PRNG seed that was used to create the world.
+    UINT seed;
+    /// horizontal and vertical dimension of the world, in elemental squares.
+    UINT wdim;
+    /// horizontal and vertical dimension of a chunk, in elemental squares.
+    UINT cdim;
+    /// number of slots in the chunk cache.
+    UINT nchk;
+    /// number of frames streamed so far; the clock for FCHK::used.
+    UINT nfrm;
+    /// number of chunks queued for the worker threads or being generated.
+    UINT njob;
+    /// VBO ID for the packed vertices of the objects of all chunks (see BatchObjects()).
+    UINT ivtx;
+    /// VBO ID for the indices of the objects of all chunks, pointing into FMAP::ivtx.
+    UINT iind;
+
+    /// width and height of the whole world.
+    FLOAT grid;
+    /// width and height of an elemental square.
+    FLOAT cell;
+    /// height range.
+    FLOAT fhei;
+    /// lowest point in the world; "sea level".
+    FLOAT wlvl;
+    /// raw heightmap value that is mapped onto the bottom of the height range.
+    FLOAT hmin;
+    /// raw heightmap value that is mapped onto the top of the height range.
+    FLOAT hmax;
+
+    /// camera position in the world; the one to start from until it is shown.
+    FVEC ftrn;
+    /// camera direction to start from, set by ShowMap().
+    FTEX fang;
+    /// light position to start from, set by ShowMap().
+    FLOAT lpos[4];
+    /// light direction to start from, set by ShowMap().
+    FLOAT ldir[4];
+
+    /// array of FHEIs for mapping colors to heights.
+    FHEI *lscp;
+    /// the chunk cache.
+    FCHK *chnk;
+} FMAP;
+
+/**
+  @struct FJOB
+  A chunk to be generated by a worker thread.
+**/
+typedef struct _FJOB {
+    /// next job in the queue.
+    struct _FJOB *next;
+    /// world that the chunk belongs to.
+    FMAP *wmap;
+    /// cache slot that shall receive the chunk.
+    FCHK *fchk;
+    /// horizontal index of the chunk within the world.
+    LONG xpos;
+    /// vertical index of the chunk within the world.
+    LONG ypos;
+    /// the result; not drawable until the fence is passed.
+    FVBO *vobj;
+    /// nonzero if the result has been uploaded.
+    UINT upld;
+    /// fence that the upload shall pass before the chunk goes to its slot; NULL if none.
+    LPVOID sync;
+    /// TRUE while the heights of the chunk wait for the GPU (see TextureChunk()).
+    BOOL hgpu;
+    /// (cdim + 3) x (cdim + 3) heights computed on the GPU; NULL if there are none.
+    FLOAT *hgts;
+    /// height texture that FJOB::hgts were read from; 0 if there is none.
+    UINT ihgt;
+} FJOB;
+
+/**
+  @struct FROW
+  A strip of rows to be processed by a separate thread (see SplitRows()).
+**/
+typedef struct _FROW {
+    /// function that processes the rows [ybgn; yend) of data.
+    void (*func)(LPVOID, LONG, LONG);
+    /// data shared by all the strips.
+    LPVOID data;
+    /// first row of the strip.
+    LONG ybgn;
+    /// row after the last one of the strip.
+    LONG yend;
+} FROW;
+
+/**
+  @struct FDSQ
+  A step of the diamond-square algorithm, to be done by HeightRows().
+**/
+typedef struct _FDSQ {
+    /// the heightmap.
+    FLOAT *farr;
+    /// amplitude of the random values.
+    FLOAT hdef;
+    /// PRNG seed.
+    UINT seed;
+    /// width and height of the heightmap minus 1.
+    LONG size;
+    /// distance between the points computed.
+    LONG step;
+    /// TRUE for the diamond step, FALSE for the square one.
+    BOOL diam;
+} FDSQ;
+
+/**
+  @struct FHGN
+  The region of the diamond-square heightmap that the height texture of a
+  displaced chunk is made of, and how it becomes heights; see
+  TextureHeightmap().
+**/
+typedef struct _FHGN {
+    /// size of the world.
+    UINT wdim;
+    /// PRNG seed of the world.
+    UINT seed;
+    /// X coordinate of the first point of the region.
+    LONG xbgn;
+    /// Y coordinate of the first point of the region.
+    LONG ybgn;
+    /// number of squares along each side of the region.
+    LONG size;
+    /// position of the first texel of the height texture in the region; wraps around it.
+    LONG hofs;
+    /// heightmap value that becomes the bottom of the height range.
+    FLOAT fmin;
+    /// scale from heightmap values to heights.
+    FLOAT fscl;
+    /// height range.
+    FLOAT fhei;
+    /// "sea level" within the range.
+    FLOAT wlvl;
+} FHGN;
+
+/**
+  @struct FNSE
+  A region of the fBm noise heightmap, to be done by NoiseRows().
+**/
+typedef struct _FNSE {
+    /// the heightmap.
+    FLOAT *farr;
+    /// PRNG seed.
+    UINT seed;
+    /// size of the world; the noise wraps around it.
+    LONG wdim;
+    /// X coordinate of the first point.
+    LONG xbgn;
+    /// Y coordinate of the first point.
+    LONG ybgn;
+    /// width and height of the heightmap minus 1.
+    LONG size;
+    /// distance between the points.
+    LONG step;
+    /// number of octaves.
+    LONG noct;
+    /// number of lattice cells along the world, per octave.
+    LONG nlat[DEF_NOCT];
+    /// lattice cells per elemental square, per octave.
+    FLOAT fscl[DEF_NOCT];
+    /// amplitude, per octave.
+    FLOAT famp[DEF_NOCT];
+    /// distance the warping noise shifts the points by at its amplitude of 1.
+    FLOAT fwrp;
+} FNSE;
+
+/**
+  @struct FBLR
+  A pass of the heightmap blur, to be done by BlurRows().
+**/
+typedef struct _FBLR {
+    /// source heightmap.
+    FLOAT *fsrc;
+    /// destination heightmap; shall not be the same as fsrc.
+    FLOAT *fdst;
+    /// blur kernel; blur[0] is the weight of the center.
+    FLOAT *blur;
+    /// width and height of the heightmap minus 1.
+    LONG size;
+    /// radius of the kernel.
+    LONG rblr;
+    /// TRUE if the rows are blurred vertically, FALSE if horizontally.
+    BOOL vert;
+} FBLR;
+
+/**
+  @struct FBAK
+  A pass of the light baking of a landscape, to be done by OcclusionRows()
+  or LightRows().
+**/
+typedef struct _FBAK {
+    /// (ndim + 1) x (ndim + 1) heights of the square corners.
+    FLOAT *hgts;
+    /// ambient occlusion of the corners; made by OcclusionRows(), used by LightRows().
+    BYTE *aocc;
+    /// luminance of the corners, made by LightRows().
+    BYTE *lpix;
+    /// horizontal and vertical dimension of the landscape.
+    LONG ndim;
+    /// first row of corners to be done; the rows that SplitRows() passes are counted from it.
+    LONG ybgn;
+    /// width and height of an elemental square.
+    FLOAT cell;
+    /// highest point of the landscape; nothing casts a shadow above it.
+    FLOAT hmax;
+    /// light position relative to the center of the landscape.
+    FVEC lvec;
+} FBAK;
+
+/**
+  @struct FTHD
+  The header of a tile cache file. It holds everything the chunk depends on,
+  so the file is only used if its header matches the one made by TileHead().
+
+  It is followed by the chain of VBOs, each being a raw FVBO, then the packed
+  vertices (for level 0 VBOs), the indices and the heights (if the VBO has
+  FVBO::hgts), every part aligned to DEF_TALN so that it can be passed to
+  OpenGL right from the mapped file.
+**/
+typedef struct _FTHD {
+    /// format version; DEF_TVER.
+    UINT tver;
+    /// size of FVBO in the program that wrote the file.
+    UINT tsiz;
+    /// creation-time flags the chunk was made with (see FVBO::flgs).
+    UINT flgs;
+    /// PRNG seed of the world.
+    UINT seed;
+    /// horizontal and vertical dimension of the world, in elemental squares.
+    UINT wdim;
+    /// horizontal and vertical dimension of the chunk, in elemental squares.
+    UINT cdim;
+    /// hash of the colors and heights of FMAP::lscp.
+    UINT lkey;
+    /// width and height of an elemental square.
+    FLOAT cell;
+    /// height range.
+    FLOAT fhei;
+    /// lowest point in the world; "sea level".
+    FLOAT wlvl;
+    /// horizontal index of the chunk within the world.
+    LONG xpos;
+    /// vertical index of the chunk within the world.
+    LONG ypos;
+    /// number of VBOs in the chain.
+    UINT nvbo;
+} FTHD;
+
+/**
+  @struct FPBK
+  The header of a memory block given by PoolAlloc(); it directly precedes
+  the block, so that PoolFree() can find it.
+**/
+typedef struct _FPBK {
+    /// next free block of the pool.
+    struct _FPBK *next;
+    /// what malloc() returned; the block is aligned within it.
+    LPVOID base;
+    /// usable size of the block.
+    SIZE_T size;
+} FPBK;
+
+/**
+  @struct FFAC
+  A facet texture in the cache (see FacetTex()); the texture depends on
+  nothing but the amplitude and the seed, so VBOs share it.
+**/
+typedef struct _FFAC {
+    /// texture ID; 0 if the entry is empty.
+    UINT ntex;
+    /// number of VBOs using the texture; unused textures stay until evicted.
+    UINT nref;
+    /// amplitude, as in FVBO::trnd.
+    LONG trnd;
+    /// PRNG seed, as in FVBO::tsed.
+    UINT tsed;
+} FFAC;
+
+/**
+  @struct FGLS
+  The GL state the drawing functions have set up, so that consecutive draws
+  only change what actually differs (see StateApply()). Also used to request
+  the state a draw needs, in which case FGLS::iind and FGLS::iarr are not
+  looked at; buffers are bound by StateBind().
+**/
+typedef struct _FGLS {
+    /// polygon mode: GL_FILL or GL_LINE.
+    UINT pmod;
+    /// client arrays enabled along with the vertex array: USE_NORM, USE_TEXC, USE_CLRS.
+    UINT arrs;
+    /// texture bound to unit 0; 0 if GL_TEXTURE_2D is disabled.
+    UINT ntex;
+    /// bound index buffer.
+    UINT iind;
+    /// bound array buffer.
+    UINT iarr;
+    /// program in use.
+    UINT prog;
+    /// whether GL_NORMALIZE is enabled.
+    BOOL nrmz;
+    /// TRUE if the current color is white (or, in a request, shall be made white).
+    BOOL wclr;
+    /// scale of the texture matrix.
+    FLOAT tscl;
+    /// baked light texture bound to unit 3, which turns GL lighting off; 0 if none.
+    UINT nlgt;
+    /// scale of the texture matrix of unit 3, where the texture is offset by 0.5 (see DrawVBO()).
+    FLOAT lscl;
+} FGLS;
+
+/**
+  @struct FPRF
+  The frame profiler: CPU and GPU times of every phase (see PRF_NPHS) and
+  the draw call and triangle counts of the last DEF_PWIN frames, indexed by
+  the frame number modulo DEF_PWIN. GPU times arrive DEF_PQRY frames late.
+**/
+typedef struct _FPRF {
+    /// TRUE if the frames are profiled and the overlay is shown.
+    BOOL used;
+    /// number of frames profiled so far.
+    UINT nfrm;
+    /// draw calls issued in the current frame; counted even when not profiling.
+    UINT ndrw;
+    /// triangles drawn in the current frame; counted even when not profiling.
+    UINT ntri;
+    /// display lists of the overlay font, 0 if not made yet.
+    UINT font;
+    /// height of a line of the overlay font.
+    LONG lhei;
+    /// milliseconds per tick of QueryPerformanceCounter().
+    FLOAT fmsc;
+    /// counter value that the current phase began at.
+    LONGLONG tbgn;
+    /// draw calls of the frames.
+    UINT fdrw[DEF_PWIN];
+    /// triangles of the frames.
+    UINT ftri[DEF_PWIN];
+    /// CPU time of every phase of the frames, in milliseconds.
+    FLOAT fcpu[PRF_NPHS][DEF_PWIN];
+    /// GPU time of every phase of the frames, in milliseconds.
+    FLOAT fgpu[PRF_NPHS][DEF_PWIN];
+    /// timer queries of the frames in flight, one per phase; 0 without ARB_timer_query.
+    UINT iqry[DEF_PQRY][PRF_NPHS];
+    /// phases whose queries were issued in each of the frames in flight, bit N = phase N.
+    UINT fmsk[DEF_PQRY];
+    /// the statistics as shown by the overlay, remade at the end of every frame.
+    CHAR text[PRF_NPHS + 4][128];
+} FPRF;
+
 
 
 /// Main GDI device context
@@ -323,10 +1247,6 @@ HGLRC RC;
 BOOL paint;
 /// Path to the config file
 LPSTR path;
-/// ID of a timer that recomputes the scene
-UINT tmrc;
-/// ID of a timer that repaints the scene
-UINT tmrp;
 /// Prevoius mouse position
 POINT angp;
 /// Current mouse position
@@ -340,14 +1260,56 @@ FTEX fang;
 FLOAT lpos[4];
 /// Light direction
 FLOAT ldir[4];
-/// Main landsape VBO
-FVBO *land = NULL;
+/// Main landsape world
+FMAP *land = NULL;
+/// World that is being generated to replace the main one
+FMAP *lnew = NULL;
+/// Worker threads that generate chunks
+HANDLE thrd[DEF_NTHR];
+/// Number of worker threads; 0 means that chunks are generated synchronously
+UINT nthr = 0;
+/// Semaphore that counts the jobs queued for the worker threads
+HANDLE jsem;
+/// Critical section that guards the job queues
+CRITICAL_SECTION jcrs;
+/// Jobs queued for the worker threads, head and tail
+FJOB *jnew = NULL, *jtal = NULL;
+/// Jobs done by the worker threads, waiting for upload
+FJOB *jend = NULL;
+/// Jobs taken from jend by the window thread, either waiting for upload or for their fences
+FJOB *jupl = NULL;
+/// Signals the worker threads to quit
+BOOL jstp = FALSE;
 /// Array that holds keystrokes
 BOOL keys[256] = {};
 /// Previous frame timestamp
 UINT tick = 0;
 /// Number of frames drawn
 UINT fram = 0;
+/// Default mapping of heights to colors
+FHEI dlsc[] = {{.fhei = 0.1, .fclr.RGBA = 0xFF76DDFC},
+               {.fhei = 8.0, .fclr.RGBA = 0xFF30A15D},
+               {.fhei = 6.5, .fclr.RGBA = 0xFF808080},
+               {.fhei = 5.0, .fclr.RGBA = 0xFFFFFFFF},
+               {.fhei = 0.0, .fclr.RGBA = 0x80AC630D}};
+/// Benchmark results file; NULL unless the benchmark was requested
+LPSTR bout = NULL;
+/// Seed list of the batch mode; NULL unless the batch mode was requested
+LPSTR slst = NULL;
+/// Benchmark stage timers (see BEN_NSTG); NULL unless the benchmark is running
+LONGLONG *btim = NULL;
+/// Frame profiler, see ProfBegin()
+FPRF prof = {};
+
+/// free blocks of the memory pool, most recently freed first.
+FPBK *pool = NULL;
+/// total size of the free blocks.
+SIZE_T psiz = 0;
+/// guards the pool; chunks are allocated by the workers and freed by the window thread.
+CRITICAL_SECTION pcrs;
+
+/// GL state cache of DrawVBO() and DrawObjects(); only valid between StateReset() calls.
+FGLS glst = {GLS_NONE, GLS_NONE, GLS_NONE, GLS_NONE, GLS_NONE, GLS_NONE, FALSE, FALSE, 1.0, GLS_NONE, 0.0};
 
 /// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
 void CALLBACK (*glGenBuffersARB)(GLsizei, GLuint*) = NULL;
@@ -356,735 +1318,5573 @@ void CALLBACK (*glBindBufferARB)(GLenum, GLuint);
 /// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
 void CALLBACK (*glBufferDataARB)(GLenum, GLsizei, const void*, GLenum);
 /// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glBufferSubDataARB)(GLenum, GLsizei, GLsizei, const void*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
 void CALLBACK (*glDelBuffersARB)(GLsizei, const GLuint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+LPVOID CALLBACK (*glMapBufferARB)(GLenum, GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLboolean CALLBACK (*glUnmapBufferARB)(GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+LPVOID CALLBACK (*glMapBufferRange)(GLenum, GLsizei, GLsizei, GLbitfield) = NULL;
 
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+LPVOID CALLBACK (*glFenceSync)(GLenum, GLbitfield) = NULL;
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLenum CALLBACK (*glClientWaitSync)(LPVOID, GLbitfield, ULONGLONG);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDeleteSync)(LPVOID);
 
-
-/**
-  @brief MakeFacetTex
-  creates a microfacet texture containing a white noise pattern.
-
-  @param rndc - absolute value defines the amplitude of white noise, (0; 256].
-                sign shows if the texture needs to be transparent; < 0 == yes.
-
-  @return texture ID on success, 0 on failure (either by OGL or if rndc == 0).
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDrawElementsInstancedARB)(GLenum, GLsizei, GLenum, const void*, GLsizei) = NULL;
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLuint CALLBACK (*glCreateShaderObjectARB)(GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glShaderSourceARB)(GLuint, GLsizei, const CHAR**, const GLint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glCompileShaderARB)(GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLuint CALLBACK (*glCreateProgramObjectARB)(void);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glAttachObjectARB)(GLuint, GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glLinkProgramARB)(GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUseProgramObjectARB)(GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glGetObjectParameterivARB)(GLuint, GLenum, GLint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDeleteObjectARB)(GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLint CALLBACK (*glGetUniformLocationARB)(GLuint, const CHAR*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform1fARB)(GLint, GLfloat);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform3fvARB)(GLint, GLsizei, const GLfloat*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform1iARB)(GLint, GLint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform2fARB)(GLint, GLfloat, GLfloat);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform3fARB)(GLint, GLfloat, GLfloat, GLfloat);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform1fvARB)(GLint, GLsizei, const GLfloat*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform4fvARB)(GLint, GLsizei, const GLfloat*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glUniform4iARB)(GLint, GLint, GLint, GLint, GLint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glActTextureARB)(GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glGenFramebuffersEXT)(GLsizei, GLuint*) = NULL;
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glBindFramebufferEXT)(GLenum, GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glFramebufferTexture2DEXT)(GLenum, GLenum, GLenum, GLuint, GLint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glFramebufferRenderbufferEXT)(GLenum, GLenum, GLenum, GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+GLenum CALLBACK (*glCheckFramebufferStatusEXT)(GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDeleteFramebuffersEXT)(GLsizei, const GLuint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glGenRenderbuffersEXT)(GLsizei, GLuint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glBindRenderbufferEXT)(GLenum, GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glRenderbufferStorageEXT)(GLenum, GLenum, GLsizei, GLsizei);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDeleteRenderbuffersEXT)(GLsizei, const GLuint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glGenQueriesARB)(GLsizei, GLuint*) = NULL;
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glDeleteQueriesARB)(GLsizei, const GLuint*);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glBeginQueryARB)(GLenum, GLuint);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glEndQueryARB)(GLenum);
+/// This function is to be loaded manually, since its implementation may vastly depend on the pixel format.
+void CALLBACK (*glGetQueryObjectui64v)(GLuint, GLenum, ULONGLONG*);
+/** This function is to be loaded manually, since its implementation may vastly
+    depend on the pixel format; it is asked for directly, as drivers often
+    leave WGL_EXT_swap_control out of GL_EXTENSIONS.
 **/
-UINT MakeFacetTex(LONG rndc) {
-    UINT x, y, dpos, itex;
-    BOOL trns = rndc < 0;
-    FCLR *ctex;
+BOOL CALLBACK (*wglSwapIntervalEXT)(int) = NULL;
+
+/// Reflection framebuffer (see DrawReflection()); 0 if render to texture is not supported
+UINT rfbo = 0;
+/// Framebuffer the scene is drawn to; 0 unless the batch mode draws a thumbnail
+UINT sfbo = 0;
+/// Color texture of rfbo, sampled by the water from texture unit 2
+UINT rtex = 0;
+/// Depth renderbuffer of rfbo
+UINT rdep = 0;
+/// Part of rtex the reflection is drawn to, in pixels
+POINT rvpt;
+/// Size of rtex, in pixels
+POINT rtsz;
+
+/// Instancing shader program; 0 if instancing is not supported
+UINT ishd = 0;
+/// Location of the instance offset array in ishd
+GLint iofs;
+/// Location of the vertex scale in ishd
+GLint iscl;
+/// Location of the baked light switch in ishd
+GLint ibak;
+/// TRUE if the light of the landscape can be baked (see BakeMap())
+BOOL blgt = FALSE;
+/// Turns the value of a constant into a string, to size shaders by the same constants
+#define SHD_CNST(c) SHD_TEXT(c)
+#define SHD_TEXT(c) #c
+/** GLSL function that does the same per-vertex lighting as the fixed pipeline
+    does for GL_LIGHT0 with GL_COLOR_MATERIAL; shared by all vertex shaders.
+    Non-zero lbak leaves the color as is, the light being baked (USE_BAKE).
+**/
+#define SHD_LGHT \
+    "uniform float lbak;\n" \
+    "vec4 Light(vec4 epos, vec3 norm, vec4 colr) {\n" \
+    "    if (lbak != 0.0) return colr;\n" \
+    "    vec3 ldir = gl_LightSource[0].position.xyz - epos.xyz * gl_LightSource[0].position.w;\n" \
+    "    float dist = length(ldir), attn = 1.0, spot;\n" \
+    "    ldir /= dist;\n" \
+    "    if (gl_LightSource[0].position.w != 0.0)\n" \
+    "        attn /= gl_LightSource[0].constantAttenuation + dist * (gl_LightSource[0].linearAttenuation\n" \
+    "              + dist * gl_LightSource[0].quadraticAttenuation);\n" \
+    "    if (gl_LightSource[0].spotCutoff < 180.0) {\n" \
+    "        spot = dot(-ldir, normalize(gl_LightSource[0].spotDirection));\n" \
+    "        attn *= (spot < gl_LightSource[0].spotCosCutoff)? 0.0 : pow(spot, gl_LightSource[0].spotExponent);\n" \
+    "    }\n" \
+    "    return vec4(gl_FrontMaterial.emission.rgb + colr.rgb * (gl_LightModel.ambient.rgb\n" \
+    "              + attn * (gl_LightSource[0].ambient.rgb + max(dot(norm, ldir), 0.0) * gl_LightSource[0].diffuse.rgb)), colr.a);\n" \
+    "}\n"
+
+/** Vertex shader for instancing: moves each instance by its own offset,
+    then does the same per-vertex lighting, texturing and fog setup as the
+    fixed pipeline does for GL_LIGHT0 with GL_COLOR_MATERIAL. Unit 2 gets
+    the eye position, as the eye-linear texgen of the reflection does, and
+    unit 3 the object position, as the object-linear texgen of the baked light.
+**/
+LPSTR vins =
+    "#extension GL_ARB_draw_instanced : require\n"
+    "uniform vec3 fofs[" SHD_CNST(DEF_NINS) "];\n"
+    "uniform float fscl;\n"
+    SHD_LGHT
+    "void main() {\n"
+    "    vec4 epos = gl_ModelViewMatrix * vec4(gl_Vertex.xyz * fscl + fofs[gl_InstanceIDARB], 1.0);\n"
+    "    gl_FrontColor = gl_BackColor = Light(epos, normalize(gl_NormalMatrix * gl_Normal), gl_Color);\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;\n"
+    "    gl_TexCoord[2] = gl_TextureMatrix[2] * epos;\n"
+    "    gl_TexCoord[3] = gl_TextureMatrix[3] * vec4(gl_Vertex.xyz, 1.0);\n"
+    "    gl_FogFragCoord = abs(epos.z);\n"
+    "    gl_Position = gl_ProjectionMatrix * epos;\n"
+    "}\n";
+
+/// Shader program for batched objects; 0 if shaders are not supported
+UINT oshd = 0;
+/// Location of the slot offset array in oshd
+GLint oofs;
+/// Texture atlas shared by all objects
+UINT otex = 0;
+/// Facet texture cache
+FFAC fcac[DEF_NFAC] = {};
+/// TRUE if mipmaps can be built by OpenGL (GL_SGIS_generate_mipmap)
+BOOL fgmp = FALSE;
+/// TRUE if facet textures can be DXT-compressed (GL_EXT_texture_compression_s3tc)
+BOOL fdxt = FALSE;
+
+/** Vertex shader for batched objects: moves the objects of each cache slot
+    by the offset of their chunk, given with the vertex scale in oofs[] and
+    indexed by the 4th position component. A zero scale collapses the slot,
+    which hides it. Lighting, texturing and fog are the same as in vins.
+**/
+LPSTR vobs =
+    "uniform vec4 oofs[" SHD_CNST(DEF_NCHK) "];\n"
+    SHD_LGHT
+    "void main() {\n"
+    "    vec4 fofs = oofs[int(gl_Vertex.w)];\n"
+    "    vec4 epos = gl_ModelViewMatrix * vec4(gl_Vertex.xyz * fofs.w + fofs.xyz, 1.0);\n"
+    "    gl_FrontColor = gl_BackColor = Light(epos, normalize(gl_NormalMatrix * gl_Normal), gl_Color);\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;\n"
+    "    gl_TexCoord[2] = gl_TextureMatrix[2] * epos;\n"
+    "    gl_FogFragCoord = abs(epos.z);\n"
+    "    gl_Position = gl_ProjectionMatrix * epos;\n"
+    "}\n";
+
+/// Displacement shader program; 0 if vertex texture fetch is not supported
+UINT dshd = 0;
+/// Location of the grid parameters in dshd: size of the square, ndim, "sea level"
+GLint dprm;
+/// Location of the flags in dshd: compute normals, compute colors
+GLint dflg;
+/// Location of the band heights in dshd
+GLint dhei;
+/// Location of the band and water colors in dshd
+GLint dclr;
+/// Location of the number of bands in dshd
+GLint dnum;
+/// Location of the baked light switch in dshd
+GLint dbak;
+/// Height generator program (see TextureHeightmap()); 0 if not supported
+UINT hshd = 0;
+/// Location of the pass number in hshd
+GLint hmod;
+/// Location of the PRNG seed in hshd
+GLint hsed;
+/// Location of the current level in hshd: X and Y of its origin, step, world size
+GLint hcur;
+/// Location of the previous level in hshd: X and Y of its origin, step, dimension
+GLint hpre;
+/// Location of the random value amplitude in hshd
+GLint hhdf;
+/// Location of the blur kernel in hshd
+GLint hblr;
+/// Location of the blur radius in hshd
+GLint hnbl;
+/// Location of the height normalization in hshd: bottom value, scale, half range, "sea level"
+GLint hnrm;
+/// Framebuffer that hshd renders to
+UINT hfbo = 0;
+/// Ping-pong textures of hshd
+UINT htex[2] = {};
+/// Width and height of htex
+LONG hdim = 0;
+/** Fragment shader of the height generator: one pass of TextureHeightmap()
+    per draw, texel by texel; the diamond-square passes follow the levels
+    of RegionHeightmap(), with HashRand() redone in unsigned integers.
+**/
+LPSTR fgen =
+    "#extension GL_EXT_gpu_shader4 : require\n"
+    "uniform sampler2D hsrc;\n"
+    "uniform int gmod, gsed, gnbl;\n"
+    "uniform ivec4 gcur, gpre;\n"
+    "uniform float ghdf, gblr[8];\n"
+    "uniform vec4 gnrm;\n"
+    "unsigned int HashRand(unsigned int seed, unsigned int xkey, unsigned int ykey, unsigned int okey) {\n"
+    "    unsigned int hash = seed + 0x9E3779B9u * (xkey + 1u);\n"
+    "    hash = (hash ^ (hash >> 16u)) * 0x85EBCA6Bu + 0xC2B2AE35u * (ykey + 1u);\n"
+    "    hash = (hash ^ (hash >> 13u)) * 0x27D4EB2Fu + 0x165667B1u * (okey + 1u);\n"
+    "    hash = (hash ^ (hash >> 16u)) * 0x85EBCA6Bu;\n"
+    "    hash = (hash ^ (hash >> 13u)) * 0xC2B2AE35u;\n"
+    "    return hash ^ (hash >> 16u);\n"
+    "}\n"
+    "float Rand(ivec2 gpos) {\n"
+    "    unsigned int hash = HashRand(unsigned int(gsed), unsigned int(gpos.x & (gcur.w - 1)),\n"
+    "                                 unsigned int(gpos.y & (gcur.w - 1)), unsigned int(gcur.z));\n"
+    "    return ghdf * (float(hash & 0x7FFFu) / 32767.0 - 0.5);\n"
+    "}\n"
+    "float Prev(ivec2 gpos) {\n"
+    "    return texelFetch2D(hsrc, (gpos - gpre.xy) / gpre.z, 0).r;\n"
+    "}\n"
+    "float Texel(ivec2 tpos) {\n"
+    "    return texelFetch2D(hsrc, tpos, 0).r;\n"
+    "}\n"
+    "ivec2 Wrap(ivec2 tpos) {\n"
+    "    return tpos + ivec2(lessThan(tpos, ivec2(0))) * gpre.w - ivec2(greaterThan(tpos, ivec2(gpre.w))) * gpre.w;\n"
+    "}\n"
+    "void main() {\n"
+    "    ivec2 tpos = ivec2(gl_FragCoord.xy), gpos = gcur.xy + (tpos - 1) * gcur.z;\n"
+    "    float retn = 0.0;\n"
+    "    if (gmod == 0) {\n"
+    "        if (((gpos.x | gpos.y) & gcur.z) == 0)\n"
+    "            retn = Prev(gpos);\n"
+    "        else if ((gpos.x & gpos.y & gcur.z) != 0)\n"
+    "            retn = Rand(gpos) + 0.25 * (Prev(gpos - gcur.z) + Prev(gpos + ivec2(gcur.z, -gcur.z))\n"
+    "                                      + Prev(gpos + ivec2(-gcur.z, gcur.z)) + Prev(gpos + gcur.z));\n"
+    "    }\n"
+    "    else if (gmod == 1) {\n"
+    "        retn = Texel(tpos);\n"
+    "        if ((((gpos.x ^ gpos.y) & gcur.z) != 0) && all(greaterThan(tpos, ivec2(0))) && all(lessThan(tpos, ivec2(gpre.w - 1))))\n"
+    "            retn = Rand(gpos) + 0.25 * (Texel(tpos - ivec2(1, 0)) + Texel(tpos + ivec2(1, 0))\n"
+    "                                      + Texel(tpos - ivec2(0, 1)) + Texel(tpos + ivec2(0, 1)));\n"
+    "    }\n"
+    "    else if (gmod == 2) {\n"
+    "        retn = gblr[0] * Texel(tpos + gpre.x);\n"
+    "        for (int z = 1; z <= gnbl; z++)\n"
+    "            retn += gblr[z] * (Texel(Wrap(tpos - z * gcur.xy) + gpre.x) + Texel(Wrap(tpos + z * gcur.xy) + gpre.x));\n"
+    "    }\n"
+    "    else\n"
+    "        retn = clamp((Texel(Wrap(tpos + gpre.x)) - gnrm.x) * gnrm.y - gnrm.z, gnrm.w, gnrm.z);\n"
+    "    gl_FragColor = vec4(retn);\n"
+    "}\n";
+/// Shared grid VBOs of the displacement shader, one for each log2(ndim)
+UINT dgrd[32] = {};
+/** Vertex shader for displacement: the vertex only holds its grid position
+    in half-squares, everything else is derived from the height texture the
+    same way FillVBO() does it on the CPU; lighting follows the one in vins.
+**/
+LPSTR vdsp =
+    "uniform sampler2D hmap;\n"
+    "uniform vec3 dprm;\n"
+    "uniform vec2 dflg;\n"
+    "uniform float dhei[8];\n"
+    "uniform vec4 dclr[8];\n"
+    "uniform int dnum;\n"
+    SHD_LGHT
+    "float Height(vec2 gpos) {\n"
+    "    return texture2DLod(hmap, (gpos + 1.5) / (dprm.y + 3.0), 0.0).r;\n"
+    "}\n"
+    "float Center(vec2 gpos) {\n"
+    "    return 0.25 * (Height(gpos) + Height(gpos + vec2(1.0, 0.0)) + Height(gpos + vec2(0.0, 1.0)) + Height(gpos + vec2(1.0, 1.0)));\n"
+    "}\n"
+    "vec4 Corner(vec2 gpos) {\n"
+    "    float hcur = Height(gpos);\n"
+    "    vec4 retn = dclr[dnum - 1];\n"
+    "    bool wtr = true;\n"
+    "    for (int i = 7; i >= 0; i--)\n"
+    "        if ((i < dnum) && (hcur <= dhei[i])) retn = dclr[i];\n"
+    "    for (int y = -1; y <= 1; y++)\n"
+    "        for (int x = -1; x <= 1; x++)\n"
+    "            wtr = wtr && (Height(gpos + vec2(float(x), float(y))) == dprm.z);\n"
+    "    return (wtr)? dclr[dnum] : vec4(retn.rgb, 1.0);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec2 gpos = floor(gl_Vertex.xy * 0.5), gofs = gl_Vertex.xy * 0.5 - gpos;\n"
+    "    vec4 vert = vec4((gpos + gofs) * dprm.x - 0.5 * dprm.x * dprm.y, 0.0, 1.0), colr = gl_Color, epos, c00, c10, c01, c11;\n"
+    "    vec3 norm = gl_Normal;\n"
+    "    float nwtr;\n"
+    "    if (gofs.x == 0.0) {\n"
+    "        vert.z = Height(gpos);\n"
+    "        if (dflg.x != 0.0)\n"
+    "            norm = vec3(Height(gpos - vec2(1.0, 0.0)) - Height(gpos + vec2(1.0, 0.0)),\n"
+    "                        Height(gpos - vec2(0.0, 1.0)) - Height(gpos + vec2(0.0, 1.0)), 2.0 * dprm.x);\n"
+    "        if (dflg.y != 0.0)\n"
+    "            colr = Corner(gpos);\n"
+    "    }\n"
+    "    else {\n"
+    "        vert.z = Center(gpos);\n"
+    "        if (dflg.x != 0.0)\n"
+    "            norm = vec3(Center(gpos - vec2(1.0, 0.0)) - Center(gpos + vec2(1.0, 0.0)),\n"
+    "                        Center(gpos - vec2(0.0, 1.0)) - Center(gpos + vec2(0.0, 1.0)), 2.0 * dprm.x);\n"
+    "        if (dflg.y != 0.0) {\n"
+    "            c00 = Corner(gpos);\n"
+    "            c10 = Corner(gpos + vec2(1.0, 0.0));\n"
+    "            c01 = Corner(gpos + vec2(0.0, 1.0));\n"
+    "            c11 = Corner(gpos + vec2(1.0, 1.0));\n"
+    "            nwtr = float(c00.a != dclr[dnum].a) + float(c10.a != dclr[dnum].a)\n"
+    "                 + float(c01.a != dclr[dnum].a) + float(c11.a != dclr[dnum].a);\n"
+    "            colr = vec4(0.25 * (c00.rgb + c10.rgb + c01.rgb + c11.rgb), 1.0);\n"
+    "            if (vert.z == dprm.z) {\n"
+    "                if (nwtr == 0.0) colr.rgb = dclr[dnum].rgb;\n"
+    "                colr.a = dclr[dnum].a + 0.25 * nwtr * (1.0 - dclr[dnum].a);\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    epos = gl_ModelViewMatrix * vert;\n"
+    "    gl_FrontColor = gl_BackColor = Light(epos, normalize(gl_NormalMatrix * norm), colr);\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * vec4(gpos + gofs, 0.0, 1.0);\n"
+    "    gl_TexCoord[2] = gl_TextureMatrix[2] * epos;\n"
+    "    gl_TexCoord[3] = gl_TextureMatrix[3] * vert;\n"
+    "    gl_FogFragCoord = abs(epos.z);\n"
+    "    gl_Position = gl_ProjectionMatrix * epos;\n"
+    "}\n";
 
-    if (!(rndc = abs(rndc) % 257)) return 0;
 
-    #define TEX_LPWR 8
-    itex = pow(2.0, TEX_LPWR);
-    ctex = (FCLR*)malloc(itex * itex * sizeof(FCLR));
 
-    if (trns) {
-        for (y = 0; y < itex; y++)
-            for (dpos = itex + (x = y * itex); x < dpos; x++) {
-                ctex[x].R = ctex[x].G = ctex[x].B = 255;
-                ctex[x].A = (rand() % rndc) - rndc;
-            }
+/**
+  @brief MakeProgram
+  compiles a vertex shader and a fragment shader and links them into
+  a program; the stage without a shader is left to the fixed pipeline.
+
+  @param vert - source of the vertex shader; NULL if none.
+  @param frag - source of the fragment shader; NULL if none.
+
+  @return program ID on success, 0 on failure.
+**/
+UINT MakeProgram(LPSTR vert, LPSTR frag) {
+    GLint stat = 0;
+    UINT retn, vshd = 0, fshd = 0;
+
+    if (!glCreateProgramObjectARB) return 0;
+    retn = glCreateProgramObjectARB();
+    if (vert) {
+        vshd = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
+        glShaderSourceARB(vshd, 1, (const CHAR**)&vert, NULL);
+        glCompileShaderARB(vshd);
+        glAttachObjectARB(retn, vshd);
     }
-    else {
-        for (y = 0; y < itex; y++)
-            for (dpos = itex + (x = y * itex); x < dpos; x++) {
-                ctex[x].R = ctex[x].G = ctex[x].B = (rand() % rndc) - rndc;
-                ctex[x].A = 255;
-            }
+    if (frag) {
+        fshd = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+        glShaderSourceARB(fshd, 1, (const CHAR**)&frag, NULL);
+        glCompileShaderARB(fshd);
+        glAttachObjectARB(retn, fshd);
     }
+    glLinkProgramARB(retn);
+    if (vshd) glDeleteObjectARB(vshd);
+    if (fshd) glDeleteObjectARB(fshd);
+    glGetObjectParameterivARB(retn, GL_OBJECT_LINK_STATUS_ARB, &stat);
+    if (!stat) {
+        glDeleteObjectARB(retn);
+        return 0;
+    }
+    return retn;
+}
 
-    glGenTextures(1, &dpos);
-    glBindTexture(GL_TEXTURE_2D, dpos);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    gluBuild2DMipmaps(GL_TEXTURE_2D, sizeof(FCLR), itex, itex, GL_RGBA, GL_UNSIGNED_BYTE, ctex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NICEST);
-    free(ctex);
-    #undef TEX_LPWR
 
-    return dpos;
+
+/**
+  @brief HashRand
+  a stateless PRNG: hashes the seed and a 3D key into 32 random bits.
+  Unlike rand(), the result does not depend on what was generated before,
+  so any part of the map can be regenerated separately.
+
+  @param seed - PRNG seed.
+  @param xkey - first coordinate of the key.
+  @param ykey - second coordinate of the key.
+  @param okey - third coordinate of the key.
+
+  @return random 32-bit value.
+**/
+UINT HashRand(UINT seed, UINT xkey, UINT ykey, UINT okey) {
+    UINT hash = seed + 0x9E3779B9 * (xkey + 1);
+
+    hash = (hash ^ (hash >> 16)) * 0x85EBCA6B + 0xC2B2AE35 * (ykey + 1);
+    hash = (hash ^ (hash >> 13)) * 0x27D4EB2F + 0x165667B1 * (okey + 1);
+    hash = (hash ^ (hash >> 16)) * 0x85EBCA6B;
+    hash = (hash ^ (hash >> 13)) * 0xC2B2AE35;
+    return hash ^ (hash >> 16);
 }
 
 
 
 /**
-  @brief MakeHeightmap
-  generates a random NxN heightmap, where N shall be a power of 2.
-  The method used is the so-called "diamond-square" algorithm.
+  @brief BenchTick
+  reads the performance counter on behalf of the benchmark, and adds the time
+  elapsed since tbgn to a stage timer. Does nothing when btim == NULL.
 
-  @param size - N (discussed above).
-  @param dmpf - the "sharpness" of the surface; shan`t be zero.
+  @param stge - stage to add the time to (see BEN_NSTG); < 0 means none.
+  @param tbgn - value of the counter that the stage began at.
 
-  @return 1D array on success, NULL on failure (N != 2**K, where K is natural).
+  @return current value of the counter, or 0 if no benchmark is running.
 **/
-FLOAT *MakeHeightmap(UINT size, FLOAT dmpf) {
-    if ((size & (size - 1)) || (size == 1)) return NULL;
+LONGLONG BenchTick(LONG stge, LONGLONG tbgn) {
+    LARGE_INTEGER tcur;
 
-    LONG x, y, xbgn, xend, ybgn, yend, oddc, step, sinc = size + 1;
-    FLOAT hdef, *farr = (FLOAT*)calloc(sinc * sinc, sizeof(FLOAT));
-    hdef = dmpf = pow(2.0, -fabs(dmpf));
+    if (!btim) return 0;
+    QueryPerformanceCounter(&tcur);
+    if (stge >= 0) btim[stge] += tcur.QuadPart - tbgn;
+    return tcur.QuadPart;
+}
 
-    for (step = size >> 1; step; step >>= 1, hdef *= dmpf) {
-        for (y = step; y < size; y += step << 1)
-            for (x = step; x < size; x += step << 1)
-                farr[x + y * sinc] = hdef * frand(0.500)
-                           + 0.250 *(farr[(x - step) + (y - step) * sinc]
-                                   + farr[(x + step) + (y - step) * sinc]
-                                   + farr[(x - step) + (y + step) * sinc]
-                                   + farr[(x + step) + (y + step) * sinc]);
 
-        for (ybgn = yend = oddc = y = 0; y < size; ybgn = yend = y += step, oddc = ~oddc) {
-            if (y == 0) yend = size; else if (y == size) ybgn = 0;
-            for (xbgn = xend = x = (oddc)? 0 : step; x < size; xbgn = xend = x += step << 1) {
-                if (x == 0) xend = size; else if (x == size) xbgn = 0;
-                farr[x + y * sinc] = hdef * frand(0.500)
-                           + 0.250 *(farr[(xend - step) + y * sinc]
-                                   + farr[(xbgn + step) + y * sinc]
-                                   + farr[x + (yend - step) * sinc]
-                                   + farr[x + (ybgn + step) * sinc]);
-                if (x == 0) farr[size + y * sinc] = farr[0 + y * sinc];
-                if (y == 0) farr[x + size * sinc] = farr[x + 0 * sinc];
-            }
-        }
+
+/**
+  @brief PoolAlloc
+  allocates a memory block aligned to DEF_PALN, reusing a freed one if there
+  is any of about the same size. Chunks of a world are all alike, and so are
+  their heightmaps, so after the first few chunks the heap is not touched.
+
+  @param size - size of the block.
+  @param zero - TRUE if the block shall be zeroed, as calloc() does.
+
+  @return the block on success, NULL on failure; to be freed by PoolFree().
+**/
+LPVOID PoolAlloc(SIZE_T size, BOOL zero) {
+    FPBK **fptr, **fbst = NULL, *fblk = NULL;
+    BYTE *base;
+
+    size = (size + DEF_PALN - 1) & ~(DEF_PALN - 1);
+    EnterCriticalSection(&pcrs);
+    for (fptr = &pool; *fptr; fptr = &(*fptr)->next)
+        if (((*fptr)->size >= size) && ((*fptr)->size <= size + (size >> 2))
+        &&  (!fbst || ((*fptr)->size < (*fbst)->size)))
+            fbst = fptr;
+    if (fbst) {
+        fblk = *fbst;
+        *fbst = fblk->next;
+        psiz -= fblk->size;
+    }
+    LeaveCriticalSection(&pcrs);
+
+    if (!fblk) {
+        if (!(base = (BYTE*)malloc(sizeof(FPBK) + DEF_PALN - 1 + size))) return NULL;
+        fblk = (FPBK*)(((ULONG_PTR)base + sizeof(FPBK) + DEF_PALN - 1) & ~(ULONG_PTR)(DEF_PALN - 1)) - 1;
+        fblk->base = base;
+        fblk->size = size;
     }
-    return farr;
+    if (zero) memset(fblk + 1, 0, size);
+    return fblk + 1;
 }
 
 
 
 /**
-  @brief BlurHeightmap
-  makes the heightmap look less edgy, by smoothing it with Gaussian blur.
+  @brief PoolFree
+  returns a block given by PoolAlloc() to the pool, or to the heap if the
+  pool already holds DEF_PMAX bytes.
 
-  @param farr - the heightmap to be blurred.
-  @param size - width and height of the heightmap.
-  @param fsig - strength of smoothing; [0, size).
+  @param data - the block; may be NULL.
 **/
-void BlurHeightmap(FLOAT *farr, UINT size, FLOAT fsig) {
-    FLOAT *blur, *ftmp, fsum;
-    LONG x, y, z, dpos;
+void PoolFree(LPVOID data) {
+    FPBK *fblk;
+
+    if (!data) return;
+    fblk = (FPBK*)data - 1;
+    EnterCriticalSection(&pcrs);
+    if (psiz + fblk->size <= DEF_PMAX) {
+        fblk->next = pool;
+        pool = fblk;
+        psiz += fblk->size;
+        fblk = NULL;
+    }
+    LeaveCriticalSection(&pcrs);
+    if (fblk) free(fblk->base);
+}
 
-    if (!(fsig = fabs(fsig) * 3.0)) return;
-    if (size <= 0 || fsig >= size) return;
 
-    fsum = 9.0 / (2.0 * fsig * fsig);
-    blur = (FLOAT*)calloc(tr(fsig) + 1, sizeof(FLOAT));
 
-    for (x = tr(fsig); x > 0; x--)
-        blur[0] += blur[x] = exp(-x * x * fsum);
+/**
+  @brief PoolFlush
+  returns all free blocks of the pool to the heap.
+**/
+void PoolFlush() {
+    FPBK *fblk;
 
-    blur[0] = 0.5 / (blur[0] + 0.5);
-    for (x = tr(fsig); x > 0; x--)
-        blur[x] *= blur[0];
+    EnterCriticalSection(&pcrs);
+    while ((fblk = pool)) {
+        pool = fblk->next;
+        free(fblk->base);
+    }
+    psiz = 0;
+    LeaveCriticalSection(&pcrs);
+}
 
-    ftmp = (FLOAT*)malloc((size + 1) * (size + 1) * sizeof(FLOAT));
-    for (y = 0; y <= size; y++)
-        for (dpos = y * (size + 1), x = 0; x <= size; x++) {
-            for (fsum = 0.0, z = tr(fsig); z > 0; z--)
-                fsum += (farr[dpos + ((x - z < 0)?    x - z + size : x - z)]  +
-                         farr[dpos + ((x + z > size)? x + z - size : x + z)]) * blur[z];
-            ftmp[dpos + x] = ftmp[dpos + x] * blur[0] + fsum;
-        }
-    for (x = 0; x <= size; x++)
-        for (y = 0; y <= size; y++) {
-            for (fsum = 0.0, z = tr(fsig); z > 0; z--)
-                fsum += (ftmp[x + ((y - z < 0)?    (y - z + size) * (size + 1) : (y - z) * (size + 1))]  +
-                         ftmp[x + ((y + z > size)? (y + z - size) * (size + 1) : (y + z) * (size + 1))]) * blur[z];
-            farr[x + y * (size + 1)] = farr[x + y * (size + 1)] * blur[0] + fsum;
-        }
-    free(ftmp);
-    free(blur);
+
+
+/**
+  @brief FloatOrder
+  compares two FLOATs for qsort().
+
+  @param a - pointer to the first FLOAT.
+  @param b - pointer to the second FLOAT.
+
+  @return < 0 if *a < *b, > 0 if *a > *b, 0 otherwise.
+**/
+int FloatOrder(const void *a, const void *b) {
+    return (*(FLOAT*)a > *(FLOAT*)b) - (*(FLOAT*)a < *(FLOAT*)b);
 }
 
 
 
 /**
-  @brief MakeVBO
-  creates an empty VBO placeholder.
+  @brief ProfBegin
+  starts timing a frame phase, both on the CPU and, if ARB_timer_query is
+  supported, on the GPU. Phases shall not overlap. Does nothing unless the
+  profiler is in use (see FPRF::used).
 
-  @param ndot - number of separate vertices in the VBO; must be > 0.
+  @param phas - the phase (see PRF_NPHS).
+**/
+void ProfBegin(UINT phas) {
+    LARGE_INTEGER tcur;
 
-  @return FVBO struct on success, NULL on failure (ndot == 0).
+    if (!prof.used) return;
+    if (prof.iqry[0][0]) {
+        glBeginQueryARB(GL_TIME_ELAPSED, prof.iqry[prof.nfrm % DEF_PQRY][phas]);
+        prof.fmsk[prof.nfrm % DEF_PQRY] |= 1 << phas;
+    }
+    QueryPerformanceCounter(&tcur);
+    prof.tbgn = tcur.QuadPart;
+}
+
+
+
+/**
+  @brief ProfEnd
+  stops timing the frame phase started by ProfBegin(), adding the CPU time
+  to that of the phase in the current frame.
+
+  @param phas - the phase; shall be the one given to ProfBegin().
 **/
-FVBO *MakeVBO(UINT ndot) {
-    if (!ndot) return NULL;
-    FVBO *retn = (FVBO*)calloc(1, sizeof(FVBO));
+void ProfEnd(UINT phas) {
+    LARGE_INTEGER tcur;
 
-    retn->ndot = ndot;
-    retn->indx = (FTRI*)calloc(1 + (ndot >> 1), sizeof(FTRI));
-    retn->vect = (FVEC*)calloc(ndot, sizeof(FVEC));
-    retn->norm = (FVEC*)calloc(ndot, sizeof(FVEC));
-    retn->texc = (FTEX*)calloc(ndot, sizeof(FTEX));
-    retn->clrs = (FCLR*)calloc(ndot, sizeof(FCLR));
+    if (!prof.used) return;
+    QueryPerformanceCounter(&tcur);
+    prof.fcpu[phas][prof.nfrm % DEF_PWIN] += (FLOAT)(tcur.QuadPart - prof.tbgn) * prof.fmsc;
+    if (prof.iqry[0][0]) glEndQueryARB(GL_TIME_ELAPSED);
+}
 
-    if (glGenBuffersARB) {
-        glGenBuffersARB(1, &retn->iind);
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, retn->iind);
-        glGenBuffersARB(1, &retn->ivec);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->ivec);
-        glGenBuffersARB(1, &retn->inrm);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->inrm);
-        glGenBuffersARB(1, &retn->itex);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->itex);
-        glGenBuffersARB(1, &retn->iclr);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->iclr);
+
+
+/**
+  @brief ProfStat
+  computes the statistics of the samples of a phase: minimum, average and
+  the 99th percentile.
+
+  @param fsmp - the samples; sorted in place.
+  @param nsmp - number of samples.
+  @param fres - array to receive the minimum, the average and the p99.
+**/
+void ProfStat(FLOAT *fsmp, UINT nsmp, FLOAT fres[3]) {
+    UINT i;
+
+    fres[0] = fres[1] = fres[2] = 0.0;
+    if (!nsmp) return;
+    qsort(fsmp, nsmp, sizeof(FLOAT), FloatOrder);
+    for (i = 0; i < nsmp; i++)
+        fres[1] += fsmp[i];
+    fres[0] = fsmp[0];
+    fres[1] /= (FLOAT)nsmp;
+    fres[2] = fsmp[(nsmp - 1) * 99 / 100];
+}
+
+
+
+/**
+  @brief ProfFrame
+  finishes the profiled frame: stores its counts, remakes the statistics
+  in FPRF::text, and reads the GPU times of the frame that was issued
+  DEF_PQRY frames ago, so that its queries can be reused by the next one.
+  The CPU statistics cover the last DEF_PWIN - 1 finished frames, leaving
+  out the slot cleared for the next one.
+  The counts always start anew, whether the profiler is in use or not.
+**/
+void ProfFrame() {
+    LPSTR name[PRF_NPHS] = {"stream", "reflect", "land", "objects", "minimap", "swap"};
+    FLOAT fsmp[DEF_PWIN], fcpu[3], fgpu[3], fdrw = 0.0, ftri = 0.0;
+    UINT i, phas, ncpu, ngpu, slot;
+    ULONGLONG tgpu;
+
+    if (!prof.used) {
+        prof.ndrw = prof.ntri = 0;
+        return;
     }
-    return retn;
+    prof.fdrw[prof.nfrm % DEF_PWIN] = prof.ndrw;
+    prof.ftri[prof.nfrm % DEF_PWIN] = prof.ntri;
+    prof.nfrm++;
+
+    slot = prof.nfrm % DEF_PQRY;
+    for (phas = 0; phas < PRF_NPHS; phas++) {
+        tgpu = 0;
+        if (prof.fmsk[slot] & (1 << phas))
+            glGetQueryObjectui64v(prof.iqry[slot][phas], GL_QUERY_RESULT_ARB, &tgpu);
+        if (prof.nfrm >= DEF_PQRY)
+            prof.fgpu[phas][(prof.nfrm - DEF_PQRY) % DEF_PWIN] = (FLOAT)tgpu * 1.0e-6;
+        prof.fcpu[phas][prof.nfrm % DEF_PWIN] = 0.0;
+    }
+    prof.fmsk[slot] = 0;
+
+    ncpu = min(prof.nfrm, DEF_PWIN - 1);
+    ngpu = (prof.iqry[0][0] && (prof.nfrm >= DEF_PQRY))? min(prof.nfrm - DEF_PQRY + 1, DEF_PWIN) : 0;
+    for (i = 0; i < ncpu; i++) {
+        fdrw += prof.fdrw[(prof.nfrm - 1 - i) % DEF_PWIN];
+        ftri += prof.ftri[(prof.nfrm - 1 - i) % DEF_PWIN];
+    }
+    sprintf(prof.text[0], "frame %u: %u draws, %u triangles; avg %0.0f draws, %0.0f triangles",
+            prof.nfrm, prof.ndrw, prof.ntri, fdrw / (FLOAT)ncpu, ftri / (FLOAT)ncpu);
+    sprintf(prof.text[1], "%-8s %27s %27s", "ms", "CPU min / avg / p99", (ngpu)? "GPU min / avg / p99" : "GPU n/a");
+    for (phas = 0; phas < PRF_NPHS; phas++) {
+        for (i = 0; i < ncpu; i++)
+            fsmp[i] = prof.fcpu[phas][(prof.nfrm - 1 - i) % DEF_PWIN];
+        ProfStat(fsmp, ncpu, fcpu);
+        memcpy(fsmp, prof.fgpu[phas], ngpu * sizeof(FLOAT));
+        ProfStat(fsmp, ngpu, fgpu);
+        sprintf(prof.text[phas + 2], "%-8s %8.3f %8.3f %8.3f   %8.3f %8.3f %8.3f", name[phas],
+                fcpu[0], fcpu[1], fcpu[2], fgpu[0], fgpu[1], fgpu[2]);
+    }
+    prof.text[PRF_NPHS + 2][0] = 0;
+    prof.ndrw = prof.ntri = 0;
 }
 
 
 
 /**
-  @brief DrawVBO
-  renders the VBO using OpenGL commands.
+  @brief ProfShow
+  draws the profiler overlay, i.e. FPRF::text, over the frame. The font is
+  made from the one selected into the device context on the first call.
 
-  @param vobj - VBO to be rendered; must be a valid FVBO pointer.
+  @param hDlg - handle of the main drawing surface.
 **/
-void DrawVBO(FVBO *vobj) {
-    if (!vobj) return;
+void ProfShow(HWND hDlg) {
+    TEXTMETRIC tmet;
+    RECT rect;
+    UINT i;
+
+    if (!prof.used) return;
+    if (!prof.font) {
+        wglUseFontBitmaps(DC, 0, 128, prof.font = glGenLists(128));
+        GetTextMetrics(DC, &tmet);
+        prof.lhei = tmet.tmHeight;
+    }
+    GetClientRect(hDlg, &rect);
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_LIST_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_FOG);
+    glDisable(GL_DEPTH_TEST);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0.0, rect.right, rect.bottom, 0.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glColor4ub(255, 255, 0, 255);
+    glListBase(prof.font);
+    for (i = 0; prof.text[i][0]; i++) {
+        glRasterPos2i(4, (i + 1) * prof.lhei);
+        glCallLists(strlen(prof.text[i]), GL_UNSIGNED_BYTE, prof.text[i]);
+    }
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
 
-    if (vobj->flgs & USE_FILL)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    else
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    if (!(vobj->flgs & USE_CLRS))
-        glColor4ub(255, 255, 255, 255);
 
-    glEnableClientState(GL_VERTEX_ARRAY);
-    if (vobj->flgs & USE_ARBV) {
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, vobj->iind);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, vobj->ivec);
-        glVertexPointer(3, GL_FLOAT, 0, 0);
-        if (vobj->flgs & USE_NORM) {
-            glEnableClientState(GL_NORMAL_ARRAY);
-            glBindBufferARB(GL_ARRAY_BUFFER_ARB, vobj->inrm);
-            glNormalPointer(GL_FLOAT, 0, 0);
-        }
-        if (vobj->flgs & USE_TEXC) {
-            glEnable(GL_TEXTURE_2D);
-            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-            glBindTexture(GL_TEXTURE_2D, vobj->ntex);
-            glBindBufferARB(GL_ARRAY_BUFFER_ARB, vobj->itex);
-            glTexCoordPointer(2, GL_FLOAT, 0, 0);
-        }
-        if (vobj->flgs & USE_CLRS) {
-            glEnableClientState(GL_COLOR_ARRAY);
-            glBindBufferARB(GL_ARRAY_BUFFER_ARB, vobj->iclr);
-            glColorPointer(4, GL_UNSIGNED_BYTE, 0, 0);
-        }
-        glDrawElements(GL_TRIANGLES, vobj->npol, GL_UNSIGNED_INT, 0);
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+/**
+  @brief ProfDump
+  appends the statistics last shown by the overlay to DEF_PLOG.
+**/
+void ProfDump() {
+    time_t tcur = time(NULL);
+    FILE *filp;
+    UINT i;
+
+    if (!prof.used || !(filp = fopen(DEF_PLOG, "a"))) return;
+    fprintf(filp, "%s", ctime(&tcur));
+    for (i = 0; prof.text[i][0]; i++)
+        fprintf(filp, "%s\n", prof.text[i]);
+    fprintf(filp, "\n");
+    fclose(filp);
+}
+
+
+
+/**
+  @brief MakeFacetTex
+  creates the pixels of a microfacet texture containing a white noise pattern.
+  Does not touch OpenGL, so it can be safely called from any thread.
+
+  @param rndc - absolute value defines the amplitude of white noise, (0; 256].
+                sign shows if the texture needs to be transparent; < 0 == yes.
+  @param seed - PRNG seed; equal seeds give equal textures.
+
+  @return 2^DEF_TPWR x 2^DEF_TPWR array of pixels on success, NULL on failure (rndc == 0);
+          to be freed by PoolFree().
+**/
+FCLR *MakeFacetTex(LONG rndc, UINT seed) {
+    UINT x, y, dpos, itex;
+    BOOL trns = rndc < 0;
+    FCLR *ctex;
+
+    if (!(rndc = abs(rndc) % 257)) return NULL;
+
+    itex = pow(2.0, DEF_TPWR);
+    ctex = (FCLR*)PoolAlloc(itex * itex * sizeof(FCLR), FALSE);
+
+    if (trns) {
+        for (y = 0; y < itex; y++)
+            for (dpos = itex + (x = y * itex); x < dpos; x++) {
+                ctex[x].R = ctex[x].G = ctex[x].B = 255;
+                ctex[x].A = (HashRand(seed, x - y * itex, y, DEF_KTEX) % rndc) - rndc;
+            }
     }
     else {
-        glVertexPointer(3, GL_FLOAT, 0, vobj->vect);
-        if (vobj->flgs & USE_NORM) {
-            glEnableClientState(GL_NORMAL_ARRAY);
-            glNormalPointer(GL_FLOAT, 0, vobj->norm);
-        }
-        if (vobj->flgs & USE_TEXC) {
-            glEnable(GL_TEXTURE_2D);
-            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-            glBindTexture(GL_TEXTURE_2D, vobj->ntex);
-            glTexCoordPointer(2, GL_FLOAT, 0, vobj->texc);
-        }
-        if (vobj->flgs & USE_CLRS) {
-            glEnableClientState(GL_COLOR_ARRAY);
-            glColorPointer(4, GL_UNSIGNED_BYTE, 0, vobj->clrs);
-        }
-        glDrawElements(GL_TRIANGLES, vobj->npol, GL_UNSIGNED_INT, vobj->indx);
+        for (y = 0; y < itex; y++)
+            for (dpos = itex + (x = y * itex); x < dpos; x++) {
+                ctex[x].R = ctex[x].G = ctex[x].B = (HashRand(seed, x - y * itex, y, DEF_KTEX) % rndc) - rndc;
+                ctex[x].A = 255;
+            }
     }
-    glDisableClientState(GL_COLOR_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisable(GL_TEXTURE_2D);
 
-    if (!vobj->next)
-        vobj->flgs &= ~USE_OBJS;
-    else if (vobj->flgs & USE_OBJS) {
-        vobj->next->flgs = (vobj->next->flgs & USE_OBJS)? vobj->flgs : vobj->flgs & ~USE_OBJS;
-        DrawVBO(vobj->next);
+    return ctex;
+}
+
+
+
+/**
+  @brief LoadFacetTex
+  turns the pixels made by MakeFacetTex() into an OpenGL texture. Mipmaps
+  are built by OpenGL if it can, and by GLU otherwise; the texture is stored
+  compressed if DEF_FDXT allows that.
+
+  @param ctex - array of pixels; may be NULL.
+  @param trns - TRUE if the texture is transparent, i.e. needs DXT5.
+
+  @return texture ID on success, 0 on failure (either by OGL or if ctex == NULL).
+**/
+UINT LoadFacetTex(FCLR *ctex, BOOL trns) {
+    UINT retn, frmt = GL_RGBA, itex = pow(2.0, DEF_TPWR);
+
+    if (!ctex) return 0;
+
+    if (DEF_FDXT && fdxt)
+        frmt = (trns)? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    glGenTextures(1, &retn);
+    glBindTexture(GL_TEXTURE_2D, retn);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (fgmp) {
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+        glTexImage2D(GL_TEXTURE_2D, 0, frmt, itex, itex, 0, GL_RGBA, GL_UNSIGNED_BYTE, ctex);
     }
+    else
+        gluBuild2DMipmaps(GL_TEXTURE_2D, frmt, itex, itex, GL_RGBA, GL_UNSIGNED_BYTE, ctex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NICEST);
+    return retn;
 }
 
 
 
 /**
-  @brief FreeVBO
-  frees a VBO. /Captain, is it you again? ^_^/
+  @brief FacetTex
+  returns the facet texture of the given amplitude and seed, taking it from
+  the cache or making it anew; either way the texture gains a reference,
+  to be dropped by DropFacetTex(). If the cache has no room, the texture is
+  not cached. Shall be called from the thread that owns OpenGL.
 
-  @param vobj - pointer to the location where the target FVBO is stored.
+  @param trnd - amplitude, as in MakeFacetTex().
+  @param tsed - PRNG seed.
+  @param size - where to add the number of bytes uploaded; may be NULL.
+
+  @return texture ID; 0 if trnd == 0.
 **/
-void FreeVBO(FVBO **vobj) {
-    if (vobj && *vobj) {
-        FreeVBO(&(*vobj)->next);
-        if (glGenBuffersARB) {
-            glDelBuffersARB(1, &(*vobj)->iind);
-            glDelBuffersARB(1, &(*vobj)->ivec);
-            glDelBuffersARB(1, &(*vobj)->inrm);
-            glDelBuffersARB(1, &(*vobj)->itex);
-            glDelBuffersARB(1, &(*vobj)->iclr);
+UINT FacetTex(LONG trnd, UINT tsed, UINT *size) {
+    FFAC *fnew = NULL;
+    FCLR *ctex;
+    UINT i;
+
+    if (!trnd) return 0;
+
+    for (i = 0; i < DEF_NFAC; i++)
+        if (fcac[i].ntex && (fcac[i].trnd == trnd) && (fcac[i].tsed == tsed)) {
+            fcac[i].nref++;
+            return fcac[i].ntex;
         }
-        glDeleteTextures(1, &(*vobj)->ntex);
-        free((*vobj)->indx);
-        free((*vobj)->vect);
-        free((*vobj)->norm);
-        free((*vobj)->texc);
-        free((*vobj)->clrs);
-        free(*vobj);
-        vobj = NULL;
+        else if (!fnew && !fcac[i].nref)
+            fnew = &fcac[i];
+
+    if (size) *size += (UINT)pow(4.0, DEF_TPWR) * sizeof(FCLR);
+    i = LoadFacetTex(ctex = MakeFacetTex(trnd, tsed), trnd < 0);
+    PoolFree(ctex);
+    if (fnew) {
+        glDeleteTextures(1, &fnew->ntex);
+        fnew->ntex = i;
+        fnew->nref = 1;
+        fnew->trnd = trnd;
+        fnew->tsed = tsed;
     }
+    return i;
 }
 
 
 
 /**
-  @brief CamLightReset
-  resets camera and light source orientation to their default values.
+  @brief DropFacetTex
+  drops a reference to a texture given by FacetTex(); the texture is only
+  deleted if it is not cached.
+
+  @param ntex - texture ID; 0 and otex are ignored.
 **/
-void CamLightReset() {
-    fang.u = DEF_ANGU;
-    fang.v = DEF_ANGV;
+void DropFacetTex(UINT ntex) {
+    UINT i;
 
-    ftrn.x = DEF_TRNX;
-    ftrn.y = DEF_TRNY;
-    ftrn.z = DEF_TRNZ;
+    if (!ntex || (ntex == otex)) return;
 
-    ldir[0] = DEF_DIRX;
-    ldir[1] = DEF_DIRY;
-    ldir[2] = DEF_DIRZ;
-    ldir[3] = 1.0;
+    for (i = 0; i < DEF_NFAC; i++)
+        if (fcac[i].ntex == ntex) {
+            if (fcac[i].nref) fcac[i].nref--;
+            return;
+        }
+    glDeleteTextures(1, &ntex);
+}
 
-    lpos[0] = DEF_POSX;
-    lpos[1] = DEF_POSY;
-    lpos[2] = DEF_POSZ;
-    lpos[3] = 1.0;
+
+
+/**
+  @brief ClearFacetTex
+  deletes all cached facet textures; none shall be referenced anymore.
+**/
+void ClearFacetTex() {
+    UINT i;
+
+    for (i = 0; i < DEF_NFAC; i++)
+        glDeleteTextures(1, &fcac[i].ntex);
+    memset(fcac, 0, sizeof(fcac));
 }
 
 
 
 /**
-  @brief Serialize
-  saves VBO creation parameters to a file.
+  @brief RowThread
+  the thread that processes a strip of rows for SplitRows().
+
+  @param data - FROW that describes the strip.
 
-  @param file - file into which the VBO shall be serialized.
-  @param vobj - location where the target FVBO is stored.
+  @return 0.
 **/
-void Serialize(LPSTR file, FVBO *vobj) {
-    FILE *filp;
+DWORD WINAPI RowThread(LPVOID data) {
+    FROW *frow = (FROW*)data;
 
-    if ((filp = fopen(file, "wb"))) {
-        if ((file = strstr(file, DEF_FEXT)) && (strlen(file) == DEF_FEXL)) {
-            fprintf(filp, DEF_FRMT, vobj->seed, vobj->flgs,
-                    fang.u,  fang.v,
-                    ftrn.x,  ftrn.y,  ftrn.z,
-                    ldir[0], ldir[1], ldir[2],
-                    lpos[0], lpos[1], lpos[2]);
-        }
+    frow->func(frow->data, frow->ybgn, frow->yend);
+    return 0;
+}
+
+
+
+/**
+  @brief SplitRows
+  processes rows that do not depend on each other, splitting them into
+  strips of at least DEF_NCEL points done by separate threads, one per CPU
+  (DEF_NTHR at most). The calling thread does the first strip itself.
+
+  @param func - function that processes the rows [ybgn; yend) of data.
+  @param data - data to be passed to func.
+  @param nrow - number of rows.
+  @param ncel - number of points in a row.
+**/
+void SplitRows(void (*func)(LPVOID, LONG, LONG), LPVOID data, LONG nrow, LONG ncel) {
+    FROW frow[DEF_NTHR];
+    HANDLE hrow[DEF_NTHR];
+    SYSTEM_INFO info;
+    LONG x, nstr;
+
+    GetSystemInfo(&info);
+    nstr = min(DEF_NTHR, min((LONG)info.dwNumberOfProcessors, nrow * ncel / DEF_NCEL));
+    nstr = max(1, min(nstr, nrow));
+    for (x = 0; x < nstr; x++) {
+        frow[x].func = func;
+        frow[x].data = data;
+        frow[x].ybgn = nrow *  x      / nstr;
+        frow[x].yend = nrow * (x + 1) / nstr;
+        hrow[x] = (x)? CreateThread(NULL, 0, RowThread, &frow[x], 0, NULL) : NULL;
+    }
+    for (x = nstr - 1; x >= 0; x--)
+        if (!hrow[x])
+            func(data, frow[x].ybgn, frow[x].yend);
         else {
-            fwrite(&vobj->seed, sizeof(UINT), 1, filp);
-            fwrite(&vobj->flgs, sizeof(UINT), 1, filp);
-            fwrite(&fang, sizeof(FTEX), 1, filp);
-            fwrite(&ftrn, sizeof(FVEC), 1, filp);
-            fwrite(ldir, sizeof(FVEC), 1, filp);
-            fwrite(lpos, sizeof(FVEC), 1, filp);
+            WaitForSingleObject(hrow[x], INFINITE);
+            CloseHandle(hrow[x]);
+        }
+}
+
+
+
+/**
+  @brief HeightRows
+  does a step of MakeHeightmap() for a strip of rows. Within a step, each
+  point only depends on the points of the previous steps, so any rows may
+  be done in any order, giving the same result.
+
+  @param data - FDSQ that describes the step.
+  @param ybgn - first row: for the square step, row N is the one at
+                (2N + 1) * step; for the diamond step, it is at N * step.
+  @param yend - row after the last one.
+**/
+void HeightRows(LPVOID data, LONG ybgn, LONG yend) {
+    FDSQ *fdsq = (FDSQ*)data;
+    LONG x, y, xbgn, xend, ylow, yhgh, size = fdsq->size, step = fdsq->step, sinc = size + 1;
+    FLOAT hdef = fdsq->hdef, *farr = fdsq->farr;
+    UINT seed = fdsq->seed;
+
+    if (!fdsq->diam) {
+        for (y = step + ybgn * (step << 1); ybgn < yend; ybgn++, y += step << 1)
+            for (x = step; x < size; x += step << 1)
+                farr[x + y * sinc] = hdef * hrand(0.500, seed, x, y, step)
+                           + 0.250 *(farr[(x - step) + (y - step) * sinc]
+                                   + farr[(x + step) + (y - step) * sinc]
+                                   + farr[(x - step) + (y + step) * sinc]
+                                   + farr[(x + step) + (y + step) * sinc]);
+        return;
+    }
+    for (y = ybgn * step; ybgn < yend; ybgn++, y += step) {
+        ylow = yhgh = y;
+        if (y == 0) yhgh = size;
+        for (xbgn = xend = x = (ybgn & 1)? 0 : step; x < size; xbgn = xend = x += step << 1) {
+            if (x == 0) xend = size;
+            farr[x + y * sinc] = hdef * hrand(0.500, seed, x, y, step)
+                       + 0.250 *(farr[(xend - step) + y * sinc]
+                               + farr[(xbgn + step) + y * sinc]
+                               + farr[x + (yhgh - step) * sinc]
+                               + farr[x + (ylow + step) * sinc]);
+            if (x == 0) farr[size + y * sinc] = farr[0 + y * sinc];
+            if (y == 0) farr[x + size * sinc] = farr[x + 0 * sinc];
+        }
+    }
+}
+
+
+
+/**
+  @brief MakeHeightmap
+  generates a random NxN heightmap, where N shall be a power of 2.
+  The method used is the so-called "diamond-square" algorithm.
+  Random values are keyed the same way as in RegionHeightmap(), so the result
+  only depends on the seed and equals the region covering the whole world.
+  Each step is done in parallel by SplitRows(); the result does not depend
+  on the number of threads.
+
+  @param size - N (discussed above).
+  @param seed - PRNG seed.
+  @param dmpf - the "sharpness" of the surface; shan`t be zero.
+
+  @return 1D array on success, NULL on failure (N != 2**K, where K is natural);
+          to be freed by PoolFree().
+**/
+FLOAT *MakeHeightmap(UINT size, UINT seed, FLOAT dmpf) {
+    if ((size & (size - 1)) || (size == 1)) return NULL;
+
+    FDSQ fdsq = {.farr = (FLOAT*)PoolAlloc((size + 1) * (size + 1) * sizeof(FLOAT), TRUE), .seed = seed, .size = size};
+
+    fdsq.hdef = dmpf = pow(2.0, -fabs(dmpf));
+    for (fdsq.step = size >> 1; fdsq.step; fdsq.step >>= 1, fdsq.hdef *= dmpf) {
+        fdsq.diam = FALSE;
+        SplitRows(HeightRows, &fdsq, size / (fdsq.step << 1), size / (fdsq.step << 1));
+        fdsq.diam = TRUE;
+        SplitRows(HeightRows, &fdsq, size / fdsq.step, size / (fdsq.step << 1));
+    }
+    return fdsq.farr;
+}
+
+
+
+/**
+  @brief RegionLevels
+  finds the part of each diamond-square level that RegionHeightmap() needs
+  to compute a region: the part of the next finer level, plus a border as
+  wide as the step of the level, aligned to twice that step.
+
+  @param rlvl - 32 {left, bottom, width} triples to receive the parts; the
+                first one is the region itself.
+  @param wdim - size of the world (see RegionHeightmap()).
+  @param xbgn - X coordinate of the first point of the region.
+  @param ybgn - Y coordinate of the first point of the region.
+  @param size - number of squares along each side of the region.
+  @param step - distance between the points of the region.
+
+  @return index of the last triple, the one of the level with a step of wdim.
+**/
+LONG RegionLevels(LONG rlvl[][3], UINT wdim, LONG xbgn, LONG ybgn, UINT size, UINT step) {
+    LONG nlvl, cstp, pstp;
+
+    rlvl[0][0] = xbgn;
+    rlvl[0][1] = ybgn;
+    rlvl[0][2] = size * step;
+    for (nlvl = 0, cstp = step; cstp < wdim; nlvl++, cstp <<= 1) {
+        pstp = cstp << 1;
+        rlvl[nlvl + 1][0] = (rlvl[nlvl][0] - pstp) & ~(pstp - 1);
+        rlvl[nlvl + 1][1] = (rlvl[nlvl][1] - pstp) & ~(pstp - 1);
+        rlvl[nlvl + 1][2] = -((-(rlvl[nlvl][0] + rlvl[nlvl][2] + pstp)) & ~(pstp - 1)) - rlvl[nlvl + 1][0];
+    }
+    return nlvl;
+}
+
+
+
+/**
+  @brief RegionHeightmap
+  computes a rectangular part of the diamond-square heightmap of the whole
+  world, without generating the rest of it. Every point only depends on its
+  position and on the seed, so adjacent regions match each other precisely.
+
+  The levels are computed from the coarsest to the finest one; on each level
+  only the points required by the next one are kept, i.e. the region plus
+  a border that shrinks twice with every level.
+
+  @param wdim - size of the world (N, N = 2**K, where K is natural); the
+                world wraps around, so any coordinates are allowed.
+  @param seed - PRNG seed of the world.
+  @param dmpf - the "sharpness" of the surface; shan`t be zero.
+  @param xbgn - X coordinate of the first point; shall be a multiple of step.
+  @param ybgn - Y coordinate of the first point; shall be a multiple of step.
+  @param size - number of squares along each side of the region.
+  @param step - distance between the points; shall be a power of 2 < wdim.
+
+  @return (size + 1) x (size + 1) array on success, NULL on failure;
+          to be freed by PoolFree().
+**/
+FLOAT *RegionHeightmap(UINT wdim, UINT seed, FLOAT dmpf, LONG xbgn, LONG ybgn, UINT size, UINT step) {
+    if ((wdim & (wdim - 1)) || (wdim == 1) || !size) return NULL;
+    if (!step || (step & (step - 1)) || (step >= wdim) || ((xbgn | ybgn) & (step - 1))) return NULL;
+
+    LONG x, y, xpos, ypos, xorg, yorg, cdim, pdim, cstp, pstp, nlvl, rlvl[32][3];
+    FLOAT hdef, *fcur, *fpre, *retn;
+
+    nlvl = RegionLevels(rlvl, wdim, xbgn, ybgn, size, step);
+    pdim = rlvl[nlvl][2] / wdim + 1;
+    fpre = (FLOAT*)PoolAlloc(pdim * pdim * sizeof(FLOAT), TRUE);
+    xorg = rlvl[nlvl][0];
+    yorg = rlvl[nlvl][1];
+
+    #define PRE(x, y) fpre[((x) - xorg) / pstp + ((y) - yorg) / pstp * pdim]
+    hdef = dmpf = pow(2.0, -fabs(dmpf));
+    for (nlvl--; nlvl >= 0; nlvl--, hdef *= dmpf) {
+        cstp = step << nlvl;
+        pstp = cstp << 1;
+        cdim = rlvl[nlvl][2] / cstp + 3;
+        fcur = (FLOAT*)PoolAlloc(cdim * cdim * sizeof(FLOAT), TRUE);
+
+        for (y = 0; y < cdim; y++)
+            for (x = 0; x < cdim; x++) {
+                xpos = rlvl[nlvl][0] + (x - 1) * cstp;
+                ypos = rlvl[nlvl][1] + (y - 1) * cstp;
+                if (!(xpos & cstp) && !(ypos & cstp))
+                    fcur[x + y * cdim] = PRE(xpos, ypos);
+                else if ((xpos & cstp) && (ypos & cstp))
+                    fcur[x + y * cdim] = hdef * hrand(0.500, seed, xpos & (wdim - 1), ypos & (wdim - 1), cstp)
+                                       + 0.250 *(PRE(xpos - cstp, ypos - cstp)
+                                               + PRE(xpos + cstp, ypos - cstp)
+                                               + PRE(xpos - cstp, ypos + cstp)
+                                               + PRE(xpos + cstp, ypos + cstp));
+            }
+        for (y = 1; y < cdim - 1; y++)
+            for (x = 1; x < cdim - 1; x++) {
+                xpos = rlvl[nlvl][0] + (x - 1) * cstp;
+                ypos = rlvl[nlvl][1] + (y - 1) * cstp;
+                if ((xpos ^ ypos) & cstp)
+                    fcur[x + y * cdim] = hdef * hrand(0.500, seed, xpos & (wdim - 1), ypos & (wdim - 1), cstp)
+                                       + 0.250 *(fcur[(x - 1) + y * cdim]
+                                               + fcur[(x + 1) + y * cdim]
+                                               + fcur[x + (y - 1) * cdim]
+                                               + fcur[x + (y + 1) * cdim]);
+            }
+        PoolFree(fpre);
+        fpre = fcur;
+        pdim = cdim;
+        xorg = rlvl[nlvl][0] - cstp;
+        yorg = rlvl[nlvl][1] - cstp;
+    }
+    #undef PRE
+
+    retn = (FLOAT*)PoolAlloc((size + 1) * (size + 1) * sizeof(FLOAT), FALSE);
+    for (y = 0; y <= size; y++)
+        for (x = 0; x <= size; x++)
+            retn[x + y * (size + 1)] = fpre[(x + 1) + (y + 1) * pdim];
+    PoolFree(fpre);
+    return retn;
+}
+
+
+
+/**
+  @brief GradNoise
+  computes a single octave of gradient noise at a point given in lattice
+  cells. The lattice wraps around every nlat cells, so that the noise can
+  cover a torus of any size. Corner gradients come from HashRand(), thus
+  the value only depends on the point and the keys.
+  The arithmetic is all in FLOATs, step by step as in NoiseLine(), so that
+  both give the same bits.
+
+  @param seed - PRNG seed.
+  @param u    - horizontal coordinate, in lattice cells; [-nlat; 2 * nlat).
+  @param v    - vertical coordinate, in lattice cells; [-nlat; 2 * nlat).
+  @param nlat - period of the lattice, in cells.
+  @param okey - octave key of the gradients.
+
+  @return value in [-1; 1]: after the blend, each axis adds at most 0.5.
+**/
+FLOAT GradNoise(UINT seed, FLOAT u, FLOAT v, LONG nlat, UINT okey) {
+    FLOAT fx, fy, sx, sy, d00, d10, d01, d11, fone = 1.0, fsix = 6.0, ften = 10.0, ffif = 15.0, fgrd = 2.0 / 65535.0;
+    LONG x0 = floor(u), y0 = floor(v), x1, y1;
+    UINT hash;
+
+    fx = u - (FLOAT)x0;
+    fy = v - (FLOAT)y0;
+    x0 += (x0 < 0)? nlat : (x0 >= nlat)? -nlat : 0;
+    y0 += (y0 < 0)? nlat : (y0 >= nlat)? -nlat : 0;
+    x1 = (x0 + 1 < nlat)? x0 + 1 : 0;
+    y1 = (y0 + 1 < nlat)? y0 + 1 : 0;
+    sx = fx * fx * fx * (fx * (fx * fsix - ffif) + ften);
+    sy = fy * fy * fy * (fy * (fy * fsix - ffif) + ften);
+
+    #define DOT(x, y, u, v) (hash = HashRand(seed, x, y, okey),                      \
+                             ((FLOAT)(LONG)(hash & 0xFFFF) * fgrd - fone) * (u)     \
+                           + ((FLOAT)(LONG)(hash >> 16) * fgrd - fone) * (v))
+    d00 = DOT(x0, y0, fx, fy);
+    d10 = DOT(x1, y0, fx - fone, fy);
+    d01 = DOT(x0, y1, fx, fy - fone);
+    d11 = DOT(x1, y1, fx - fone, fy - fone);
+    #undef DOT
+    d00 = d00 + (d10 - d00) * sx;
+    d01 = d01 + (d11 - d01) * sx;
+    return d00 + (d01 - d00) * sy;
+}
+
+
+
+#if defined(__SSE2__) && (FLT_EVAL_METHOD == 0)
+/**
+  @brief GradVector
+  does what GradNoise() does for four points at once, with SSE2. The steps
+  and their order are the same, so every point gets exactly the same value
+  as GradNoise() would give it. HashRand() is redone for four keys at once;
+  SSE2 only multiplies unsigned pairs, so its multiplications are made of
+  two of those.
+
+  @param seed - PRNG seed.
+  @param u    - horizontal coordinates, in lattice cells; [-nlat; 2 * nlat).
+  @param v    - vertical coordinates, in lattice cells; [-nlat; 2 * nlat).
+  @param nlat - period of the lattice, in cells.
+  @param okey - octave key of the gradients.
+
+  @return values in about [-1; 1].
+**/
+__m128 GradVector(UINT seed, __m128 u, __m128 v, LONG nlat, UINT okey) {
+    __m128 vone = _mm_set1_ps(1.0), vsix = _mm_set1_ps(6.0), vten = _mm_set1_ps(10.0), vfif = _mm_set1_ps(15.0),
+           vgrd = _mm_set1_ps(2.0 / 65535.0), vfx, vfy, vsx, vsy, v00, v10, v01, v11;
+    __m128i vlat = _mm_set1_epi32(nlat), vinc = _mm_set1_epi32(1), vlow = _mm_set1_epi32(0xFFFF), vx0, vy0, vx1, vy1, vh;
+
+    vx0 = _mm_cvttps_epi32(u);
+    vy0 = _mm_cvttps_epi32(v);
+    vx0 = _mm_add_epi32(vx0, _mm_castps_si128(_mm_cmplt_ps(u, _mm_cvtepi32_ps(vx0))));
+    vy0 = _mm_add_epi32(vy0, _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(vy0))));
+    vfx = _mm_sub_ps(u, _mm_cvtepi32_ps(vx0));
+    vfy = _mm_sub_ps(v, _mm_cvtepi32_ps(vy0));
+    vx0 = _mm_add_epi32(vx0, _mm_and_si128(_mm_cmplt_epi32(vx0, _mm_setzero_si128()), vlat));
+    vy0 = _mm_add_epi32(vy0, _mm_and_si128(_mm_cmplt_epi32(vy0, _mm_setzero_si128()), vlat));
+    vx0 = _mm_sub_epi32(vx0, _mm_andnot_si128(_mm_cmplt_epi32(vx0, vlat), vlat));
+    vy0 = _mm_sub_epi32(vy0, _mm_andnot_si128(_mm_cmplt_epi32(vy0, vlat), vlat));
+    vx1 = _mm_add_epi32(vx0, vinc);
+    vy1 = _mm_add_epi32(vy0, vinc);
+    vx1 = _mm_and_si128(vx1, _mm_cmplt_epi32(vx1, vlat));
+    vy1 = _mm_and_si128(vy1, _mm_cmplt_epi32(vy1, vlat));
+    vsx = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(vfx, vfx), vfx), _mm_add_ps(_mm_mul_ps(vfx, _mm_sub_ps(_mm_mul_ps(vfx, vsix), vfif)), vten));
+    vsy = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(vfy, vfy), vfy), _mm_add_ps(_mm_mul_ps(vfy, _mm_sub_ps(_mm_mul_ps(vfy, vsix), vfif)), vten));
+
+    #define MUL(a, c) _mm_unpacklo_epi32(_mm_shuffle_epi32(_mm_mul_epu32(a, _mm_set1_epi32(c)), 0x08), \
+                                         _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_set1_epi32(c)), 0x08))
+    #define XSR(h, n) _mm_xor_si128(h, _mm_srli_epi32(h, n))
+    #define HSH(x, y) (vh = _mm_add_epi32(_mm_set1_epi32(seed), MUL(_mm_add_epi32(x, vinc), 0x9E3779B9)),            \
+                       vh = _mm_add_epi32(MUL(XSR(vh, 16), 0x85EBCA6B), MUL(_mm_add_epi32(y, vinc), 0xC2B2AE35)),      \
+                       vh = _mm_add_epi32(MUL(XSR(vh, 13), 0x27D4EB2F), _mm_set1_epi32(0x165667B1 * (okey + 1))),      \
+                       vh = MUL(XSR(vh, 16), 0x85EBCA6B),                                                             \
+                       vh = MUL(XSR(vh, 13), 0xC2B2AE35),                                                             \
+                       vh = XSR(vh, 16))
+    #define DOT(h, u, v) _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(h, vlow)), vgrd), vone), u), \
+                                    _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 16)), vgrd), vone), v))
+    HSH(vx0, vy0);
+    v00 = DOT(vh, vfx, vfy);
+    HSH(vx1, vy0);
+    v10 = DOT(vh, _mm_sub_ps(vfx, vone), vfy);
+    HSH(vx0, vy1);
+    v01 = DOT(vh, vfx, _mm_sub_ps(vfy, vone));
+    HSH(vx1, vy1);
+    v11 = DOT(vh, _mm_sub_ps(vfx, vone), _mm_sub_ps(vfy, vone));
+    #undef DOT
+    #undef HSH
+    #undef XSR
+    #undef MUL
+    v00 = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), vsx));
+    v01 = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), vsx));
+    return _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v01, v00), vsy));
+}
+#endif
+
+
+
+/**
+  @brief NoiseLine
+  computes a line of the fBm noise heightmap: the domain is warped by
+  DEF_NWOC octaves of noise, then all octaves of the noise are summed at
+  the warped points. Four points are done at once by GradVector(), if
+  there is SSE2; the points that adjacent regions share are equal anyway,
+  whichever way they were computed.
+
+  @param fdst - destination line.
+  @param xpos - X coordinates of the points, wrapped to [0; wdim).
+  @param ypos - Y coordinate of the line, wrapped to [0; wdim).
+  @param dnum - number of points in the line.
+  @param fnse - FNSE that describes the noise.
+**/
+void NoiseLine(FLOAT *fdst, FLOAT *xpos, FLOAT ypos, LONG dnum, FNSE *fnse) {
+    LONG x = 0, k, nwoc = min(fnse->noct, DEF_NWOC);
+    FLOAT qx, qy, wx, wy, fsum;
+    UINT seed = fnse->seed;
+
+    #if defined(__SSE2__) && (FLT_EVAL_METHOD == 0)
+    __m128 vqx, vqy, vwx, vwy, vsx, vsy, vsum, vscl, vamp;
+
+    for (; x + 4 <= dnum; x += 4) {
+        vwx = _mm_loadu_ps(xpos + x);
+        vwy = _mm_set1_ps(ypos);
+        for (vqx = vqy = _mm_setzero_ps(), k = 0; k < nwoc; k++) {
+            vscl = _mm_set1_ps(fnse->fscl[k]);
+            vamp = _mm_set1_ps(fnse->famp[k]);
+            vsx = _mm_mul_ps(vwx, vscl);
+            vsy = _mm_mul_ps(vwy, vscl);
+            vqx = _mm_add_ps(vqx, _mm_mul_ps(vamp, GradVector(seed, vsx, vsy, fnse->nlat[k], DEF_NKEY + k)));
+            vqy = _mm_add_ps(vqy, _mm_mul_ps(vamp, GradVector(seed, vsx, vsy, fnse->nlat[k], 2 * DEF_NKEY + k)));
+        }
+        vwx = _mm_add_ps(vwx, _mm_mul_ps(_mm_set1_ps(fnse->fwrp), vqx));
+        vwy = _mm_add_ps(vwy, _mm_mul_ps(_mm_set1_ps(fnse->fwrp), vqy));
+        for (vsum = _mm_setzero_ps(), k = 0; k < fnse->noct; k++) {
+            vscl = _mm_set1_ps(fnse->fscl[k]);
+            vsx = _mm_mul_ps(vwx, vscl);
+            vsy = _mm_mul_ps(vwy, vscl);
+            vsum = _mm_add_ps(vsum, _mm_mul_ps(_mm_set1_ps(fnse->famp[k]), GradVector(seed, vsx, vsy, fnse->nlat[k], k)));
+        }
+        _mm_storeu_ps(fdst + x, vsum);
+    }
+    #endif
+    for (; x < dnum; x++) {
+        for (qx = qy = 0.0, k = 0; k < nwoc; k++) {
+            qx = qx + fnse->famp[k] * GradNoise(seed, xpos[x] * fnse->fscl[k], ypos * fnse->fscl[k], fnse->nlat[k], DEF_NKEY + k);
+            qy = qy + fnse->famp[k] * GradNoise(seed, xpos[x] * fnse->fscl[k], ypos * fnse->fscl[k], fnse->nlat[k], 2 * DEF_NKEY + k);
+        }
+        wx = xpos[x] + fnse->fwrp * qx;
+        wy = ypos + fnse->fwrp * qy;
+        for (fsum = 0.0, k = 0; k < fnse->noct; k++)
+            fsum = fsum + fnse->famp[k] * GradNoise(seed, wx * fnse->fscl[k], wy * fnse->fscl[k], fnse->nlat[k], k);
+        fdst[x] = fsum;
+    }
+}
+
+
+
+/**
+  @brief NoiseRows
+  does RegionNoise() for a strip of rows. Every point is computed on its
+  own, so the rows may be done in any order, giving the same result.
+
+  @param data - FNSE that describes the region.
+  @param ybgn - first row of the strip.
+  @param yend - row after the last one of the strip.
+**/
+void NoiseRows(LPVOID data, LONG ybgn, LONG yend) {
+    FNSE *fnse = (FNSE*)data;
+    LONG x, y, wdim = fnse->wdim, sinc = fnse->size + 1;
+    FLOAT *xpos = (FLOAT*)PoolAlloc(sinc * sizeof(FLOAT), FALSE);
+
+    #define WRP(v) ((((v) % wdim) + wdim) % wdim)
+    for (x = 0; x < sinc; x++)
+        xpos[x] = WRP(fnse->xbgn + x * fnse->step);
+    for (y = ybgn; y < yend; y++)
+        NoiseLine(fnse->farr + y * sinc, xpos, WRP(fnse->ybgn + y * fnse->step), sinc, fnse);
+    #undef WRP
+    PoolFree(xpos);
+}
+
+
+
+/**
+  @brief RegionNoise
+  computes a rectangular part of the fBm noise heightmap of the whole world:
+  octaves of gradient noise from DEF_NBAS lattice cells along the world to
+  cells of 2 elemental squares, each 2^-dmpf of the previous one in height,
+  with the domain warped by noise as well. Unlike diamond-square, there are
+  no coarse levels to go through: every point only depends on its position
+  and on the seed, so any region is computed directly. The lattices wrap
+  around the world of any size, which lets MakeMap() make noise worlds of
+  any number of chunks.
+  Rows are done in parallel by SplitRows(); the result does not depend on
+  the number of threads.
+
+  @param wdim - size of the world; the world wraps around, so any
+                coordinates are allowed.
+  @param seed - PRNG seed of the world.
+  @param dmpf - the "sharpness" of the surface; shan`t be zero.
+  @param xbgn - X coordinate of the first point.
+  @param ybgn - Y coordinate of the first point.
+  @param size - number of squares along each side of the region.
+  @param step - distance between the points.
+
+  @return (size + 1) x (size + 1) array on success, NULL on failure;
+          to be freed by PoolFree().
+**/
+FLOAT *RegionNoise(UINT wdim, UINT seed, FLOAT dmpf, LONG xbgn, LONG ybgn, UINT size, UINT step) {
+    if (!wdim || !size || !step) return NULL;
+
+    FNSE fnse = {.farr = (FLOAT*)PoolAlloc((size + 1) * (size + 1) * sizeof(FLOAT), FALSE), .seed = seed,
+                 .wdim = wdim, .xbgn = xbgn, .ybgn = ybgn, .size = size, .step = step};
+
+    dmpf = pow(2.0, -fabs(dmpf));
+    for (fnse.noct = 0; (fnse.noct < DEF_NOCT) && (!fnse.noct || ((DEF_NBAS << fnse.noct) <= (wdim >> 1))); fnse.noct++) {
+        fnse.nlat[fnse.noct] = DEF_NBAS << fnse.noct;
+        fnse.fscl[fnse.noct] = (FLOAT)fnse.nlat[fnse.noct] / (FLOAT)wdim;
+        fnse.famp[fnse.noct] = (fnse.noct)? fnse.famp[fnse.noct - 1] * dmpf : 1.0;
+    }
+    fnse.fwrp = DEF_NWRP * (FLOAT)wdim / (FLOAT)DEF_NBAS;
+    SplitRows(NoiseRows, &fnse, size + 1, size + 1);
+    return fnse.farr;
+}
+
+
+
+/**
+  @brief SourceHeightmap
+  computes a rectangular part of the heightmap of the whole world, taking
+  it from the height source that the flags select: fBm noise (USE_FBMN,
+  see RegionNoise()) or diamond-square. A region that is the whole world
+  is done by MakeHeightmap(), which gives the same but computes its steps
+  in parallel; any other one by RegionHeightmap().
+  The result is to be blurred and turned into vertices the same way,
+  whichever the source.
+
+  @param flgs - flags of the world (see FVBO::flgs).
+  @param wdim - size of the world (N, N = 2**K for diamond-square, any for fBm noise).
+  @param seed - PRNG seed of the world.
+  @param dmpf - the "sharpness" of the surface; shan`t be zero.
+  @param xbgn - X coordinate of the first point.
+  @param ybgn - Y coordinate of the first point.
+  @param size - number of squares along each side of the region.
+  @param step - distance between the points.
+
+  @return (size + 1) x (size + 1) array on success, NULL on failure
+          (see RegionNoise(), RegionHeightmap()); to be freed by PoolFree().
+**/
+FLOAT *SourceHeightmap(UINT flgs, UINT wdim, UINT seed, FLOAT dmpf, LONG xbgn, LONG ybgn, UINT size, UINT step) {
+    if (flgs & USE_FBMN)
+        return RegionNoise(wdim, seed, dmpf, xbgn, ybgn, size, step);
+    if (!xbgn && !ybgn && (size == wdim) && (step == 1))
+        return MakeHeightmap(wdim, seed, dmpf);
+    return RegionHeightmap(wdim, seed, dmpf, xbgn, ybgn, size, step);
+}
+
+
+
+/**
+  @brief BlurLine
+  blurs a single line of a heightmap. Taps are given by pointers, so that the
+  horizontal and the vertical passes can share the same code: ftap[z][x] is
+  the point z steps away from the point x, z in [-rblr; rblr].
+
+  @param fdst - destination line.
+  @param ftap - array of pointers to the taps, centered at ftap[0].
+  @param blur - blur kernel; blur[0] is the weight of the center.
+  @param rblr - radius of the kernel.
+  @param dnum - number of points in the line.
+**/
+void BlurLine(FLOAT *fdst, FLOAT **ftap, FLOAT *blur, LONG rblr, LONG dnum) {
+    LONG x = 0, z;
+    FLOAT fsum;
+
+    #ifdef __SSE__
+    __m128 vsum;
+
+    for (; x + 4 <= dnum; x += 4) {
+        for (vsum = _mm_setzero_ps(), z = rblr; z > 0; z--)
+            vsum = _mm_add_ps(vsum, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(ftap[-z] + x), _mm_loadu_ps(ftap[z] + x)), _mm_set1_ps(blur[z])));
+        _mm_storeu_ps(fdst + x, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(ftap[0] + x), _mm_set1_ps(blur[0])), vsum));
+    }
+    #endif
+    for (; x < dnum; x++) {
+        for (fsum = 0.0, z = rblr; z > 0; z--)
+            fsum += (ftap[-z][x] + ftap[z][x]) * blur[z];
+        fdst[x] = ftap[0][x] * blur[0] + fsum;
+    }
+}
+
+
+
+/**
+  @brief BlurRows
+  applies one pass of BlurHeightmap() to a strip of rows. Both passes walk
+  the heightmap row by row; the horizontal one copies each row to a buffer
+  padded with the wrapped points, the vertical one wraps the row pointers,
+  so there are no per-tap conditionals in either.
+
+  @param data - FBLR that describes the pass.
+  @param ybgn - first row of the strip.
+  @param yend - row after the last one of the strip.
+**/
+void BlurRows(LPVOID data, LONG ybgn, LONG yend) {
+    FBLR *fblr = (FBLR*)data;
+    LONG y, z, size = fblr->size, rblr = fblr->rblr, sinc = size + 1;
+    FLOAT *fpad, **ftap;
+
+    ftap = (FLOAT**)malloc((rblr + 1 + rblr) * sizeof(FLOAT*)) + rblr;
+    if (!fblr->vert) {
+        fpad = (FLOAT*)PoolAlloc((rblr + sinc + rblr) * sizeof(FLOAT), FALSE) + rblr;
+        for (z = -rblr; z <= rblr; z++)
+            ftap[z] = fpad + z;
+        for (y = ybgn; y < yend; y++) {
+            memcpy(fpad, fblr->fsrc + y * sinc, sinc * sizeof(FLOAT));
+            for (z = 1; z <= rblr; z++) {
+                fpad[-z] = fpad[size - z];
+                fpad[size + z] = fpad[z];
+            }
+            BlurLine(fblr->fdst + y * sinc, ftap, fblr->blur, rblr, sinc);
+        }
+        PoolFree(fpad - rblr);
+    }
+    else
+        for (y = ybgn; y < yend; y++) {
+            for (z = -rblr; z <= rblr; z++)
+                ftap[z] = fblr->fsrc + ((y + z < 0)? y + z + size : (y + z > size)? y + z - size : y + z) * sinc;
+            BlurLine(fblr->fdst + y * sinc, ftap, fblr->blur, rblr, sinc);
+        }
+    free(ftap - rblr);
+}
+
+
+
+/**
+  @brief BlurKernel
+  computes the weights of the Gaussian blur that BlurHeightmap() applies.
+
+  @param fsig - strength of smoothing (see BlurHeightmap()).
+  @param size - width and height of the heightmap.
+  @param rblr - receives the radius of the kernel.
+
+  @return rblr + 1 weights, blur[0] being the one of the center, or NULL if
+          there is nothing to blur; to be freed by free().
+**/
+FLOAT *BlurKernel(FLOAT fsig, UINT size, LONG *rblr) {
+    FLOAT *blur, fsum;
+    LONG x;
+
+    if (!(fsig = fabs(fsig) * 3.0)) return NULL;
+    if (size <= 0 || fsig >= size) return NULL;
+
+    fsum = 9.0 / (2.0 * fsig * fsig);
+    blur = (FLOAT*)calloc((*rblr = tr(fsig)) + 1, sizeof(FLOAT));
+
+    for (x = *rblr; x > 0; x--)
+        blur[0] += blur[x] = exp(-x * x * fsum);
+
+    blur[0] = 0.5 / (blur[0] + 0.5);
+    for (x = *rblr; x > 0; x--)
+        blur[x] *= blur[0];
+    return blur;
+}
+
+
+
+/**
+  @brief BlurHeightmap
+  makes the heightmap look less edgy, by smoothing it with Gaussian blur.
+  Both passes are done in parallel by SplitRows().
+
+  @param farr - the heightmap to be blurred.
+  @param size - width and height of the heightmap.
+  @param fsig - strength of smoothing; [0, size).
+**/
+void BlurHeightmap(FLOAT *farr, UINT size, FLOAT fsig) {
+    FLOAT *blur, *ftmp;
+    FBLR fblr;
+    LONG x;
+
+    if (!(blur = BlurKernel(fsig, size, &fblr.rblr))) return;
+
+    ftmp = (FLOAT*)PoolAlloc((size + 1) * (size + 1) * sizeof(FLOAT), FALSE);
+    fblr.blur = blur;
+    fblr.size = size;
+    for (x = 0; x < 2; x++) {
+        fblr.fsrc = (x)? ftmp : farr;
+        fblr.fdst = (x)? farr : ftmp;
+        fblr.vert = x;
+        SplitRows(BlurRows, &fblr, size + 1, size + 1);
+    }
+    PoolFree(ftmp);
+    free(blur);
+}
+
+
+
+/**
+  @brief MakeVBO
+  creates an empty VBO placeholder. OpenGL objects are created later, by
+  UploadVBO(); so, like the rest of VBO creation, this is thread-safe.
+  All the arrays share a single block from PoolAlloc(), headed by the index
+  array, so that ReleaseVBO() and FreeVBO() drop them at once.
+
+  @param ndot - number of separate vertices in the VBO; must be > 0.
+
+  @return FVBO struct on success, NULL on failure (ndot == 0).
+**/
+FVBO *MakeVBO(UINT ndot) {
+    if (!ndot) return NULL;
+
+    #define VBO_ALGN(o) (((o) + DEF_PALN - 1) & ~(DEF_PALN - 1))
+    SIZE_T ovec = VBO_ALGN((1 + (ndot >> 1)) * sizeof(FTRI)),
+           onrm = VBO_ALGN(ovec + ndot * sizeof(FVEC)),
+           otex = VBO_ALGN(onrm + ndot * sizeof(FVEC)),
+           oclr = VBO_ALGN(otex + ndot * sizeof(FTEX));
+    #undef VBO_ALGN
+    FVBO *retn = (FVBO*)PoolAlloc(sizeof(FVBO), TRUE);
+    BYTE *data = (BYTE*)PoolAlloc(oclr + ndot * sizeof(FCLR), TRUE);
+
+    retn->ndot = ndot;
+    retn->indx = (FTRI*)data;
+    retn->vect = (FVEC*)(data + ovec);
+    retn->norm = (FVEC*)(data + onrm);
+    retn->texc = (FTEX*)(data + otex);
+    retn->clrs = (FCLR*)(data + oclr);
+    return retn;
+}
+
+
+
+/**
+  @brief PackVerts
+  converts the vertex data of a VBO into the packed vertices it already has,
+  in the unit of positions it already has (see PackVBO()).
+
+  @param vobj - VBO to be packed; FVBO::vtxs and FVBO::vscl shall be set.
+**/
+void PackVerts(FVBO *vobj) {
+    LONG x;
+
+    for (x = vobj->ndot - 1; x >= 0; x--) {
+        vobj->vtxs[x].x  = floor(vobj->vect[x].x / vobj->vscl + 0.5);
+        vobj->vtxs[x].y  = floor(vobj->vect[x].y / vobj->vscl + 0.5);
+        vobj->vtxs[x].z  = floor(vobj->vect[x].z / vobj->vscl + 0.5);
+        vobj->vtxs[x].u  = floor(vobj->texc[x].u * DEF_PTEX + 0.5);
+        vobj->vtxs[x].v  = floor(vobj->texc[x].v * DEF_PTEX + 0.5);
+        vobj->vtxs[x].nx = floor(vobj->norm[x].x * 127.0 + 0.5);
+        vobj->vtxs[x].ny = floor(vobj->norm[x].y * 127.0 + 0.5);
+        vobj->vtxs[x].nz = floor(vobj->norm[x].z * 127.0 + 0.5);
+        vobj->vtxs[x].c  = vobj->clrs[x];
+    }
+}
+
+
+
+/**
+  @brief PackVBO
+  converts the vertex data of a VBO into packed vertices (see FVTX).
+  The unit of positions is the smallest power of 2 that lets fext fit into
+  a SHORT, so VBOs having the same fext get identical packed coordinates
+  for identical points, and no cracks appear between them.
+
+  @param vobj - VBO to be packed.
+  @param fext - maximum absolute value of a vertex coordinate.
+**/
+void PackVBO(FVBO *vobj, FLOAT fext) {
+    vobj->vscl = pow(2.0, ceil(log2(fext / 32767.0)));
+    vobj->vtxs = (FVTX*)PoolAlloc(vobj->ndot * sizeof(FVTX), TRUE);
+    PackVerts(vobj);
+}
+
+
+
+/**
+  @brief PackIndices
+  sets the real size of the index array of a VBO, converting the indices to
+  16 bit in place if there are few enough vertices. This halves the index
+  memory and bandwidth for every landscape chunk and most object sets.
+  The array stays where it is, since it heads the block of the FVBO arrays.
+
+  @param vobj - VBO whose index array holds nind UINTs.
+  @param nind - number of indices.
+**/
+void PackIndices(FVBO *vobj, UINT nind) {
+    UINT x;
+
+    vobj->nind = nind;
+    if (vobj->ndot <= 65536) {
+        for (x = 0; x < nind; x++)
+            ((WORD*)vobj->indx)[x] = ((UINT*)vobj->indx)[x];
+        vobj->ityp = GL_UNSIGNED_SHORT;
+    }
+    else
+        vobj->ityp = GL_UNSIGNED_INT;
+}
+
+
+
+/**
+  @brief BufferData
+  creates an ARB buffer and fills it with data through a mapped pointer: the
+  storage is orphaned first, so that the driver hands out fresh memory and the
+  mapping needs no synchronization. Falls back to glBufferDataARB() if buffers
+  cannot be mapped, or if the mapped contents have been lost.
+
+  @param targ - buffer target, GL_ARRAY_BUFFER_ARB or GL_INDEX_BUFFER_ARB.
+  @param ibuf - where to put the ID of the buffer; the buffer stays bound.
+  @param size - size of the data in bytes.
+  @param data - the data.
+
+  @return number of bytes uploaded.
+**/
+UINT BufferData(GLenum targ, UINT *ibuf, UINT size, LPVOID data) {
+    LPVOID bptr = NULL;
+
+    glGenBuffersARB(1, ibuf);
+    glBindBufferARB(targ, *ibuf);
+    glBufferDataARB(targ, size, NULL, GL_STATIC_DRAW_ARB);
+    if (glMapBufferRange)
+        bptr = glMapBufferRange(targ, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    else if (glMapBufferARB)
+        bptr = glMapBufferARB(targ, GL_WRITE_ONLY_ARB);
+    if (bptr) {
+        memcpy(bptr, data, size);
+        if (glUnmapBufferARB(targ)) return size;
+    }
+    glBufferDataARB(targ, size, data, GL_STATIC_DRAW_ARB);
+    return size;
+}
+
+
+
+/**
+  @brief BufferMap
+  returns a pointer to a range of the bound ARB buffer that is to be written
+  to; the old contents of the range are discarded. If the range cannot be
+  mapped, returns a temporary array instead. Either way BufferDone() shall be
+  called when the range is filled.
+
+  @param targ - buffer target.
+  @param offs - offset of the range in bytes.
+  @param size - size of the range in bytes.
+  @param mapd - FALSE to get the temporary array without trying to map the
+                range; receives TRUE if the range is mapped, FALSE otherwise.
+
+  @return pointer to write the range to.
+**/
+LPVOID BufferMap(GLenum targ, UINT offs, UINT size, BOOL *mapd) {
+    LPVOID bptr = NULL;
+
+    if (*mapd && glMapBufferRange)
+        bptr = glMapBufferRange(targ, offs, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    *mapd = (bptr != NULL);
+    return (bptr)? bptr : PoolAlloc(size, FALSE);
+}
+
+
+
+/**
+  @brief BufferDone
+  finishes writing a range obtained from BufferMap(): unmaps it, or uploads
+  and frees the temporary array. If the mapped contents have been lost, the
+  range shall be written again: BufferMap() is called once more with the flag
+  this function cleared, and gives the temporary array, which is uploaded as
+  BufferData() does in that case (see BatchObjects()).
+
+  @param targ - buffer target.
+  @param offs - offset of the range in bytes.
+  @param size - size of the range in bytes.
+  @param bptr - pointer returned by BufferMap().
+  @param mapd - the flag set by BufferMap(); receives FALSE if the contents
+                have been lost.
+
+  @return TRUE if the range is uploaded, FALSE if it shall be written again.
+**/
+BOOL BufferDone(GLenum targ, UINT offs, UINT size, LPVOID bptr, BOOL *mapd) {
+    if (*mapd)
+        return *mapd = glUnmapBufferARB(targ);
+    glBufferSubDataARB(targ, offs, size, bptr);
+    PoolFree(bptr);
+    return TRUE;
+}
+
+
+
+/**
+  @brief ResizeHeightmap
+  (re)allocates the ping-pong textures of TextureHeightmap(), htex, both of
+  the same size; their contents are lost.
+  Shall be called from the thread that owns the OpenGL context.
+
+  @param size - new width and height of the textures.
+**/
+void ResizeHeightmap(LONG size) {
+    LONG x;
+
+    if (!htex[0]) glGenTextures(2, htex);
+    for (x = 0; x < 2; x++) {
+        glBindTexture(GL_TEXTURE_2D, htex[x]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, size, size, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    hdim = size;
+}
+
+
+
+/**
+  @brief TextureHeightmap
+  computes the height texture of a displaced chunk on the GPU, in place of
+  the CPU heightmap and of its upload (see TextureChunk()). The levels of
+  RegionHeightmap() are drawn by hshd, one pass for the squares and one for
+  the diamonds, ping-ponging between htex[0] and htex[1]; then come the two
+  passes of BlurHeightmap() and the one of FillVBO() that turns values into
+  heights and picks the texels of the VBO. Random values are the same as on
+  the CPU, so the texture only differs from what ChunkVBO() would make there
+  by rounding.
+  Shall be called from the thread that owns the OpenGL context.
+
+  @param fhgn - region of the world to be computed.
+  @param ndim - number of squares along each side of the VBO.
+  @param size - where to add the cost of the passes: the bytes of all the
+                texels they write, and of the texture; may be NULL.
+
+  @return (ndim + 3) x (ndim + 3) texture ID.
+**/
+UINT TextureHeightmap(FHGN *fhgn, UINT ndim, UINT *size) {
+    LONG x, xorg, yorg, nlvl, cdim, cstp, rblr = 0, ntxl = 0, rlvl[32][3];
+    FLOAT hdef, dmpf, *blur, fblr[DEF_HBLR] = {1.0},
+          fnrm[4] = {fhgn->fmin, fhgn->fscl, 0.5 * fhgn->fhei, fhgn->wlvl};
+    UINT retn;
+
+    nlvl = RegionLevels(rlvl, fhgn->wdim, fhgn->xbgn, fhgn->ybgn, fhgn->size, 1);
+    for (cdim = ndim + 3, x = 0; x < nlvl; x++)
+        cdim = max(cdim, (rlvl[x][2] >> x) + 3);
+    if (hdim < cdim) {
+        for (x = max(hdim, 1); x < cdim; x <<= 1);
+        ResizeHeightmap(x);
+    }
+    if ((blur = BlurKernel(DEF_BLUR, fhgn->size, &rblr))) {
+        memcpy(fblr, blur, (rblr + 1) * sizeof(FLOAT));
+        free(blur);
+    }
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_POLYGON_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_ALPHA_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glActTextureARB(GL_TEXTURE0_ARB);
+    glUseProgramObjectARB(hshd);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, hfbo);
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, htex[0], 0);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    #define HGN_PASS(s, d, n) glBindTexture(GL_TEXTURE_2D, htex[s]);                                              \
+                              glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, htex[d], 0); \
+                              glViewport(0, 0, n, n);                                                          \
+                              glRecti(-1, -1, 1, 1);                                                           \
+                              ntxl += (n) * (n);
+    glUniform1iARB(hsed, fhgn->seed);
+    xorg = rlvl[nlvl][0];
+    yorg = rlvl[nlvl][1];
+    hdef = dmpf = pow(2.0, -fabs(DEF_DMPF));
+    for (nlvl--; nlvl >= 0; nlvl--, hdef *= dmpf) {
+        cstp = 1 << nlvl;
+        cdim = rlvl[nlvl][2] / cstp + 3;
+        glUniform1fARB(hhdf, hdef);
+        glUniform4iARB(hcur, rlvl[nlvl][0], rlvl[nlvl][1], cstp, fhgn->wdim);
+        glUniform4iARB(hpre, xorg, yorg, cstp << 1, cdim);
+        glUniform1iARB(hmod, 0);
+        HGN_PASS(0, 1, cdim);
+        glUniform1iARB(hmod, 1);
+        HGN_PASS(1, 0, cdim);
+        xorg = rlvl[nlvl][0] - cstp;
+        yorg = rlvl[nlvl][1] - cstp;
+    }
+    glUniform1fvARB(hblr, DEF_HBLR, fblr);
+    glUniform1iARB(hnbl, rblr);
+    glUniform1iARB(hmod, 2);
+    glUniform4iARB(hcur, 1, 0, 0, 0);
+    glUniform4iARB(hpre, 1, 0, 0, fhgn->size);
+    HGN_PASS(0, 1, fhgn->size + 1);
+    glUniform4iARB(hcur, 0, 1, 0, 0);
+    glUniform4iARB(hpre, 0, 0, 0, fhgn->size);
+    HGN_PASS(1, 0, fhgn->size + 1);
+    glUniform4fvARB(hnrm, 1, fnrm);
+    glUniform1iARB(hmod, 3);
+    glUniform4iARB(hpre, fhgn->hofs, 0, 0, fhgn->size);
+    HGN_PASS(0, 1, ndim + 3);
+    #undef HGN_PASS
+    if (size) *size += ntxl * 4 * sizeof(FLOAT) + (ndim + 3) * (ndim + 3) * sizeof(FLOAT);
+
+    glGenTextures(1, &retn);
+    glBindTexture(GL_TEXTURE_2D, retn);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glCopyTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE32F_ARB, 0, 0, ndim + 3, ndim + 3, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, sfbo);
+    glUseProgramObjectARB(0);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glPopAttrib();
+    return retn;
+}
+
+
+
+/**
+  @brief UploadVBO
+  creates the OpenGL objects for a VBO and all VBOs chained after it: the
+  facet textures and the ARB buffers, filled with the indices and either the
+  height texture if the VBO is displaced, the packed vertices if there are
+  any, or the four separate arrays. LODs get the vertex buffers and the
+  textures of the level 0 VBO preceding them; objects get the atlas otex.
+  Buffers are written through BufferData(). A height texture that the GPU
+  has computed (see TextureChunk()) is already there, so nothing but the
+  indices is uploaded then.
+  Shall be called from the thread that owns the OpenGL context.
+
+  @param vobj - VBO to be uploaded; its indices shall be set by PackIndices().
+
+  @return number of bytes uploaded, textures included.
+**/
+UINT UploadVBO(FVBO *vobj) {
+    FVBO *fobj, *fvtx = vobj;
+    UINT retn = 0;
+
+    for (fobj = vobj; fobj; fobj = fobj->next) {
+        if (!fobj->nlod) {
+            fvtx = fobj;
+            fobj->ntex = (fobj->trnd)? FacetTex(fobj->trnd, fobj->tsed, &retn) : otex;
+        }
+        else {
+            fobj->ntex = fvtx->ntex;
+            fobj->ivec = fvtx->ivec;
+            fobj->inrm = fvtx->inrm;
+            fobj->iclr = fvtx->iclr;
+            fobj->itex = fvtx->itex;
+            fobj->ivtx = fvtx->ivtx;
+            fobj->ihgt = fvtx->ihgt;
+            fobj->dscp = fvtx->dscp;
+        }
+        if (!glGenBuffersARB) continue;
+
+        retn += BufferData(GL_INDEX_BUFFER_ARB, &fobj->iind,
+                           fobj->nind * ((fobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT)), fobj->indx);
+        if (fobj->nlod || fobj->ihgt) continue;
+
+        if (fobj->hpix) {
+            glGenTextures(1, &fobj->ihgt);
+            glBindTexture(GL_TEXTURE_2D, fobj->ihgt);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE32F_ARB, fobj->ndim + 3, fobj->ndim + 3, 0, GL_LUMINANCE, GL_FLOAT, fobj->hpix);
+            retn += (fobj->ndim + 3) * (fobj->ndim + 3) * sizeof(FLOAT);
+            PoolFree(fobj->hpix);
+            fobj->hpix = NULL;
+        }
+        else if (fobj->vtxs)
+            retn += BufferData(GL_ARRAY_BUFFER_ARB, &fobj->ivtx, fobj->ndot * sizeof(FVTX), fobj->vtxs);
+        else {
+            retn += BufferData(GL_ARRAY_BUFFER_ARB, &fobj->ivec, fobj->ndot * sizeof(FVEC), fobj->vect);
+            retn += BufferData(GL_ARRAY_BUFFER_ARB, &fobj->iclr, fobj->ndot * sizeof(FCLR), fobj->clrs);
+            retn += BufferData(GL_ARRAY_BUFFER_ARB, &fobj->inrm, fobj->ndot * sizeof(FVEC), fobj->norm);
+            retn += BufferData(GL_ARRAY_BUFFER_ARB, &fobj->itex, fobj->ndot * sizeof(FTEX), fobj->texc);
+        }
+    }
+    if (glGenBuffersARB) {
+        glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
+        glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    }
+    return retn;
+}
+
+
+
+/**
+  @brief ReleaseVBO
+  drops the CPU copies of the vertices and indices of a VBO chain that has
+  been uploaded to ARB VBOs, roughly halving the memory a chunk takes; only
+  the heights (FVBO::hgts) and what is kept with them are left. Nothing is
+  made anew later: chunks are regenerated instead when the client arrays
+  are selected (see [Z]).
+  Shall be called after UploadVBO(), and only if the chain is to be drawn
+  through ARB VBOs.
+
+  @param vobj - VBO to be released.
+**/
+void ReleaseVBO(FVBO *vobj) {
+    FVBO *fobj;
+
+    if (!vobj || !glGenBuffersARB) return;
+    for (fobj = vobj; fobj; fobj = fobj->next) {
+        if (!vobj->view) {
+            PoolFree(fobj->indx);
+            if (!fobj->nlod) PoolFree(fobj->vtxs);
+        }
+        fobj->indx = NULL;
+        fobj->vect = NULL;
+        fobj->norm = NULL;
+        fobj->texc = NULL;
+        fobj->clrs = NULL;
+        fobj->vtxs = NULL;
+    }
+    if (vobj->view) UnmapViewOfFile(vobj->view);
+    vobj->view = NULL;
+}
+
+
+
+/**
+  @brief OwnArrays
+  copies the packed vertices and the indices of a VBO chain mapped from the
+  tile cache (see LoadTile()) out of the view, and unmaps it, so that the
+  arrays belong to the chain like those of a generated one. The landscape
+  indices get room for the whole mesh, since remaking them may take more
+  space than the merged flat water did (see LandIndices()).
+
+  @param vobj - VBO chain; nothing is done unless it has a view.
+**/
+void OwnArrays(FVBO *vobj) {
+    FVBO *fobj, *fvtx = vobj;
+    UINT isiz, ncap;
+
+    if (!vobj || !vobj->view) return;
+    for (fobj = vobj; fobj; fobj = fobj->next) {
+        isiz = (fobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT);
+        ncap = fobj->nind * isiz;
+        if (fobj->nlod || fobj->hgts)
+            ncap = max(ncap, (12 * (fobj->ndim >> fobj->nlod) + 18) * (fobj->ndim >> fobj->nlod) * sizeof(UINT));
+        if (fobj->indx)
+            fobj->indx = (FTRI*)memcpy(PoolAlloc(ncap, FALSE), fobj->indx, fobj->nind * isiz);
+        if (!fobj->nlod) {
+            fvtx = fobj;
+            if (fobj->vtxs)
+                fobj->vtxs = (FVTX*)memcpy(PoolAlloc(fobj->ndot * sizeof(FVTX), FALSE), fobj->vtxs, fobj->ndot * sizeof(FVTX));
+        }
+        else
+            fobj->vtxs = fvtx->vtxs;
+    }
+    UnmapViewOfFile(vobj->view);
+    vobj->view = NULL;
+}
+
+
+
+/**
+  @brief GridVBO
+  returns the grid that the displacement shader builds the landscapes of the
+  given size upon; the grid is shared by all of them and created on demand.
+  Every vertex holds its position in half-squares, in the same order as the
+  vertices of FillVBO(): odd positions are the centers of the squares.
+
+  @param ndim - size of the landscape; shall be a power of 2 < 16384.
+
+  @return VBO ID of the grid (2 GL_SHORTs per vertex).
+**/
+UINT GridVBO(UINT ndim) {
+    UINT x, y, dpos, lpwr;
+    SHORT *grid;
+
+    for (lpwr = 0; (1 << lpwr) < ndim; lpwr++);
+    if (!dgrd[lpwr]) {
+        grid = (SHORT*)malloc((ndim + 1) * (ndim + ndim + 2) * 2 * sizeof(SHORT));
+        for (y = 0; y <= ndim; y++) {
+            dpos = y * (ndim + 1) << 1;
+            for (x = 0; x <= ndim; x++) {
+                grid[(dpos + x) * 2 + 0] = x << 1;
+                grid[(dpos + x) * 2 + 1] = y << 1;
+                grid[(dpos + x + ndim + 1) * 2 + 0] = (x << 1) + 1;
+                grid[(dpos + x + ndim + 1) * 2 + 1] = (y << 1) + 1;
+            }
+        }
+        glGenBuffersARB(1, &dgrd[lpwr]);
+        glBindBufferARB(GL_ARRAY_BUFFER_ARB, dgrd[lpwr]);
+        glBufferDataARB(GL_ARRAY_BUFFER_ARB, (ndim + 1) * (ndim + ndim + 2) * 2 * sizeof(SHORT), grid, GL_STATIC_DRAW_ARB);
+        free(grid);
+    }
+    return dgrd[lpwr];
+}
+
+
+
+/**
+  @brief LodIndices
+  fills the index array of a landscape VBO LOD, where every square is made
+  of 2^nlod x 2^nlod squares of the VBO and has a vertex at its center.
+
+  The array consists of 9 parts: the core, then 4 edge strips (bottom, right,
+  top, left) that join the core to the same LOD level, then 4 strips that
+  join it to a LOD level twice as coarse. In the latter, the edge vertices
+  missing from the coarse neighbour are dropped, so no cracks appear at the
+  seam:
+
+  @verbatim
+    \    |    /           \        /
+     cA--T--cB     ->      cA----cB
+    /  \ | /  \          /  \    / \
+   X0---X1----X2        X0--------X2
+  @endverbatim
+
+  The core goes in columns DEF_IBLK squares wide, so that the vertices
+  shared with the previous row are still in the post-transform cache when
+  they are used again.
+
+  The squares flagged in fmsk are left out of the core; instead, the
+  rectangles they form are appended to it, two triangles each, grown
+  greedily along X and then along Y. Flagged squares shall not be at the
+  edges, so the strips are never affected.
+
+  @param indx - array to be filled; shall hold 12 * N * N + 18 * N elements,
+                where N = ndim / 2^nlod.
+  @param ndim - dimension of the VBO; shall be a power of 2.
+  @param nlod - LOD level; 2^nlod shall not exceed ndim / 2.
+  @param fmsk - N x N flags of the squares to be merged (see FlatCells()),
+                cleared on return; NULL if there are none.
+
+  @return number of indices written; all but the last 18 * N form the whole mesh.
+**/
+UINT LodIndices(UINT *indx, UINT ndim, UINT nlod, BYTE *fmsk) {
+    LONG i, j, e, p, x, y, b, dlen = 2 << nlod, cdim = ndim >> nlod, ndbl = ndim << 1;
+    LONG lpnt[6][2], gpnt[6][2], crnr[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    BYTE ltri[7][3] = {{3, 0, 1}, {3, 1, 5}, {4, 5, 1}, {4, 1, 2},
+                       {3, 0, 2}, {3, 2, 4}, {3, 4, 5}};
+    UINT *iptr = indx;
+
+    #define VTX(x, y) ((y) * (ndim + 1) + ((x) >> 1))
+    #define OWN(i, j, e) ((((j) == 0)        && (((e) == 0) || ((e) == (((i) & 1)? 3 : 1))))  \
+                       || (((i) == cdim - 1) && (((e) == 1) || ((e) == (((j) & 1)? 0 : 2))))  \
+                       || (((j) == cdim - 1) && (((e) == 2) || ((e) == (((i) & 1)? 3 : 1))))  \
+                       || (((i) == 0)        && (((e) == 3) || ((e) == (((j) & 1)? 0 : 2)))))
+    for (b = 0; b < cdim; b += DEF_IBLK)
+        for (j = 0; j < cdim; j++)
+            for (i = b; i < min(cdim, b + DEF_IBLK); i++) {
+                x = i * dlen + (dlen >> 1);
+                y = j * dlen + (dlen >> 1);
+                for (e = 0; e < 4; e++)
+                    if (!OWN(i, j, e) && !(fmsk && fmsk[i + j * cdim])) {
+                        *iptr++ = VTX(x, y);
+                        *iptr++ = VTX((i + crnr[e][0]) * dlen, (j + crnr[e][1]) * dlen);
+                        *iptr++ = VTX((i + crnr[(e + 1) & 3][0]) * dlen, (j + crnr[(e + 1) & 3][1]) * dlen);
+                    }
+            }
+    #undef OWN
+
+    for (j = 0; fmsk && (j < cdim); j++)
+        for (i = 0; i < cdim; i++) {
+            if (!fmsk[i + j * cdim]) continue;
+            for (x = i + 1; (x < cdim) && fmsk[x + j * cdim]; x++);
+            for (y = j + 1; y < cdim; y++) {
+                for (p = i; (p < x) && fmsk[p + y * cdim]; p++);
+                if (p < x) break;
+            }
+            for (b = j; b < y; b++)
+                memset(fmsk + i + b * cdim, 0, x - i);
+            *iptr++ = VTX(i * dlen, j * dlen);
+            *iptr++ = VTX(x * dlen, j * dlen);
+            *iptr++ = VTX(x * dlen, y * dlen);
+            *iptr++ = VTX(i * dlen, j * dlen);
+            *iptr++ = VTX(x * dlen, y * dlen);
+            *iptr++ = VTX(i * dlen, y * dlen);
+        }
+
+    for (x = 0; x < 7; x += 4)
+        for (e = 0; e < 4; e++)
+            for (p = 0; p < cdim; p += 2) {
+                lpnt[0][0] = (p + 0) * dlen;              lpnt[0][1] = 0;
+                lpnt[1][0] = (p + 1) * dlen;              lpnt[1][1] = 0;
+                lpnt[2][0] = (p + 2) * dlen;              lpnt[2][1] = 0;
+                lpnt[3][0] = (p + 0) * dlen + (dlen >> 1); lpnt[3][1] = dlen >> 1;
+                lpnt[4][0] = (p + 1) * dlen + (dlen >> 1); lpnt[4][1] = dlen >> 1;
+                lpnt[5][0] = (p + 1) * dlen;              lpnt[5][1] = dlen;
+                for (i = 0; i < 6; i++) {
+                    gpnt[i][0] = (e == 0)? lpnt[i][0] : (e == 1)? ndbl - lpnt[i][1] : (e == 2)? ndbl - lpnt[i][0] : lpnt[i][1];
+                    gpnt[i][1] = (e == 0)? lpnt[i][1] : (e == 1)? lpnt[i][0] : (e == 2)? ndbl - lpnt[i][1] : ndbl - lpnt[i][0];
+                }
+                for (i = x; i < ((x)? 7 : 4); i++)
+                    for (j = 0; j < 3; j++)
+                        *iptr++ = VTX(gpnt[ltri[i][j]][0], gpnt[ltri[i][j]][1]);
+            }
+    #undef VTX
+
+    return iptr - indx;
+}
+
+
+
+/**
+  @brief FlatCells
+  finds the squares of a landscape VBO LOD that lie in flat water: all their
+  vertices are at the "sea level", and so are all the heights these vertices
+  take their normals and colors from (see FillRows()). Such vertices are all
+  alike, so the squares may be merged without any visible change (see
+  LodIndices()). Squares at the edges never qualify.
+
+  @param hgts - (ndim + 1) x (ndim + 1) heights of the corners (see FVBO::hgts); may be NULL.
+  @param ndim - dimension of the VBO.
+  @param nlod - LOD level.
+  @param wlvl - "sea level".
+
+  @return (ndim / 2^nlod)^2 flags, nonzero for flat squares, to be freed by
+          PoolFree(); NULL if there are none (or hgts == NULL).
+**/
+BYTE *FlatCells(FLOAT *hgts, UINT ndim, UINT nlod, FLOAT wlvl) {
+    LONG i, j, x, y, cdim = ndim >> nlod, cstp = 1 << nlod, nflt = 0;
+    BYTE *vflt, *retn;
+    FLOAT fctr;
+
+    if (!hgts) return NULL;
+
+    vflt = (BYTE*)PoolAlloc((ndim + 1) * (ndim + 1), TRUE);
+    #define HGT(x, y) hgts[(x) + (y) * (ndim + 1)]
+    #define FLT(x, y) vflt[(x) + (y) * (ndim + 1)]
+    for (y = 1; y < (LONG)ndim; y++)
+        for (x = 1; x < (LONG)ndim; x++) {
+            for (i = 0; (i < 9) && (HGT(x + i % 3 - 1, y + i / 3 - 1) == wlvl); i++);
+            for (j = 0; (i == 9) && (j < 4); j++) {
+                fctr = 0.25 * (HGT(x - 1 + (j & 1), y - 1 + (j >> 1)) + HGT(x + (j & 1), y - 1 + (j >> 1))
+                            +  HGT(x - 1 + (j & 1), y + (j >> 1))     + HGT(x + (j & 1), y + (j >> 1)));
+                if (fctr != wlvl) break;
+            }
+            FLT(x, y) = (j == 4);
+        }
+    retn = (BYTE*)PoolAlloc(cdim * cdim, FALSE);
+    for (j = 0; j < cdim; j++)
+        for (i = 0; i < cdim; i++) {
+            x = i * cstp;
+            y = j * cstp;
+            retn[i + j * cdim] = FLT(x, y) && FLT(x + cstp, y) && FLT(x, y + cstp) && FLT(x + cstp, y + cstp)
+                              && FLT(x + (cstp >> 1), y + (cstp >> 1));
+            nflt += retn[i + j * cdim];
+        }
+    #undef FLT
+    #undef HGT
+    PoolFree(vflt);
+    if (!nflt) {
+        PoolFree(retn);
+        retn = NULL;
+    }
+    return retn;
+}
+
+
+
+/**
+  @brief LandIndices
+  fills the index array of a landscape VBO or of its LOD by LodIndices(),
+  merging the squares of flat water (see FlatCells()), and sets FVBO::npol.
+
+  @param vobj - the VBO; FVBO::wlvl shall be set, and the index array shall
+                hold 12 * N * N + 18 * N UINTs, where N = ndim / 2^nlod.
+  @param hgts - heights of the corners of the level 0 VBO; NULL not to merge anything.
+**/
+void LandIndices(FVBO *vobj, FLOAT *hgts) {
+    BYTE *fmsk = FlatCells(hgts, vobj->ndim, vobj->nlod, vobj->wlvl);
+
+    PackIndices(vobj, LodIndices((UINT*)vobj->indx, vobj->ndim, vobj->nlod, fmsk));
+    vobj->npol = vobj->nind - 18 * (vobj->ndim >> vobj->nlod);
+    PoolFree(fmsk);
+}
+
+
+
+/**
+  @brief LodVBO
+  creates a LOD of a landscape VBO; the LOD shares vertex data with its base.
+
+  @param vobj - the base landscape VBO (level 0).
+  @param nlod - LOD level; 2^nlod shall not exceed vobj->ndim / 2.
+
+  @return FVBO on success, NULL on failure (vobj == NULL or nlod is invalid).
+**/
+FVBO *LodVBO(FVBO *vobj, UINT nlod) {
+    if (!vobj || !nlod || ((vobj->ndim >> nlod) < 2)) return NULL;
+
+    FVBO *retn = (FVBO*)PoolAlloc(sizeof(FVBO), FALSE);
+    UINT ndim = vobj->ndim >> nlod;
+
+    *retn = *vobj;
+    retn->next = NULL;
+    retn->nlod = nlod;
+    retn->emsk = 0;
+    retn->iind = 0;
+    retn->hgts = NULL;
+    retn->qtre = NULL;
+    retn->aocc = NULL;
+    retn->indx = (FTRI*)PoolAlloc((12 * ndim * ndim + 18 * ndim) * sizeof(UINT), FALSE);
+    LandIndices(retn, vobj->hgts);
+    return retn;
+}
+
+
+
+/**
+  @brief StateApply
+  brings the GL state to the one requested, only issuing the calls for what
+  differs from the state cached in glst; the cache is updated accordingly.
+  Enabling the color array makes the current color unknown, since drawing
+  with it leaves the current color undefined. While a baked light texture
+  is bound (FGLS::nlgt), GL lighting is off, and unit 3 generates the
+  texture coords from the vertex positions (set up in WM_INITDIALOG).
+
+  @param fgls - the state requested, see FGLS.
+**/
+void StateApply(FGLS *fgls) {
+    if (glst.pmod != fgls->pmod)
+        glPolygonMode(GL_FRONT_AND_BACK, glst.pmod = fgls->pmod);
+
+    if (fgls->wclr && !glst.wclr) {
+        glColor4ub(255, 255, 255, 255);
+        glst.wclr = TRUE;
+    }
+    if (glst.arrs == GLS_NONE) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glst.arrs = ~fgls->arrs;
+    }
+    #define GLS_ARRS(f, a) if ((glst.arrs ^ fgls->arrs) & (f)) { \
+                               if (fgls->arrs & (f)) glEnableClientState(a); \
+                               else glDisableClientState(a); }
+    GLS_ARRS(USE_NORM, GL_NORMAL_ARRAY);
+    GLS_ARRS(USE_TEXC, GL_TEXTURE_COORD_ARRAY);
+    GLS_ARRS(USE_CLRS, GL_COLOR_ARRAY);
+    #undef GLS_ARRS
+    glst.arrs = fgls->arrs;
+    if (fgls->arrs & USE_CLRS)
+        glst.wclr = FALSE;
+
+    if (glst.ntex != fgls->ntex) {
+        if (!fgls->ntex)
+            glDisable(GL_TEXTURE_2D);
+        else {
+            if (!glst.ntex || (glst.ntex == GLS_NONE))
+                glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, fgls->ntex);
+        }
+        glst.ntex = fgls->ntex;
+    }
+    if ((glst.prog != fgls->prog) && glUseProgramObjectARB)
+        glUseProgramObjectARB(glst.prog = fgls->prog);
+
+    if (glst.nrmz != fgls->nrmz) {
+        if (fgls->nrmz)
+            glEnable(GL_NORMALIZE);
+        else
+            glDisable(GL_NORMALIZE);
+        glst.nrmz = fgls->nrmz;
+    }
+    if (glst.tscl != fgls->tscl) {
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+        glScalef(fgls->tscl, fgls->tscl, 1.0);
+        glMatrixMode(GL_MODELVIEW);
+        glst.tscl = fgls->tscl;
+    }
+    if ((glst.nlgt != fgls->nlgt) && blgt) {
+        glActTextureARB(GL_TEXTURE3_ARB);
+        if (!fgls->nlgt) {
+            glDisable(GL_TEXTURE_GEN_T);
+            glDisable(GL_TEXTURE_GEN_S);
+            glDisable(GL_TEXTURE_2D);
+            glEnable(GL_LIGHTING);
+        }
+        else {
+            if (!glst.nlgt || (glst.nlgt == GLS_NONE)) {
+                glDisable(GL_LIGHTING);
+                glEnable(GL_TEXTURE_2D);
+                glEnable(GL_TEXTURE_GEN_S);
+                glEnable(GL_TEXTURE_GEN_T);
+            }
+            glBindTexture(GL_TEXTURE_2D, fgls->nlgt);
+        }
+        glActTextureARB(GL_TEXTURE0_ARB);
+        glst.nlgt = fgls->nlgt;
+    }
+    if (fgls->nlgt && (glst.lscl != fgls->lscl)) {
+        glActTextureARB(GL_TEXTURE3_ARB);
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+        glTranslatef(0.5, 0.5, 0.0);
+        glScalef(fgls->lscl, fgls->lscl, 1.0);
+        glMatrixMode(GL_MODELVIEW);
+        glActTextureARB(GL_TEXTURE0_ARB);
+        glst.lscl = fgls->lscl;
+    }
+}
+
+
+
+/**
+  @brief StateBind
+  binds an ARB buffer unless it is already bound, according to glst.
+
+  @param targ - GL_INDEX_BUFFER_ARB or GL_ARRAY_BUFFER_ARB.
+  @param buff - VBO ID of the buffer; 0 unbinds.
+**/
+void StateBind(GLenum targ, UINT buff) {
+    UINT *bind = (targ == GL_INDEX_BUFFER_ARB)? &glst.iind : &glst.iarr;
+
+    if (!glBindBufferARB || (*bind == buff)) return;
+    glBindBufferARB(targ, *bind = buff);
+}
+
+
+
+/**
+  @brief StateReset
+  restores the defaults other code expects (no client arrays, buffers,
+  texturing or programs, GL lighting on) after a sequence of draws, and
+  marks everything that other code may change until the next draw as
+  unknown in glst.
+**/
+void StateReset() {
+    FGLS fgls = glst;
+
+    fgls.arrs = USE_NONE;
+    fgls.ntex = 0;
+    fgls.prog = 0;
+    fgls.nrmz = FALSE;
+    fgls.wclr = FALSE;
+    fgls.tscl = 1.0;
+    fgls.nlgt = 0;
+    StateApply(&fgls);
+    StateBind(GL_INDEX_BUFFER_ARB, 0);
+    StateBind(GL_ARRAY_BUFFER_ARB, 0);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glst.arrs = glst.ntex = glst.iind = glst.iarr = glst.prog = glst.nlgt = GLS_NONE;
+    glst.wclr = FALSE;
+}
+
+
+
+/**
+  @brief DrawParts
+  issues the draw calls for a VBO whose indices are already set up, using
+  the stitched edge strips for the edges flagged in FVBO::emsk.
+
+  @param vobj - VBO to be rendered.
+  @param iptr - the beginning of the index array; NULL for ARB VBOs.
+  @param nins - number of instances to draw; 0 means no instancing.
+**/
+void DrawParts(FVBO *vobj, BYTE *iptr, UINT nins) {
+    UINT e, ndim, ncor, isiz = (vobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT);
+
+    #define DRAW(c, o) prof.ndrw++; prof.ntri += (c) / 3 * max(1, nins); \
+                       if (nins) glDrawElementsInstancedARB(GL_TRIANGLES, c, vobj->ityp, iptr + (o) * isiz, nins); \
+                       else glDrawElements(GL_TRIANGLES, c, vobj->ityp, iptr + (o) * isiz)
+    if (!vobj->emsk) {
+        DRAW(vobj->npol, 0);
+        return;
+    }
+    ndim = vobj->ndim >> vobj->nlod;
+    ncor = vobj->npol - 4 * 6 * ndim;
+    for (e = 0; (e < 4) && !(vobj->emsk & (1 << e)); e++);
+    DRAW(ncor + e * 6 * ndim, 0);
+    for (; e < 4; e++)
+        if (vobj->emsk & (1 << e)) {
+            DRAW(9 * (ndim >> 1), vobj->npol + e * 9 * (ndim >> 1));
+        }
+        else {
+            DRAW(6 * ndim, ncor + e * 6 * ndim);
+        }
+    #undef DRAW
+}
+
+
+
+/**
+  @brief DrawCopies
+  renders a VBO whose arrays are already set up at each of the given offsets.
+  With USE_INST, all copies are drawn by DrawParts() at once via instancing
+  (DrawVBO() has made ishd the program in use then); otherwise every copy
+  gets its own translation and draw calls.
+
+  @param vobj - VBO to be rendered.
+  @param iptr - the beginning of the index array; NULL for ARB VBOs.
+  @param fofs - array of offsets to draw the copies at.
+  @param nofs - number of offsets.
+**/
+void DrawCopies(FVBO *vobj, BYTE *iptr, FVEC *fofs, UINT nofs) {
+    UINT i;
+
+    if ((vobj->flgs & USE_INST) && ishd && !vobj->ihgt) {
+        glUniform1fARB(iscl, (vobj->vtxs || vobj->ivtx)? vobj->vscl : 1.0);
+        glUniform1fARB(ibak, ((vobj->flgs & USE_BAKE) && blgt && vobj->ilgt)? 1.0 : 0.0);
+        for (i = 0; i < nofs; i += DEF_NINS) {
+            glUniform3fvARB(iofs, min(DEF_NINS, nofs - i), (FLOAT*)&fofs[i]);
+            DrawParts(vobj, iptr, min(DEF_NINS, nofs - i));
+        }
+        return;
+    }
+    for (i = 0; i < nofs; i++) {
+        glPushMatrix();
+        glTranslatef(fofs[i].x, fofs[i].y, fofs[i].z);
+        if (vobj->vtxs || vobj->ivtx)
+            glScalef(vobj->vscl, vobj->vscl, vobj->vscl);
+        DrawParts(vobj, iptr, 0);
+        glPopMatrix();
+    }
+}
+
+
+
+/**
+  @brief DrawVBO
+  renders the VBO using OpenGL commands, once per each offset given.
+  All the state is set up only once for all the copies, and only where it
+  differs from what the previous draw left (see StateApply()); the state is
+  left as is, StateReset() shall be called after the last draw.
+  VBOs with a height texture are always drawn from the ARB buffers.
+  A landscape with a baked light texture is drawn with USE_BAKE without
+  normals or GL lighting; the texture matrix of unit 3 maps the positions of
+  the corners, in units of the vertices, onto the centers of the texels.
+
+  @param vobj - VBO to be rendered; must be a valid FVBO pointer.
+  @param fofs - array of offsets to draw the copies at.
+  @param nofs - number of offsets.
+**/
+void DrawVBO(FVBO *vobj, FVEC *fofs, UINT nofs) {
+    if (!vobj) return;
+    FLOAT fhei[DEF_NCLR], fclr[DEF_NCLR][4];
+    FVBO *fobj;
+    BYTE *vptr;
+    FGLS fgls;
+    UINT i;
+
+    fgls.pmod = (vobj->flgs & USE_FILL)? GL_FILL : GL_LINE;
+    fgls.arrs = vobj->flgs & (USE_NORM | USE_TEXC | USE_CLRS);
+    fgls.ntex = (vobj->flgs & USE_TEXC)? vobj->ntex : 0;
+    fgls.prog = (vobj->ihgt)? dshd : ((vobj->flgs & USE_INST) && ishd)? ishd : 0;
+    fgls.nrmz = FALSE;
+    fgls.wclr = !(vobj->flgs & USE_CLRS);
+    fgls.tscl = 1.0;
+    fgls.nlgt = ((vobj->flgs & USE_BAKE) && blgt)? vobj->ilgt : 0;
+    fgls.lscl = glst.lscl;
+    if (fgls.nlgt) {
+        fgls.arrs &= ~USE_NORM;
+        fgls.lscl = ((vobj->vtxs || vobj->ivtx)? vobj->vscl : 1.0) / (vobj->grid / (FLOAT)vobj->ndim * (FLOAT)(vobj->ndim + 1));
+    }
+
+    if (vobj->ihgt) {
+        fgls.arrs = USE_NONE;
+        StateApply(&fgls);
+        glUniform3fARB(dprm, vobj->grid / (FLOAT)vobj->ndim, vobj->ndim, vobj->wlvl);
+        glUniform2fARB(dflg, ((vobj->flgs & USE_NORM) && !fgls.nlgt)? 1.0 : 0.0, (vobj->flgs & USE_CLRS)? 1.0 : 0.0);
+        glUniform1fARB(dbak, (fgls.nlgt)? 1.0 : 0.0);
+        for (i = 0; i <= vobj->nclr; i++) {
+            fhei[i] = vobj->dscp[i].fhei;
+            fclr[i][0] = vobj->dscp[i].fclr.R / 255.0;
+            fclr[i][1] = vobj->dscp[i].fclr.G / 255.0;
+            fclr[i][2] = vobj->dscp[i].fclr.B / 255.0;
+            fclr[i][3] = vobj->dscp[i].fclr.A / 255.0;
+        }
+        glUniform1fvARB(dhei, vobj->nclr, fhei);
+        glUniform4fvARB(dclr, vobj->nclr + 1, (FLOAT*)fclr);
+        glUniform1iARB(dnum, vobj->nclr);
+        glActTextureARB(GL_TEXTURE1_ARB);
+        glBindTexture(GL_TEXTURE_2D, vobj->ihgt);
+        glActTextureARB(GL_TEXTURE0_ARB);
+        StateBind(GL_INDEX_BUFFER_ARB, vobj->iind);
+        StateBind(GL_ARRAY_BUFFER_ARB, GridVBO(vobj->ndim));
+        glVertexPointer(2, GL_SHORT, 0, 0);
+        DrawCopies(vobj, NULL, fofs, nofs);
+    }
+    else if (vobj->vtxs || vobj->ivtx) {
+        fgls.nrmz = (fgls.arrs & USE_NORM)? TRUE : FALSE;
+        if (vobj->flgs & USE_TEXC)
+            fgls.tscl = 1.0 / DEF_PTEX;
+        StateApply(&fgls);
+        vptr = (BYTE*)vobj->vtxs;
+        if (vobj->flgs & USE_ARBV) {
+            StateBind(GL_INDEX_BUFFER_ARB, vobj->iind);
+            StateBind(GL_ARRAY_BUFFER_ARB, vobj->ivtx);
+            vptr = NULL;
+        }
+        else {
+            StateBind(GL_INDEX_BUFFER_ARB, 0);
+            StateBind(GL_ARRAY_BUFFER_ARB, 0);
+        }
+        glVertexPointer(3, GL_SHORT, sizeof(FVTX), vptr + offsetof(FVTX, x));
+        if (fgls.arrs & USE_NORM)
+            glNormalPointer(GL_BYTE, sizeof(FVTX), vptr + offsetof(FVTX, nx));
+        if (vobj->flgs & USE_TEXC)
+            glTexCoordPointer(2, GL_SHORT, sizeof(FVTX), vptr + offsetof(FVTX, u));
+        if (vobj->flgs & USE_CLRS)
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FVTX), vptr + offsetof(FVTX, c));
+        DrawCopies(vobj, (vobj->flgs & USE_ARBV)? NULL : (BYTE*)vobj->indx, fofs, nofs);
+    }
+    else if (vobj->flgs & USE_ARBV) {
+        StateApply(&fgls);
+        StateBind(GL_INDEX_BUFFER_ARB, vobj->iind);
+        StateBind(GL_ARRAY_BUFFER_ARB, vobj->ivec);
+        glVertexPointer(3, GL_FLOAT, 0, 0);
+        if (fgls.arrs & USE_NORM) {
+            StateBind(GL_ARRAY_BUFFER_ARB, vobj->inrm);
+            glNormalPointer(GL_FLOAT, 0, 0);
+        }
+        if (vobj->flgs & USE_TEXC) {
+            StateBind(GL_ARRAY_BUFFER_ARB, vobj->itex);
+            glTexCoordPointer(2, GL_FLOAT, 0, 0);
+        }
+        if (vobj->flgs & USE_CLRS) {
+            StateBind(GL_ARRAY_BUFFER_ARB, vobj->iclr);
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, 0);
+        }
+        DrawCopies(vobj, NULL, fofs, nofs);
+    }
+    else {
+        StateApply(&fgls);
+        StateBind(GL_INDEX_BUFFER_ARB, 0);
+        StateBind(GL_ARRAY_BUFFER_ARB, 0);
+        glVertexPointer(3, GL_FLOAT, 0, vobj->vect);
+        if (fgls.arrs & USE_NORM)
+            glNormalPointer(GL_FLOAT, 0, vobj->norm);
+        if (vobj->flgs & USE_TEXC)
+            glTexCoordPointer(2, GL_FLOAT, 0, vobj->texc);
+        if (vobj->flgs & USE_CLRS)
+            glColorPointer(4, GL_UNSIGNED_BYTE, 0, vobj->clrs);
+        DrawCopies(vobj, (BYTE*)vobj->indx, fofs, nofs);
+    }
+
+    for (fobj = vobj->next; fobj && fobj->nlod; fobj = fobj->next);
+    if (!fobj)
+        vobj->flgs &= ~USE_OBJS;
+    else if (vobj->flgs & USE_OBJS) {
+        fobj->flgs = (fobj->flgs & USE_OBJS)? vobj->flgs : vobj->flgs & ~USE_OBJS;
+        fobj->emsk = 0;
+        DrawVBO(fobj, fofs, nofs);
+    }
+}
+
+
+
+/**
+  @brief FreeVBO
+  frees a VBO. /Captain, is it you again? ^_^/
+  Its memory goes back to the pool (see PoolAlloc()).
+
+  @param vobj - pointer to the location where the target FVBO is stored.
+**/
+void FreeVBO(FVBO **vobj) {
+    FVBO *fobj;
+
+    if (vobj && *vobj) {
+        if ((*vobj)->view)
+            for (fobj = *vobj; fobj; fobj = fobj->next) {
+                fobj->indx = NULL;
+                fobj->vtxs = NULL;
+            }
+        FreeVBO(&(*vobj)->next);
+        if ((*vobj)->nlod) {
+            if (glGenBuffersARB) glDelBuffersARB(1, &(*vobj)->iind);
+            PoolFree((*vobj)->indx);
+            PoolFree(*vobj);
+            *vobj = NULL;
+            return;
+        }
+        if (glGenBuffersARB) {
+            glDelBuffersARB(1, &(*vobj)->iind);
+            glDelBuffersARB(1, &(*vobj)->ivec);
+            glDelBuffersARB(1, &(*vobj)->inrm);
+            glDelBuffersARB(1, &(*vobj)->itex);
+            glDelBuffersARB(1, &(*vobj)->iclr);
+            glDelBuffersARB(1, &(*vobj)->ivtx);
+        }
+        DropFacetTex((*vobj)->ntex);
+        glDeleteTextures(1, &(*vobj)->ihgt);
+        glDeleteTextures(1, &(*vobj)->ilgt);
+        PoolFree((*vobj)->indx);
+        PoolFree((*vobj)->vtxs);
+        PoolFree((*vobj)->hpix);
+        PoolFree((*vobj)->hgts);
+        PoolFree((*vobj)->qtre);
+        PoolFree((*vobj)->aocc);
+        PoolFree((*vobj)->ocel);
+        free((*vobj)->dscp);
+        if ((*vobj)->view) UnmapViewOfFile((*vobj)->view);
+        PoolFree(*vobj);
+        *vobj = NULL;
+    }
+}
+
+
+
+/**
+  @brief CamLightReset
+  resets camera and light source orientation to their default values.
+**/
+void CamLightReset() {
+    fang.u = DEF_ANGU;
+    fang.v = DEF_ANGV;
+
+    ftrn.x = DEF_TRNX;
+    ftrn.y = DEF_TRNY;
+    ftrn.z = DEF_TRNZ;
+
+    ldir[0] = DEF_DIRX;
+    ldir[1] = DEF_DIRY;
+    ldir[2] = DEF_DIRZ;
+    ldir[3] = 1.0;
+
+    lpos[0] = DEF_POSX;
+    lpos[1] = DEF_POSY;
+    lpos[2] = DEF_POSZ;
+    lpos[3] = 1.0;
+}
+
+
+
+/**
+  @brief Serialize
+  saves world creation parameters to a file.
+
+  @param file - file into which the world shall be serialized.
+  @param vobj - location where the target FMAP is stored.
+**/
+void Serialize(LPSTR file, FMAP *vobj) {
+    FILE *filp;
+
+    if ((filp = fopen(file, "wb"))) {
+        if ((file = strstr(file, DEF_FEXT)) && (strlen(file) == DEF_FEXL)) {
+            fprintf(filp, DEF_FRMT, vobj->seed, vobj->flgs,
+                    fang.u,  fang.v,
+                    ftrn.x,  ftrn.y,  ftrn.z,
+                    ldir[0], ldir[1], ldir[2],
+                    lpos[0], lpos[1], lpos[2]);
+        }
+        else {
+            fwrite(&vobj->seed, sizeof(UINT), 1, filp);
+            fwrite(&vobj->flgs, sizeof(UINT), 1, filp);
+            fwrite(&fang, sizeof(FTEX), 1, filp);
+            fwrite(&ftrn, sizeof(FVEC), 1, filp);
+            fwrite(ldir, sizeof(FVEC), 1, filp);
+            fwrite(lpos, sizeof(FVEC), 1, filp);
+        }
+        fclose(filp);
+    }
+}
+
+
+
+/**
+  @brief QuadRect
+  recomputes the nodes of a quadtree (see QuadTree()) over a rectangle of
+  squares, level by level up to the root, after their heights have changed.
+
+  @param qtre - the quadtree.
+  @param hgts - (ndim + 1) x (ndim + 1) heights of the square corners.
+  @param ndim - horizontal and vertical dimension of the landscape.
+  @param rect - the rectangle, in squares: lower X, lower Y, upper X, upper Y;
+                the upper bounds are excluded.
+**/
+void QuadRect(FQTN *qtre, FLOAT *hgts, UINT ndim, LONG *rect) {
+    LONG x, y, xmin = rect[0], ymin = rect[1], xmax = rect[2] - 1, ymax = rect[3] - 1;
+    UINT size, qpos, qnew;
+    FQTN *fcur;
+
+    for (y = ymin; y <= ymax; y++)
+        for (x = xmin; x <= xmax; x++) {
+            fcur = &qtre[x + y * ndim];
+            fcur->hmin = min(min(hgts[x + y * (ndim + 1)],       hgts[x + 1 + y * (ndim + 1)]),
+                             min(hgts[x + (y + 1) * (ndim + 1)], hgts[x + 1 + (y + 1) * (ndim + 1)]));
+            fcur->hmax = max(max(hgts[x + y * (ndim + 1)],       hgts[x + 1 + y * (ndim + 1)]),
+                             max(hgts[x + (y + 1) * (ndim + 1)], hgts[x + 1 + (y + 1) * (ndim + 1)]));
+        }
+    #define QTN_NODE(x, y) qtre[qpos + (x) + (y) * (size << 1)]
+    for (qpos = 0, size = ndim >> 1; size; qpos = qnew, size >>= 1) {
+        qnew = qpos + 4 * size * size;
+        xmin >>= 1;
+        ymin >>= 1;
+        xmax >>= 1;
+        ymax >>= 1;
+        for (y = ymin; y <= ymax; y++)
+            for (x = xmin; x <= xmax; x++) {
+                fcur = &qtre[qnew + x + y * size];
+                fcur->hmin = min(min(QTN_NODE(2 * x, 2 * y    ).hmin, QTN_NODE(2 * x + 1, 2 * y    ).hmin),
+                                 min(QTN_NODE(2 * x, 2 * y + 1).hmin, QTN_NODE(2 * x + 1, 2 * y + 1).hmin));
+                fcur->hmax = max(max(QTN_NODE(2 * x, 2 * y    ).hmax, QTN_NODE(2 * x + 1, 2 * y    ).hmax),
+                                 max(QTN_NODE(2 * x, 2 * y + 1).hmax, QTN_NODE(2 * x + 1, 2 * y + 1).hmax));
+            }
+    }
+    #undef QTN_NODE
+}
+
+
+
+/**
+  @brief QuadTree
+  builds the quadtree of heights over the squares of a landscape. Level 0
+  holds ndim x ndim nodes, one per square; every next level has half the
+  nodes in each direction, each spanning four nodes of the previous one,
+  up to the root that spans the whole landscape. The levels follow each
+  other in the array, starting with level 0.
+
+  @param hgts - (ndim + 1) x (ndim + 1) heights of the square corners.
+  @param ndim - horizontal and vertical dimension of the landscape; shall
+                be a power of 2.
+
+  @return the array of nodes; shall be released with PoolFree().
+**/
+FQTN *QuadTree(FLOAT *hgts, UINT ndim) {
+    LONG rect[4] = {0, 0, ndim, ndim};
+    UINT size, qpos;
+    FQTN *retn;
+
+    for (qpos = 0, size = ndim; size; size >>= 1)
+        qpos += size * size;
+    retn = (FQTN*)PoolAlloc(qpos * sizeof(FQTN), FALSE);
+    QuadRect(retn, hgts, ndim, rect);
+    return retn;
+}
+
+
+
+/**
+  @brief QuadCells
+  recursive part of LandCells(): lists the squares under a single node of
+  the quadtree, skipping the subtrees that lie outside the region or are
+  not higher than hmin anywhere.
+
+  @param vobj - the landscape VBO.
+  @param qpos - index of the first node of the level the node is at.
+  @param size - count of nodes in a row at that level.
+  @param xpos - horizontal position of the node within its level.
+  @param ypos - vertical position of the node within its level.
+  @param rect - the region, see LandCells().
+  @param hmin - the height the centers shall be above.
+  @param cell - the array to put the squares to.
+
+  @return count of the squares found.
+**/
+UINT QuadCells(FVBO *vobj, UINT qpos, UINT size, LONG xpos, LONG ypos,
+               LONG *rect, FLOAT hmin, UINT *cell) {
+    LONG spos = vobj->ndim / size;
+    FLOAT *hgts;
+    UINT retn;
+
+    if (((xpos + 1) * spos <= rect[0]) || (xpos * spos >= rect[2])
+    ||  ((ypos + 1) * spos <= rect[1]) || (ypos * spos >= rect[3])
+    ||  (vobj->qtre[qpos + xpos + ypos * size].hmax <= hmin))
+        return 0;
+
+    if (size < vobj->ndim) {
+        qpos -= 4 * size * size;
+        retn  = QuadCells(vobj, qpos, size << 1, (xpos << 1) + 0, (ypos << 1) + 0, rect, hmin, cell);
+        retn += QuadCells(vobj, qpos, size << 1, (xpos << 1) + 1, (ypos << 1) + 0, rect, hmin, cell + retn);
+        retn += QuadCells(vobj, qpos, size << 1, (xpos << 1) + 0, (ypos << 1) + 1, rect, hmin, cell + retn);
+        retn += QuadCells(vobj, qpos, size << 1, (xpos << 1) + 1, (ypos << 1) + 1, rect, hmin, cell + retn);
+        return retn;
+    }
+    hgts = vobj->hgts + xpos + ypos * (vobj->ndim + 1);
+    if (0.25 * (hgts[0] + hgts[1] + hgts[vobj->ndim + 1] + hgts[vobj->ndim + 1 + 1]) <= hmin)
+        return 0;
+    *cell = xpos + ypos * vobj->ndim;
+    return 1;
+}
+
+
+
+/**
+  @brief LandCells
+  finds the squares of a landscape within a region whose centers are above
+  the given height, descending its quadtree (see QuadTree()), so that the
+  areas that are entirely too low (e.g. under water) cost a single check.
+
+  @param vobj - the landscape VBO; shall have FVBO::hgts and FVBO::qtre.
+  @param rect - the region, in squares: lower X, lower Y, upper X, upper Y;
+                the upper bounds are excluded.
+  @param hmin - the height the centers shall be above.
+  @param cell - the array to put the squares to, as (X + Y * FVBO::ndim);
+                shall be able to hold all the squares of the region.
+
+  @return count of the squares found.
+**/
+UINT LandCells(FVBO *vobj, LONG *rect, FLOAT hmin, UINT *cell) {
+    UINT size, qpos;
+
+    if (!vobj || !vobj->qtre || !vobj->hgts) return 0;
+
+    for (qpos = 0, size = vobj->ndim; size > 1; size >>= 1)
+        qpos += size * size;
+    return QuadCells(vobj, qpos, 1, 0, 0, rect, hmin, cell);
+}
+
+
+
+/**
+  @brief PlaceFir
+  makes the vertices of a single fir, standing at the center of a square of
+  the landscape: 3 pyramids stacked along the normal, their bases shrinking
+  towards the top and spanning the square corners at the bottom.
+
+  @param retn - object VBO; FVBO::grid shall be set. The fir takes its 15
+                vertices starting from 15 * iobj, the indices are not set.
+  @param iobj - index of the fir.
+  @param vect - vertices of the landscape.
+  @param norm - normals of the landscape.
+  @param vpos - index of the center vertex of the square in vect / norm.
+  @param strd - difference between the indices of the center and its lower
+                corners (ndim + 1 in a whole landscape, see FillRows()).
+  @param seed - seed of the landscape; it defines the cell of the atlas otex.
+**/
+void PlaceFir(FVBO *retn, UINT iobj, FVEC *vect, FVEC *norm, LONG vpos, LONG strd, UINT seed) {
+    FVEC fbgn, fend, fv00, fv01, fv10, fv11;
+    LONG x, y, xh;
+
+    x = HashRand(seed, 0, 1, DEF_KOBJ) % (DEF_NATL * DEF_NATL);
+    fbgn.x = (FLOAT)(x % DEF_NATL) / (FLOAT)DEF_NATL;
+    fbgn.y = (FLOAT)(x / DEF_NATL) / (FLOAT)DEF_NATL;
+    for (x = 15 * iobj + 14; x >= 15 * iobj; x--) {
+        retn->texc[x].u = fbgn.x;
+        retn->texc[x].v = fbgn.y;
+    }
+
+    #define FIR_TTEX (1.0 / DEF_NATL)
+    #define FIR_SIZE  0.75
+    #define FIR_FADE (0.25 * FIR_SIZE)
+    fv00 = vect[vpos - strd + 0];
+    fv01 = vect[vpos - strd + 1];
+    fv11 = vect[vpos + strd + 1];
+    fv10 = vect[vpos + strd + 0];
+
+    fbgn = vect[vpos];
+    fend = norm[vpos];
+
+    fend.x *= 0.5 * retn->grid;
+    fend.y *= 0.5 * retn->grid;
+    fend.z *= 0.5 * retn->grid;
+
+    for (y = 0; y < 3; y++) {
+        xh = (iobj * 3 + y) * 5;
+
+        retn->clrs[xh + 4].RGBA =
+        retn->clrs[xh + 3].RGBA =
+        retn->clrs[xh + 2].RGBA =
+        retn->clrs[xh + 1].RGBA =
+        retn->clrs[xh + 0].RGBA = 0xFF00B000;
+
+        retn->norm[xh + 0] = norm[vpos];
+
+        retn->vect[xh + 0].x = fbgn.x + fend.x * (FLOAT)(y + 2);
+        retn->vect[xh + 0].y = fbgn.y + fend.y * (FLOAT)(y + 2);
+        retn->vect[xh + 0].z = fbgn.z + fend.z * (FLOAT)(y + 2);
+
+        retn->vect[xh + 1].x = fbgn.x + (fv00.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
+        retn->vect[xh + 1].y = fbgn.y + (fv00.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
+        retn->vect[xh + 1].z = fbgn.z + (fv00.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+
+        retn->vect[xh + 2].x = fbgn.x + (fv01.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
+        retn->vect[xh + 2].y = fbgn.y + (fv01.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
+        retn->vect[xh + 2].z = fbgn.z + (fv01.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+
+        retn->vect[xh + 3].x = fbgn.x + (fv11.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
+        retn->vect[xh + 3].y = fbgn.y + (fv11.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
+        retn->vect[xh + 3].z = fbgn.z + (fv11.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+
+        retn->vect[xh + 4].x = fbgn.x + (fv10.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
+        retn->vect[xh + 4].y = fbgn.y + (fv10.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
+        retn->vect[xh + 4].z = fbgn.z + (fv10.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+
+        retn->texc[xh + 0].u += 0.5 * FIR_TTEX;
+        retn->texc[xh + 0].v += 0.5 * FIR_TTEX;
+        retn->texc[xh + 2].u += FIR_TTEX;
+        retn->texc[xh + 4].u += FIR_TTEX;
+    }
+    #undef FIR_FADE
+    #undef FIR_SIZE
+    #undef FIR_TTEX
+}
+
+
+
+/**
+  @brief ObjectVBO
+  generates a VBO filled with additional objects for a "parent" landscape VBO.
+
+  @param vobj - Parent VBO; the objects shall be situated on its surface,
+                at the centers of the squares LandCells() finds above the
+                "sea level". Its seed defines where the objects are and
+                which cell of the atlas otex they use, so regenerating the
+                same chunk always puts the same objects at the same spots.
+  @param inum - number of objects to create; may be overridden in case it
+                exceeds the count of spots that can actually hold an object.
+
+  @return FVBO on success, NULL on failure (vobj == NULL, inum == 0, vobj
+          has no quadtree or there are no spots above the "sea level").
+**/
+FVBO *ObjectVBO(FVBO *vobj, UINT inum) {
+    LONG x, y, xl, xh, rect[4];
+    UINT *fobj, *farr;
+    FVBO *retn;
+
+    if (!vobj || !inum || !vobj->qtre) return NULL;
+
+    rect[0] = rect[1] = 0;
+    rect[2] = rect[3] = vobj->ndim;
+    farr = (UINT*)PoolAlloc(vobj->ndim * vobj->ndim * sizeof(UINT), FALSE);
+    xh = LandCells(vobj, rect, vobj->wlvl, farr);
+
+    if (!(xl = min(xh, inum))) {
+        PoolFree(farr);
+        return NULL;
+    }
+    fobj = (UINT*)malloc((1 + xl) * sizeof(UINT));
+    fobj[0] = xl;
+
+    for (; xl > 0; xl--) {
+        x = HashRand(vobj->seed, xl, 0, DEF_KOBJ) % xh;
+        fobj[xl] = (vobj->ndim + 1) + (farr[x] / vobj->ndim) * ((vobj->ndim + 1) << 1) + farr[x] % vobj->ndim;
+        farr[x] = farr[--xh];
+    }
+    PoolFree(farr);
+
+    retn = MakeVBO(3 * 5 * fobj[0]);
+    retn->grid = vobj->grid / (FLOAT)vobj->ndim;
+    for (x = fobj[0] - 1; x >= 0; x--) {
+        for (y = 0; y < 3; y++) {
+            xl = x * 3 + y;
+            xh = xl * 5;
+
+            retn->indx[xl].a = xh + 0;
+            retn->indx[xl].b = xh + 4;
+            retn->indx[xl].c = xh + 1;
+
+            retn->indx[xl].d = xh + 0;
+            retn->indx[xl].e = xh + 1;
+            retn->indx[xl].f = xh + 2;
+
+            retn->indx[xl].g = xh + 0;
+            retn->indx[xl].h = xh + 2;
+            retn->indx[xl].i = xh + 3;
+
+            retn->indx[xl].j = xh + 0;
+            retn->indx[xl].k = xh + 3;
+            retn->indx[xl].l = xh + 4;
+        }
+        PlaceFir(retn, x, vobj->vect, vobj->norm, fobj[x + 1], vobj->ndim + 1, vobj->seed);
+    }
+
+    retn->bmin = retn->bmax = retn->vect[0];
+    for (x = retn->ndot - 1; x > 0; x--) {
+        retn->bmin.x = min(retn->bmin.x, retn->vect[x].x);
+        retn->bmin.y = min(retn->bmin.y, retn->vect[x].y);
+        retn->bmin.z = min(retn->bmin.z, retn->vect[x].z);
+        retn->bmax.x = max(retn->bmax.x, retn->vect[x].x);
+        retn->bmax.y = max(retn->bmax.y, retn->vect[x].y);
+        retn->bmax.z = max(retn->bmax.z, retn->vect[x].z);
+    }
+    retn->wmin.x = retn->wmax.x + 1.0;
+
+    if (vobj->flgs & USE_PACK)
+        PackVBO(retn, max(max(max(fabs(retn->bmin.x), fabs(retn->bmax.x)),
+                              max(fabs(retn->bmin.y), fabs(retn->bmax.y))),
+                              max(fabs(retn->bmin.z), fabs(retn->bmax.z))));
+    PackIndices(retn, 3 * 3 * 4 * fobj[0]);
+
+    retn->flgs = USE_ARBV;
+    retn->npol = 3 * 3 * 4 * fobj[0];
+    retn->ocel = (UINT*)memcpy(PoolAlloc(fobj[0] * sizeof(UINT), FALSE), fobj + 1, fobj[0] * sizeof(UINT));
+    free(fobj);
+
+    return retn;
+}
+
+
+
+/**
+  @brief NormLine
+  finishes a line of normals whose X and Y components are already set: sets
+  their Z component and normalizes them. Where the FLOAT arithmetic is that
+  of SSE, the normals are also normalized 4 at a time with SSE2, with the
+  very same roundings (sums in FLOATs, the square root and the division in
+  doubles), so the results do not depend on which of the paths is taken.
+
+  @param norm - the normals.
+  @param nnum - number of normals in the line.
+  @param fnrz - Z component of every normal before normalization.
+**/
+void NormLine(FVEC *norm, LONG nnum, FLOAT fnrz) {
+    LONG i, x = 0;
+    FLOAT fmul;
+
+    #if defined(__SSE2__) && (FLT_EVAL_METHOD == 0)
+    __m128 vlen, vmul;
+    FLOAT fvec[4];
+
+    for (; x + 4 <= nnum; x += 4) {
+        vlen = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set_ps(norm[x + 3].x, norm[x + 2].x, norm[x + 1].x, norm[x].x),
+                                                _mm_set_ps(norm[x + 3].x, norm[x + 2].x, norm[x + 1].x, norm[x].x)),
+                                     _mm_mul_ps(_mm_set_ps(norm[x + 3].y, norm[x + 2].y, norm[x + 1].y, norm[x].y),
+                                                _mm_set_ps(norm[x + 3].y, norm[x + 2].y, norm[x + 1].y, norm[x].y))),
+                          _mm_set1_ps(fnrz * fnrz));
+        vmul = _mm_movelh_ps(_mm_cvtpd_ps(_mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(_mm_cvtps_pd(vlen)))),
+                             _mm_cvtpd_ps(_mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(_mm_cvtps_pd(_mm_movehl_ps(vlen, vlen))))));
+        _mm_storeu_ps(fvec, vmul);
+        for (i = 0; i < 4; i++) {
+            norm[x + i].z = fnrz * fvec[i];
+            norm[x + i].x *= fvec[i];
+            norm[x + i].y *= fvec[i];
+        }
+    }
+    #endif
+    for (; x < nnum; x++) {
+        norm[x].z = fnrz;
+        fmul = 1.0 / sqrt(norm[x].x * norm[x].x
+                        + norm[x].y * norm[x].y
+                        + norm[x].z * norm[x].z);
+        norm[x].x *= fmul;
+        norm[x].y *= fmul;
+        norm[x].z *= fmul;
+    }
+}
+
+
+
+/**
+  @brief FillRows
+  computes the vertices of a rectangle of a landscape: positions, colors,
+  normals and texture coords. Every row of corners is made in full, and then
+  the row of centers that precedes it, so the data stays in the cache while
+  it is needed; the heights of the centers are computed a row ahead.
+  The bounding boxes of the VBO are extended to hold the new vertices.
+
+  @param retn - VBO to put the vertices to; retn->ndim is the size of the
+                whole landscape, but the arrays only hold the rectangle, in
+                the usual order (a row of corners, then a row of centers)
+                with rows of (rect[2] - rect[0] + 1) vertices. retn->hgts,
+                if not NULL, gets the heights of the corners (see FVBO::hgts).
+  @param farr - corner heights of the rectangle and of a border 1 point wide
+                around it, (rect[2] - rect[0] + 3) per row, already within
+                the height range.
+  @param rect - the rectangle, in corners: lower X, lower Y, upper X, upper Y;
+                the upper bounds are included.
+  @param grid - width and height of the elementary square.
+  @param fhei - height range.
+  @param wlvl - "sea level" within the range.
+  @param lscp - array of FHEIs for mapping colors to heights.
+**/
+void FillRows(FVBO *retn, FLOAT *farr, LONG *rect, FLOAT grid, FLOAT fhei, FLOAT wlvl, FHEI *lscp) {
+    LONG i, x, y, xl, xh, yl, yh, dpos, ndim = retn->ndim,
+         strd = rect[2] - rect[0] + 1, sinc = strd + 2;
+    FLOAT fmin, fmax, *fctr;
+    DWORD wclr;
+    BYTE wtrn;
+
+    #define HGT(x, y) farr[((x) - rect[0] + 1) + ((y) - rect[1] + 1) * sinc]
+    #define CTR(x, y) fctr[((x) - rect[0] + 1) + ((y) - rect[1] + 1) * (sinc - 1)]
+    for (fmax = i = 0; lscp[i].fhei > 0.0; i++)
+        fmax += lscp[i].fhei;
+    wclr = lscp[i].fclr.RGBA & 0xFFFFFF;
+    wtrn = lscp[i].fclr.A;
+
+    fctr = (FLOAT*)PoolAlloc((sinc - 1) * (rect[3] - rect[1] + 2) * sizeof(FLOAT), FALSE);
+    for (y = rect[1] - 1; y <= rect[1]; y++)
+        for (x = rect[0] - 1; x <= rect[2]; x++)
+            CTR(x, y) = 0.25 * (HGT(x, y) + HGT(x + 1, y) + HGT(x, y + 1) + HGT(x + 1, y + 1));
+
+    for (y = rect[1]; y <= rect[3]; y++) {
+        if (y < rect[3])
+            for (x = rect[0] - 1; x <= rect[2]; x++)
+                CTR(x, y + 1) = 0.25 * (HGT(x, y + 1) + HGT(x + 1, y + 1) + HGT(x, y + 2) + HGT(x + 1, y + 2));
+
+        dpos = ((y - rect[1]) * strd << 1) - rect[0];
+        for (x = rect[0]; x <= rect[2]; x++) {
+            retn->vect[dpos + x].x = grid * (FLOAT)x - 0.5 * grid * (FLOAT)ndim;
+            retn->vect[dpos + x].y = grid * (FLOAT)y - 0.5 * grid * (FLOAT)ndim;
+            retn->vect[dpos + x].z = HGT(x, y);
+            if (retn->hgts) retn->hgts[x + y * (ndim + 1)] = HGT(x, y);
+            retn->bmin.z = min(retn->bmin.z, retn->vect[dpos + x].z);
+            retn->bmax.z = max(retn->bmax.z, retn->vect[dpos + x].z);
+            if (retn->vect[dpos + x].z == wlvl) {
+                retn->wmin.x = min(retn->wmin.x, retn->vect[dpos + x].x - grid);
+                retn->wmax.x = max(retn->wmax.x, retn->vect[dpos + x].x + grid);
+                retn->wmin.y = min(retn->wmin.y, retn->vect[dpos + x].y - grid);
+                retn->wmax.y = max(retn->wmax.y, retn->vect[dpos + x].y + grid);
+            }
+
+            fmin = fmax * (HGT(x, y) - wlvl) / (0.5 * fhei - wlvl);
+            i = 0;
+            while (lscp[i].fhei > 0.0 && (fmin -= lscp[i].fhei) > 0.0) i++;
+            if (lscp[i].fhei <= 0.0) i--;
+
+            retn->clrs[dpos + x].RGBA = lscp[i].fclr.RGBA | 0xFF000000;
+            if ((HGT(x, y) == wlvl) &&
+                (CTR(x - 1, y - 1) == wlvl) &&
+                (CTR(x - 1, y    ) == wlvl) &&
+                (CTR(x,     y - 1) == wlvl) &&
+                (CTR(x,     y    ) == wlvl))
+                 retn->clrs[dpos + x].RGBA = wclr | (wtrn * 0x1000000);
+
+            retn->norm[dpos + x].x = HGT(x - 1, y) - HGT(x + 1, y);
+            retn->norm[dpos + x].y = HGT(x, y - 1) - HGT(x, y + 1);
+
+            retn->texc[dpos + x].u = (FLOAT)x;
+            retn->texc[dpos + x].v = (FLOAT)y;
+            retn->texc[dpos + x + strd].u = (FLOAT)x + 0.5;
+            retn->texc[dpos + x + strd].v = (FLOAT)y + 0.5;
+        }
+        NormLine(retn->norm + dpos + rect[0], strd, 2.0 * grid);
+        if (y == rect[1]) continue;
+
+        dpos = ((y - 1 - rect[1]) * strd << 1) - rect[0];
+        for (x = rect[0]; x < rect[2]; x++) {
+            retn->vect[dpos + x + strd].x = grid * (FLOAT)(x + 0.5) - 0.5 * grid * (FLOAT)ndim;
+            retn->vect[dpos + x + strd].y = grid * (FLOAT)(y - 1 + 0.5) - 0.5 * grid * (FLOAT)ndim;
+            retn->vect[dpos + x + strd].z = CTR(x, y - 1);
+
+            xl = dpos + x;
+            xh = dpos + x + 1;
+            yl = 0;
+            yh = strd << 1;
+            retn->clrs[dpos + x + strd].R = (retn->clrs[xl + yl].R
+                                          +  retn->clrs[xl + yh].R
+                                          +  retn->clrs[xh + yl].R
+                                          +  retn->clrs[xh + yh].R) >> 2;
+            retn->clrs[dpos + x + strd].G = (retn->clrs[xl + yl].G
+                                          +  retn->clrs[xl + yh].G
+                                          +  retn->clrs[xh + yl].G
+                                          +  retn->clrs[xh + yh].G) >> 2;
+            retn->clrs[dpos + x + strd].B = (retn->clrs[xl + yl].B
+                                          +  retn->clrs[xl + yh].B
+                                          +  retn->clrs[xh + yl].B
+                                          +  retn->clrs[xh + yh].B) >> 2;
+            retn->clrs[dpos + x + strd].A = 255;
+            if (CTR(x, y - 1) == wlvl) {
+                i = (((retn->clrs[xl + yl].A == wtrn)? 0 : 1)  +
+                     ((retn->clrs[xl + yh].A == wtrn)? 0 : 1)  +
+                     ((retn->clrs[xh + yl].A == wtrn)? 0 : 1)  +
+                     ((retn->clrs[xh + yh].A == wtrn)? 0 : 1)) * (255 - wtrn);
+                if (!i) retn->clrs[dpos + x + strd].RGBA = wclr;
+                retn->clrs[dpos + x + strd].A = wtrn + (i >> 2);
+            }
+
+            retn->norm[dpos + x + strd].x = CTR(x - 1, y - 1) - CTR(x + 1, y - 1);
+            retn->norm[dpos + x + strd].y = CTR(x, y - 2) - CTR(x, y);
+        }
+        NormLine(retn->norm + dpos + rect[0] + strd, strd, 2.0 * grid);
+    }
+    PoolFree(fctr);
+    #undef CTR
+    #undef HGT
+}
+
+
+
+/**
+  @brief OcclusionRows
+  computes the ambient occlusion of a strip of rows of square corners for
+  MakeOcclusion(). In each of DEF_BAOD directions, the corner is covered by
+  the steepest slope up to any corner within DEF_BAOR squares, and the part
+  of the sky it leaves open is averaged over the directions. Directions that
+  leave the landscape at once are not counted, so the corners at its edges
+  are only judged by what lies inside.
+
+  @param data - FBAK that describes the landscape.
+  @param ybgn - first row, counted from FBAK::ybgn.
+  @param yend - row after the last one.
+**/
+void OcclusionRows(LPVOID data, LONG ybgn, LONG yend) {
+    FBAK *fbak = (FBAK*)data;
+    LONG d, r, x, y, xpos, ypos, nuse, ndim = fbak->ndim, sinc = ndim + 1;
+    FLOAT fdir[DEF_BAOD][2], fslp, fmax, focc, *hgts = fbak->hgts;
+
+    for (d = 0; d < DEF_BAOD; d++) {
+        fdir[d][0] = cos(2.0 * M_PI * (FLOAT)d / (FLOAT)DEF_BAOD);
+        fdir[d][1] = sin(2.0 * M_PI * (FLOAT)d / (FLOAT)DEF_BAOD);
+    }
+    for (y = fbak->ybgn + ybgn; y < fbak->ybgn + yend; y++)
+        for (x = 0; x <= ndim; x++) {
+            for (focc = nuse = d = 0; d < DEF_BAOD; d++) {
+                for (fmax = 0.0, r = 1; r <= DEF_BAOR; r++) {
+                    xpos = floor((FLOAT)x + (FLOAT)r * fdir[d][0] + 0.5);
+                    ypos = floor((FLOAT)y + (FLOAT)r * fdir[d][1] + 0.5);
+                    if ((xpos < 0) || (xpos > ndim) || (ypos < 0) || (ypos > ndim)) break;
+                    fslp = (hgts[xpos + ypos * sinc] - hgts[x + y * sinc]) / ((FLOAT)r * fbak->cell);
+                    fmax = max(fmax, fslp);
+                }
+                if (r > 1) {
+                    focc += fmax / sqrt(1.0 + fmax * fmax);
+                    nuse++;
+                }
+            }
+            fbak->aocc[x + y * sinc] = tr(255.0 * (1.0 - ((nuse)? focc / (FLOAT)nuse : 0.0)) + 0.5);
+        }
+}
+
+
+
+/**
+  @brief MakeOcclusion
+  computes the ambient occlusion of rows of square corners of a landscape
+  (see OcclusionRows()) in parallel, by SplitRows(). It does not depend on
+  the light, so it is made once, on creation or with the first bake, and
+  only remade where the heights change.
+
+  @param hgts - (ndim + 1) x (ndim + 1) heights of the square corners.
+  @param aocc - occlusion to be updated; NULL to make it anew, in which case
+                the rows shall be all of them.
+  @param ndim - horizontal and vertical dimension of the landscape.
+  @param cell - width and height of the elemental square.
+  @param ybgn - first row of corners to be done; clamped to the landscape.
+  @param yend - row after the last one; clamped to the landscape.
+
+  @return the occlusion, (ndim + 1) x (ndim + 1) bytes to be freed by PoolFree().
+**/
+BYTE *MakeOcclusion(FLOAT *hgts, BYTE *aocc, LONG ndim, FLOAT cell, LONG ybgn, LONG yend) {
+    FBAK fbak;
+
+    fbak.hgts = hgts;
+    fbak.aocc = (aocc)? aocc : (BYTE*)PoolAlloc((ndim + 1) * (ndim + 1), FALSE);
+    fbak.ndim = ndim;
+    fbak.cell = cell;
+    fbak.ybgn = max(0, ybgn);
+    yend = min(ndim + 1, yend);
+    if (yend > fbak.ybgn)
+        SplitRows(OcclusionRows, &fbak, yend - fbak.ybgn, (ndim + 1) * DEF_BAOD * DEF_BAOR);
+    return fbak.aocc;
+}
+
+
+
+/**
+  @brief LightRows
+  bakes the light of a strip of rows of square corners for BakeLight().
+  A corner gets the diffuse light of GL_LIGHT0 (normals are computed as in
+  FillRows(), one-sided at the edges) unless it lies in the shadow: the ray
+  to the light is marched a square at a time, and the light is blocked
+  if the surface rises above the ray before it leaves the landscape or
+  climbs above its highest point. The ambient light (DEF_BAMB) is added,
+  and then all of it is darkened by the ambient occlusion.
+
+  @param data - FBAK that describes the landscape.
+  @param ybgn - first row.
+  @param yend - row after the last one.
+**/
+void LightRows(LPVOID data, LONG ybgn, LONG yend) {
+    FBAK *fbak = (FBAK*)data;
+    LONG x, y, xpos, ypos, ndim = fbak->ndim, sinc = ndim + 1;
+    FLOAT fdif, fstp, fray, xcur, ycur, zcur, fhgt, cell = fbak->cell, *hgts = fbak->hgts;
+    FVEC norm, lray;
+
+    #define HGT(x, y) hgts[min(ndim, max(0, (x))) + min(ndim, max(0, (y))) * sinc]
+    for (y = ybgn; y < yend; y++)
+        for (x = 0; x <= ndim; x++) {
+            lray.x = fbak->lvec.x - cell * ((FLOAT)x - 0.5 * (FLOAT)ndim);
+            lray.y = fbak->lvec.y - cell * ((FLOAT)y - 0.5 * (FLOAT)ndim);
+            lray.z = fbak->lvec.z - HGT(x, y);
+            norm.x = (HGT(x - 1, y) - HGT(x + 1, y)) / (cell * (FLOAT)(min(ndim, x + 1) - max(0, x - 1)));
+            norm.y = (HGT(x, y - 1) - HGT(x, y + 1)) / (cell * (FLOAT)(min(ndim, y + 1) - max(0, y - 1)));
+            norm.z = 1.0;
+            fdif = (norm.x * lray.x + norm.y * lray.y + norm.z * lray.z)
+                 / sqrt((norm.x * norm.x + norm.y * norm.y + norm.z * norm.z)
+                      * (lray.x * lray.x + lray.y * lray.y + lray.z * lray.z));
+            if (fdif > 0.0) {
+                fstp = cell / max(FLT_EPSILON, max(fabs(lray.x), fabs(lray.y)));
+                for (fray = fstp; fray < 1.0; fray += fstp) {
+                    xcur = (FLOAT)x + fray * lray.x / cell;
+                    ycur = (FLOAT)y + fray * lray.y / cell;
+                    zcur = HGT(x, y) + fray * lray.z;
+                    if ((zcur >= fbak->hmax) || (xcur < 0.0) || (xcur > (FLOAT)ndim)
+                    ||  (ycur < 0.0) || (ycur > (FLOAT)ndim)) break;
+                    xpos = min(ndim - 1, tr(xcur));
+                    ypos = min(ndim - 1, tr(ycur));
+                    xcur -= (FLOAT)xpos;
+                    ycur -= (FLOAT)ypos;
+                    fhgt = (HGT(xpos, ypos    ) * (1.0 - xcur) + HGT(xpos + 1, ypos    ) * xcur) * (1.0 - ycur)
+                         + (HGT(xpos, ypos + 1) * (1.0 - xcur) + HGT(xpos + 1, ypos + 1) * xcur) * ycur;
+                    if (fhgt > zcur) {
+                        fdif = 0.0;
+                        break;
+                    }
+                }
+            }
+            fdif = (DEF_BAMB + max(0.0, fdif)) * (FLOAT)fbak->aocc[x + y * sinc];
+            fbak->lpix[x + y * sinc] = min(255, tr(fdif + 0.5));
+        }
+    #undef HGT
+}
+
+
+
+/**
+  @brief FillVBO
+  builds the surface of a landscape VBO upon a heightmap: computes vertices,
+  colors, normals and texture coords (see FillRows()), and adds the objects.
+  Does not touch OpenGL; UploadVBO() shall be called on the result before
+  drawing.
+  The heightmap has a border 1 point wide around the points of the VBO, so
+  the normals and the colors at the edges do not need to know the neighbours.
+
+  @param retn - VBO created by MakeVBO(); retn->ndim and retn->seed shall be already set.
+  @param farr - (ndim + 3) x (ndim + 3) heightmap; shall be writable.
+  @param fmin - heightmap value that becomes the bottom of the height range.
+  @param fmax - heightmap value that becomes the top of the height range;
+                higher values are clamped to it.
+  @param grid - width and height of the elementary square.
+  @param fhei - height range.
+  @param wlvl - "sea level" within the range.
+  @param lscp - array of FHEIs for mapping colors to heights.
+  @param ihgt - height texture that farr was read from, which makes the VBO
+                displaced; farr holds heights then, fmin and fmax are not
+                looked at. 0 if farr holds raw values.
+**/
+void FillVBO(FVBO *retn, FLOAT *farr, FLOAT fmin, FLOAT fmax, FLOAT grid, FLOAT fhei, FLOAT wlvl, FHEI *lscp, UINT ihgt) {
+    LONG i, x, ndim = retn->ndim, sinc = ndim + 3, rect[4];
+    LONGLONG tbgn = BenchTick(-1, 0);
+    FVBO *fobj;
+
+    fmax = fhei / (fmax - fmin);
+    for (x = sinc * sinc - 1; !ihgt && (x >= 0); x--) {
+        farr[x] = (farr[x] - fmin) * fmax - 0.5 * fhei;
+        if (farr[x] < wlvl) farr[x] = wlvl;
+        else if (farr[x] > 0.5 * fhei) farr[x] = 0.5 * fhei;
+    }
+    for (i = 0; lscp[i].fhei > 0.0; i++);
+    if (ihgt || ((retn->flgs & USE_DISP) && (i < DEF_NCLR))) {
+        if (ihgt)
+            retn->ihgt = ihgt;
+        else {
+            retn->hpix = (FLOAT*)PoolAlloc(sinc * sinc * sizeof(FLOAT), FALSE);
+            memcpy(retn->hpix, farr, sinc * sinc * sizeof(FLOAT));
+        }
+        retn->dscp = (FHEI*)malloc((i + 1) * sizeof(FHEI));
+        for (fmax = x = 0; x < i; x++)
+            fmax += lscp[x].fhei;
+        for (fmin = x = 0; x <= i; x++) {
+            retn->dscp[x].fclr = lscp[x].fclr;
+            retn->dscp[x].fhei = wlvl + (fmin += lscp[x].fhei) / fmax * (0.5 * fhei - wlvl);
+        }
+        retn->nclr = i;
+    }
+    rect[0] = rect[1] = 0;
+    rect[2] = rect[3] = ndim;
+    retn->bmin.x = retn->bmin.y = retn->wmax.x = retn->wmax.y = -0.5 * grid * (FLOAT)ndim;
+    retn->bmax.x = retn->bmax.y = retn->wmin.x = retn->wmin.y =  0.5 * grid * (FLOAT)ndim;
+    retn->bmin.z = retn->bmax.z = farr[1 + sinc];
+    retn->wmin.z = retn->wmax.z = wlvl;
+    retn->hgts = (FLOAT*)PoolAlloc((ndim + 1) * (ndim + 1) * sizeof(FLOAT), FALSE);
+    FillRows(retn, farr, rect, grid, fhei, wlvl, lscp);
+    retn->qtre = QuadTree(retn->hgts, ndim);
+    if (retn->flgs & USE_BAKE)
+        retn->aocc = MakeOcclusion(retn->hgts, NULL, ndim, grid, 0, ndim + 1);
+
+    retn->trnd = 64;
+    retn->tsed = retn->seed;
+    if ((retn->flgs & USE_PACK) && !retn->hpix && !retn->ihgt)
+        PackVBO(retn, 0.5 * max((FLOAT)ndim * grid, fhei));
+
+    retn->wlvl = wlvl;
+    retn->grid = (FLOAT)ndim * grid;
+    LandIndices(retn, retn->hgts);
+    for (fobj = retn, i = 1; i < DEF_NLOD; i++)
+        if ((fobj->next = LodVBO(retn, i)))
+            fobj = fobj->next;
+    tbgn = BenchTick(BEN_SURF, tbgn);
+    fobj->next = ObjectVBO(retn, DEF_NOBJ);
+    BenchTick(BEN_OBJS, tbgn);
+}
+
+
+
+/**
+  @brief LandscapeVBO
+  generates a landscape VBO that wraps around, i.e. the whole world of a
+  single chunk. Its heights are stretched to fill the entire range.
+
+  @param ndim - map size; a power of 2, as LodVBO() and GridVBO() need.
+  @param flgs - display flags (see FVBO::flgs).
+  @param seed - random number generator seed.
+  @param grid - width and height of the elementary square.
+  @param fhei - height range.
+  @param wlvl - "sea level" within the range.
+  @param lscp - array of FHEIs for mapping colors to heights.
+
+  @return FVBO on success, NULL on failure (ndim < 2 or not a power of 2, lscp == NULL, grid <= 0).
+**/
+FVBO *LandscapeVBO(UINT ndim, UINT flgs, UINT seed, FLOAT grid, FLOAT fhei, FLOAT wlvl, FHEI *lscp) {
+    if ((ndim < 2) || (ndim & (ndim - 1)) || !lscp || grid <= 0.0) return NULL;
+    if (!glGenBuffersARB) flgs &= ~USE_ARBV;
+    if (!ishd) flgs &= ~USE_INST;
+    if (!dshd) flgs &= ~USE_DISP;
+    if (!blgt) flgs &= ~USE_BAKE;
+    wlvl = max(wlvl, -0.5 * (fhei = fabs(fhei)));
+
+    FVBO *retn = MakeVBO((ndim + 1) * (ndim + ndim + 2));
+    LONG x, y, xpos, ypos, sinc = ndim + 3;
+    LONGLONG tbgn = BenchTick(-1, 0);
+    FLOAT fmin, fmax, *farr, *fpad;
+
+    farr = SourceHeightmap(flgs, ndim, seed, DEF_DMPF, 0, 0, ndim, 1);
+    tbgn = BenchTick(BEN_HMAP, tbgn);
+    BlurHeightmap(farr, ndim, DEF_BLUR);
+    BenchTick(BEN_BLUR, tbgn);
+    fmin = fmax = farr[0];
+    for (x = (ndim + 1) * (ndim + 1) - 1; x >= 0; x--) {
+        fmin = min(fmin, farr[x]);
+        fmax = max(fmax, farr[x]);
+    }
+    fpad = (FLOAT*)PoolAlloc(sinc * sinc * sizeof(FLOAT), FALSE);
+    for (y = -1; y <= (LONG)ndim + 1; y++) {
+        ypos = (y < 0)? y + ndim : (y > ndim)? y - ndim : y;
+        for (x = -1; x <= (LONG)ndim + 1; x++) {
+            xpos = (x < 0)? x + ndim : (x > ndim)? x - ndim : x;
+            fpad[(x + 1) + (y + 1) * sinc] = farr[xpos + ypos * (ndim + 1)];
+        }
+    }
+    PoolFree(farr);
+
+    retn->seed = seed;
+    retn->flgs = flgs;
+    retn->ndim = ndim;
+    FillVBO(retn, fpad, fmin, fmax, grid, fhei, wlvl, lscp, 0);
+    PoolFree(fpad);
+    return retn;
+}
+
+
+
+/**
+  @brief ChunkVBO
+  generates the landscape VBO of a chunk that belongs to a bigger world.
+  The heightmap is taken from the world-wide one (see SourceHeightmap()), with a
+  border wide enough for the blur not to see the edges of the region, unless
+  the GPU has already computed the heights (see TextureChunk()).
+
+  @param wmap - world that the chunk belongs to.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+  @param hgts - (cdim + 3) x (cdim + 3) heights made by TextureChunk(), which
+                are overwritten; NULL to make them on the CPU.
+  @param ihgt - height texture that hgts were read from; 0 if hgts == NULL.
+
+  @return FVBO on success, NULL on failure (wmap == NULL).
+**/
+FVBO *ChunkVBO(FMAP *wmap, LONG xpos, LONG ypos, FLOAT *hgts, UINT ihgt) {
+    if (!wmap) return NULL;
+
+    LONG x, y, cdim = wmap->cdim, sinc = cdim + 3, bord = tr(3.0 * DEF_BLUR) + 1, size = cdim + 2 * bord;
+    FVBO *retn = MakeVBO((cdim + 1) * (cdim + cdim + 2));
+    LONGLONG tbgn = BenchTick(-1, 0);
+    FLOAT *farr, *fpad = hgts;
+
+    if (!hgts) {
+        farr = SourceHeightmap(wmap->flgs, wmap->wdim, wmap->seed, DEF_DMPF, xpos * cdim - bord, ypos * cdim - bord, size, 1);
+        tbgn = BenchTick(BEN_HMAP, tbgn);
+        BlurHeightmap(farr, size, DEF_BLUR);
+        BenchTick(BEN_BLUR, tbgn);
+        fpad = (FLOAT*)PoolAlloc(sinc * sinc * sizeof(FLOAT), FALSE);
+        for (y = 0; y < sinc; y++)
+            for (x = 0; x < sinc; x++)
+                fpad[x + y * sinc] = farr[(x + bord - 1) + (y + bord - 1) * (size + 1)];
+        PoolFree(farr);
+    }
+    retn->seed = HashRand(wmap->seed, xpos, ypos, 0);
+    retn->flgs = wmap->flgs;
+    retn->ndim = cdim;
+    FillVBO(retn, fpad, wmap->hmin, wmap->hmax, wmap->cell, wmap->fhei, wmap->wlvl, wmap->lscp, ihgt);
+    if (!hgts) PoolFree(fpad);
+    return retn;
+}
+
+
+
+/**
+  @brief GpuChunk
+  tells whether the heights of the chunks of a world are computed on the GPU
+  by TextureChunk(): they shall be displaced diamond-square ones, of a world
+  bigger than a chunk, since a single chunk is stretched over the range of
+  its own heights, which would have to be known first. The blur kernel shall
+  also fit into the DEF_HBLR weights of hshd, or the blur would be cut short.
+
+  @param wmap - the world.
+
+  @return TRUE if the heights come from the GPU, FALSE otherwise.
+**/
+BOOL GpuChunk(FMAP *wmap) {
+    LONG i;
+
+    for (i = 0; wmap->lscp[i].fhei > 0.0; i++);
+    return hshd && (wmap->flgs & USE_DISP) && !(wmap->flgs & USE_FBMN) && (wmap->wdim > wmap->cdim)
+        && (i < DEF_NCLR) && (tr(3.0 * fabs(DEF_BLUR)) < DEF_HBLR);
+}
+
+
+
+/**
+  @brief TextureChunk
+  computes the height texture of a chunk on the GPU (see TextureHeightmap())
+  and reads the heights back, for ChunkVBO() to build the rest of the chunk
+  upon: collision, objects, indices and bounds still need them on the CPU,
+  but neither the diamond-square steps nor the blur are done there.
+  Shall be called from the thread that owns the OpenGL context.
+
+  @param wmap - world that the chunk belongs to; GpuChunk() shall be TRUE.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+  @param ihgt - where to put the ID of the height texture.
+  @param size - where to add the cost of the passes and the read; may be NULL.
+
+  @return (cdim + 3) x (cdim + 3) heights, to be freed by PoolFree().
+**/
+FLOAT *TextureChunk(FMAP *wmap, LONG xpos, LONG ypos, UINT *ihgt, UINT *size) {
+    LONG cdim = wmap->cdim, sinc = cdim + 3, bord = tr(3.0 * DEF_BLUR) + 1;
+    FHGN fhgn = {.wdim = wmap->wdim, .seed = wmap->seed, .xbgn = xpos * cdim - bord, .ybgn = ypos * cdim - bord,
+                 .size = cdim + 2 * bord, .hofs = bord - 1, .fmin = wmap->hmin, .fscl = wmap->fhei / (wmap->hmax - wmap->hmin),
+                 .fhei = wmap->fhei, .wlvl = wmap->wlvl};
+    LONGLONG tbgn = BenchTick(-1, 0);
+    FLOAT *retn = (FLOAT*)PoolAlloc(sinc * sinc * sizeof(FLOAT), FALSE);
+
+    *ihgt = TextureHeightmap(&fhgn, cdim, size);
+    glBindTexture(GL_TEXTURE_2D, *ihgt);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, retn);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (size) *size += sinc * sinc * sizeof(FLOAT);
+    BenchTick(BEN_HMAP, tbgn);
+    return retn;
+}
+
+
+
+/**
+  @brief TileHead
+  makes the header that the tile cache file of a chunk shall begin with,
+  along with the name of the file.
+
+  @param fthd - header to be filled; its FTHD::nvbo is left zero.
+  @param file - buffer of MAX_PATH chars to receive the file name.
+  @param wmap - world that the chunk belongs to.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+**/
+void TileHead(FTHD *fthd, LPSTR file, FMAP *wmap, LONG xpos, LONG ypos) {
+    UINT x, fkey, hkey;
+
+    memset(fthd, 0, sizeof(FTHD));
+    for (x = 0; wmap->lscp[x].fhei > 0.0; x++) {
+        memcpy(&hkey, &wmap->lscp[x].fhei, sizeof(UINT));
+        fthd->lkey = HashRand(fthd->lkey ^ hkey, wmap->lscp[x].fclr.RGBA, x, DEF_KTIL);
+    }
+    fthd->lkey = HashRand(fthd->lkey, wmap->lscp[x].fclr.RGBA, x, DEF_KTIL);
+    fthd->tver = DEF_TVER;
+    fthd->tsiz = sizeof(FVBO);
+    fthd->flgs = wmap->flgs & (USE_PACK | USE_DISP | USE_FBMN);
+    fthd->seed = wmap->seed;
+    fthd->wdim = wmap->wdim;
+    fthd->cdim = wmap->cdim;
+    fthd->cell = wmap->cell;
+    fthd->fhei = wmap->fhei;
+    fthd->wlvl = wmap->wlvl;
+    for (fkey = x = 0; x < sizeof(FTHD) / sizeof(UINT); x++)
+        fkey = HashRand(fkey, ((UINT*)fthd)[x], x, DEF_KTIL);
+    fthd->xpos = xpos;
+    fthd->ypos = ypos;
+    sprintf(file, "%s\\%08X_%u_%u.til", DEF_TDIR, fkey, (UINT)xpos, (UINT)ypos);
+}
+
+
+
+/**
+  @brief SaveTile
+  stores a freshly generated chunk to the tile cache. Only packed chunks are
+  stored, since LoadTile() maps nothing but the packed vertices and indices;
+  benchmarks store nothing, not to time the disk instead of the generation.
+  The file is written under a temporary name and renamed when complete, so
+  other threads never see it half-written.
+
+  @param wmap - world that the chunk belongs to.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+  @param vobj - the chunk, not uploaded yet.
+**/
+void SaveTile(FMAP *wmap, LONG xpos, LONG ypos, FVBO *vobj) {
+    static BYTE zero[DEF_TALN] = {};
+    CHAR file[MAX_PATH], temp[MAX_PATH];
+    FVBO *fobj;
+    FTHD fthd;
+    FILE *filp;
+    BOOL retn;
+
+    if (bout || !vobj) return;
+    for (fobj = vobj; fobj; fobj = fobj->next)
+        if (!fobj->nlod && (!fobj->vtxs || fobj->hpix)) return;
+
+    TileHead(&fthd, file, wmap, xpos, ypos);
+    for (fobj = vobj; fobj; fobj = fobj->next)
+        fthd.nvbo++;
+    sprintf(temp, "%s.%08X", file, (UINT)GetCurrentThreadId());
+    CreateDirectory(DEF_TDIR, NULL);
+    if (!(filp = fopen(temp, "wb"))) return;
+
+    #define TIL_BLOB(d, n) (fwrite(zero, 1, (DEF_TALN - ftell(filp) % DEF_TALN) % DEF_TALN, filp), fwrite(d, 1, n, filp))
+    fwrite(&fthd, sizeof(FTHD), 1, filp);
+    for (fobj = vobj; fobj; fobj = fobj->next) {
+        TIL_BLOB(fobj, sizeof(FVBO));
+        if (!fobj->nlod)
+            TIL_BLOB(fobj->vtxs, fobj->ndot * sizeof(FVTX));
+        TIL_BLOB(fobj->indx, fobj->nind * ((fobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT)));
+        if (!fobj->nlod && fobj->hgts)
+            TIL_BLOB(fobj->hgts, (fobj->ndim + 1) * (fobj->ndim + 1) * sizeof(FLOAT));
+        if (fobj->ocel)
+            TIL_BLOB(fobj->ocel, fobj->ndot / 15 * sizeof(UINT));
+    }
+    #undef TIL_BLOB
+    retn = !ferror(filp);
+    fclose(filp);
+    if (!retn || !MoveFileEx(temp, file, MOVEFILE_REPLACE_EXISTING))
+        DeleteFile(temp);
+}
+
+
+
+/**
+  @brief LoadTile
+  maps the tile cache file of a chunk into memory. The VBOs are copied out
+  of the file, but their packed vertices and indices stay in the view, to be
+  passed to OpenGL from there as they are; the facet textures are not kept
+  there at all, UploadVBO() takes them from FacetTex(). The view is copy-on-write,
+  so that EditMap() may change the vertices in place.
+
+  @param wmap - world that the chunk belongs to.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+
+  @return FVBO on success, NULL if the chunk is not in the cache
+          (or the file belongs to a different version of the program).
+**/
+FVBO *LoadTile(FMAP *wmap, LONG xpos, LONG ypos) {
+    CHAR file[MAX_PATH];
+    FVBO *retn = NULL, **fptr = &retn, *fobj;
+    HANDLE hfil, hmap;
+    DWORD fpos, size;
+    BYTE *view;
+    FTHD fthd;
+    UINT i;
+
+    if (bout || !(wmap->flgs & USE_PACK) || (wmap->flgs & USE_DISP)) return NULL;
+
+    TileHead(&fthd, file, wmap, xpos, ypos);
+    hfil = CreateFile(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hfil == INVALID_HANDLE_VALUE) return NULL;
+    size = GetFileSize(hfil, NULL);
+    hmap = (size > sizeof(FTHD))? CreateFileMapping(hfil, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+    CloseHandle(hfil);
+    if (!hmap) return NULL;
+    view = (BYTE*)MapViewOfFile(hmap, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(hmap);
+    if (!view) return NULL;
+
+    fthd.nvbo = ((FTHD*)view)->nvbo;
+    if (memcmp(view, &fthd, sizeof(FTHD))) {
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+    #define TIL_ALGN(o) (((o) + DEF_TALN - 1) & ~(DEF_TALN - 1))
+    for (fpos = sizeof(FTHD), i = 0; i < fthd.nvbo; i++) {
+        fobj = (FVBO*)(view + (fpos = TIL_ALGN(fpos)));
+        if ((fpos += sizeof(FVBO)) > size) break;
+        *fptr = (FVBO*)PoolAlloc(sizeof(FVBO), FALSE);
+        **fptr = *fobj;
+        fobj = *fptr;
+        fptr = &fobj->next;
+        *fptr = NULL;
+
+        fobj->iind = fobj->ivec = fobj->inrm = fobj->iclr = fobj->itex = fobj->ivtx = 0;
+        fobj->ntex = fobj->ihgt = fobj->ilgt = 0;
+        fobj->vect = fobj->norm = NULL;
+        fobj->clrs = NULL;
+        fobj->texc = NULL;
+        fobj->hpix = NULL;
+        fobj->dscp = NULL;
+        fobj->view = NULL;
+        fobj->vtxs = NULL;
+        if (!fobj->nlod) {
+            fobj->vtxs = (FVTX*)(view + (fpos = TIL_ALGN(fpos)));
+            fpos += fobj->ndot * sizeof(FVTX);
+        }
+        fobj->indx = (FTRI*)(view + (fpos = TIL_ALGN(fpos)));
+        fpos += fobj->nind * ((fobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT));
+        if (!fobj->nlod && fobj->hgts) {
+            fobj->hgts = (FLOAT*)(view + (fpos = TIL_ALGN(fpos)));
+            fpos += (fobj->ndim + 1) * (fobj->ndim + 1) * sizeof(FLOAT);
+        }
+        else
+            fobj->hgts = NULL;
+        if (fobj->ocel) {
+            fobj->ocel = (UINT*)(view + (fpos = TIL_ALGN(fpos)));
+            fpos += fobj->ndot / 15 * sizeof(UINT);
+        }
+        fobj->qtre = NULL;
+        fobj->aocc = NULL;
+        if (fpos > size) break;
+    }
+    #undef TIL_ALGN
+    if (i < fthd.nvbo) {
+        for (; retn; retn = fobj) {
+            fobj = retn->next;
+            PoolFree(retn);
+        }
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+    for (fobj = retn; fobj; fobj = fobj->next)
+        if (!fobj->nlod) {
+            if (fobj->ocel)
+                fobj->ocel = (UINT*)memcpy(PoolAlloc(fobj->ndot / 15 * sizeof(UINT), FALSE),
+                                           fobj->ocel, fobj->ndot / 15 * sizeof(UINT));
+            if (fobj->hgts) {
+                fobj->hgts = (FLOAT*)memcpy(PoolAlloc((fobj->ndim + 1) * (fobj->ndim + 1) * sizeof(FLOAT), FALSE),
+                                            fobj->hgts, (fobj->ndim + 1) * (fobj->ndim + 1) * sizeof(FLOAT));
+                fobj->qtre = QuadTree(fobj->hgts, fobj->ndim);
+                if (wmap->flgs & USE_BAKE)
+                    fobj->aocc = MakeOcclusion(fobj->hgts, NULL, fobj->ndim, wmap->cell, 0, fobj->ndim + 1);
+            }
+        }
+    retn->view = view;
+    return retn;
+}
+
+
+
+/**
+  @brief GenChunk
+  generates a chunk without uploading it, which makes it safe to be called
+  from a worker thread. The chunk is taken from the tile cache if it is
+  there, and stored to the cache otherwise.
+
+  @param wmap - world that the chunk belongs to.
+  @param xpos - horizontal index of the chunk, [0; wdim / cdim).
+  @param ypos - vertical index of the chunk, [0; wdim / cdim).
+  @param hgts - heights made by TextureChunk(); NULL if there are none.
+  @param ihgt - height texture that hgts were read from.
+
+  @return FVBO on success, NULL on failure.
+**/
+FVBO *GenChunk(FMAP *wmap, LONG xpos, LONG ypos, FLOAT *hgts, UINT ihgt) {
+    FVBO *retn;
+
+    if (!hgts && (retn = LoadTile(wmap, xpos, ypos)))
+        return retn;
+    if (wmap->wdim == wmap->cdim)
+        retn = LandscapeVBO(wmap->cdim, wmap->flgs, wmap->seed, wmap->cell, wmap->fhei, wmap->wlvl, wmap->lscp);
+    else
+        retn = ChunkVBO(wmap, xpos, ypos, hgts, ihgt);
+    SaveTile(wmap, xpos, ypos, retn);
+    return retn;
+}
+
+
+
+/**
+  @brief WorkThread
+  the worker thread: takes jobs from the queue, generates their chunks and
+  passes them on to the done list, until told to quit.
+
+  @param data - unused.
+
+  @return 0.
+**/
+DWORD WINAPI WorkThread(LPVOID data) {
+    FJOB *fjob;
+
+    while (TRUE) {
+        WaitForSingleObject(jsem, INFINITE);
+        if (jstp) return 0;
+
+        EnterCriticalSection(&jcrs);
+        if ((fjob = jnew) && !(jnew = fjob->next))
+            jtal = NULL;
+        LeaveCriticalSection(&jcrs);
+        if (!fjob) continue;
+
+        fjob->vobj = GenChunk(fjob->wmap, fjob->xpos, fjob->ypos, fjob->hgts, fjob->ihgt);
+        PoolFree(fjob->hgts);
+        fjob->hgts = NULL;
+
+        EnterCriticalSection(&jcrs);
+        fjob->next = jend;
+        jend = fjob;
+        LeaveCriticalSection(&jcrs);
+    }
+}
+
+
+
+/**
+  @brief StartWorkers
+  starts a worker thread for each CPU but one (one at least, DEF_NTHR at most).
+  If no thread can be started, chunks are generated synchronously.
+**/
+void StartWorkers() {
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    InitializeCriticalSection(&jcrs);
+    jsem = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+    jstp = FALSE;
+    for (nthr = 0; jsem && (nthr < min(DEF_NTHR, max(1, (LONG)info.dwNumberOfProcessors - 1))); nthr++)
+        if (!(thrd[nthr] = CreateThread(NULL, 0, WorkThread, NULL, 0, NULL)))
+            break;
+}
+
+
+
+/**
+  @brief StopWorkers
+  makes all worker threads quit and waits for them.
+  Shall be called when no worlds are left, so that no jobs remain.
+**/
+void StopWorkers() {
+    UINT i;
+
+    jstp = TRUE;
+    if (nthr) {
+        ReleaseSemaphore(jsem, nthr, NULL);
+        WaitForMultipleObjects(nthr, thrd, TRUE, INFINITE);
+        for (i = 0; i < nthr; i++)
+            CloseHandle(thrd[i]);
+    }
+    if (jsem) CloseHandle(jsem);
+    DeleteCriticalSection(&jcrs);
+    nthr = 0;
+}
+
+
+
+/**
+  @brief BatchObjects
+  copies the objects of a freshly uploaded chunk into the shared buffers of
+  the world, to the slot of the chunk in the cache, so that the objects of
+  all chunks are drawn at once by DrawObjects(). The slot is written through
+  BufferMap(). The own buffers of the objects are deleted then. Does nothing
+  if the objects are not packed or there is no oshd, which leaves them to be
+  drawn on their own.
+  Shall be called from the thread that owns OpenGL, before ReleaseVBO().
+
+  @param wmap - world that the chunk belongs to.
+  @param fchk - cache slot of the chunk.
+  @param vobj - the chunk; it may not be in the slot yet.
+
+  @return number of bytes uploaded.
+**/
+UINT BatchObjects(FMAP *wmap, FCHK *fchk, FVBO *vobj) {
+    UINT i, slot = fchk - wmap->chnk, nvtx = 3 * 5 * DEF_NOBJ, nind = 3 * 3 * 4 * DEF_NOBJ;
+    FVBO *fobj = NULL;
+    BOOL mapd;
+    FVTX *vtxs;
+    UINT *indx;
+
+    fchk->nobj = 0;
+    if (vobj)
+        for (fobj = vobj->next; fobj && fobj->nlod; fobj = fobj->next);
+    if (!oshd || !(wmap->flgs & USE_ARBV) || !fobj || !fobj->vtxs || (fobj->ndot > nvtx) || (fobj->nind > nind))
+        return 0;
+
+    if (!wmap->ivtx) {
+        vtxs = (FVTX*)PoolAlloc(wmap->nchk * nvtx * sizeof(FVTX), TRUE);
+        glGenBuffersARB(1, &wmap->ivtx);
+        glBindBufferARB(GL_ARRAY_BUFFER_ARB, wmap->ivtx);
+        glBufferDataARB(GL_ARRAY_BUFFER_ARB, wmap->nchk * nvtx * sizeof(FVTX), vtxs, GL_STATIC_DRAW_ARB);
+        glGenBuffersARB(1, &wmap->iind);
+        glBindBufferARB(GL_INDEX_BUFFER_ARB, wmap->iind);
+        glBufferDataARB(GL_INDEX_BUFFER_ARB, wmap->nchk * nind * sizeof(UINT), vtxs, GL_STATIC_DRAW_ARB);
+        PoolFree(vtxs);
+    }
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, wmap->ivtx);
+    mapd = TRUE;
+    do {
+        vtxs = (FVTX*)BufferMap(GL_ARRAY_BUFFER_ARB, slot * nvtx * sizeof(FVTX), fobj->ndot * sizeof(FVTX), &mapd);
+        for (i = 0; i < fobj->ndot; i++) {
+            vtxs[i] = fobj->vtxs[i];
+            vtxs[i].w = slot;
+        }
+    } while (!BufferDone(GL_ARRAY_BUFFER_ARB, slot * nvtx * sizeof(FVTX), fobj->ndot * sizeof(FVTX), vtxs, &mapd));
+
+    glBindBufferARB(GL_INDEX_BUFFER_ARB, wmap->iind);
+    mapd = TRUE;
+    do {
+        indx = (UINT*)BufferMap(GL_INDEX_BUFFER_ARB, slot * nind * sizeof(UINT), nind * sizeof(UINT), &mapd);
+        for (i = 0; i < nind; i++)
+            indx[i] = slot * nvtx + ((i >= fobj->nind)? 0 : (fobj->ityp == GL_UNSIGNED_SHORT)? ((WORD*)fobj->indx)[i] : ((UINT*)fobj->indx)[i]);
+    } while (!BufferDone(GL_INDEX_BUFFER_ARB, slot * nind * sizeof(UINT), nind * sizeof(UINT), indx, &mapd));
+    glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+    glDelBuffersARB(1, &fobj->iind);
+    glDelBuffersARB(1, &fobj->ivtx);
+    fobj->iind = fobj->ivtx = 0;
+    fchk->nobj = nind;
+    fchk->nind = fobj->nind;
+    return fobj->ndot * sizeof(FVTX) + nind * sizeof(UINT);
+}
+
+
+
+/**
+  @brief PushJob
+  passes a job on to the worker threads.
+
+  @param fjob - the job.
+**/
+void PushJob(FJOB *fjob) {
+    EnterCriticalSection(&jcrs);
+    if (jtal)
+        jtal->next = fjob;
+    else
+        jnew = fjob;
+    jtal = fjob;
+    LeaveCriticalSection(&jcrs);
+    ReleaseSemaphore(jsem, 1, NULL);
+}
+
+
+
+/**
+  @brief QueueChunk
+  queues the chunk that a cache slot is assigned to for generation; in case
+  there are no worker threads, generates it immediately. A chunk whose
+  heights come from the GPU (see GpuChunk()) first waits in jupl for
+  CollectChunks() to compute them.
+
+  @param wmap - world that the chunk belongs to.
+  @param fchk - cache slot, with the chunk position already set.
+**/
+void QueueChunk(FMAP *wmap, FCHK *fchk) {
+    FJOB **fptr, *fjob;
+    LONGLONG tbgn;
+    FLOAT *hgts;
+    UINT ihgt = 0;
+
+    if (!nthr) {
+        hgts = (GpuChunk(wmap))? TextureChunk(wmap, fchk->xpos, fchk->ypos, &ihgt, NULL) : NULL;
+        fchk->vobj = GenChunk(wmap, fchk->xpos, fchk->ypos, hgts, ihgt);
+        PoolFree(hgts);
+        tbgn = BenchTick(-1, 0);
+        UploadVBO(fchk->vobj);
+        BatchObjects(wmap, fchk, fchk->vobj);
+        BenchTick(BEN_UPLD, tbgn);
+        if (wmap->flgs & USE_ARBV) ReleaseVBO(fchk->vobj);
+        return;
+    }
+    fjob = (FJOB*)calloc(1, sizeof(FJOB));
+    fjob->wmap = wmap;
+    fjob->fchk = fchk;
+    fjob->xpos = fchk->xpos;
+    fjob->ypos = fchk->ypos;
+    fchk->load = 1;
+    wmap->njob++;
+    if (!(fjob->hgpu = GpuChunk(wmap))) {
+        PushJob(fjob);
+        return;
+    }
+    for (fptr = &jupl; *fptr; fptr = &(*fptr)->next);
+    *fptr = fjob;
+}
+
+
+
+/**
+  @brief CollectChunks
+  uploads the chunks that the worker threads have finished, and puts them
+  into their cache slots; computes the heights of the chunks that wait for
+  the GPU, and passes them on to the workers. No more than DEF_UPLB bytes
+  are uploaded or computed per call, unless a single chunk takes more; the
+  rest wait for the next frame. An uploaded chunk is put into its slot only
+  when the fence that follows the upload is passed, so drawing it never
+  stalls on a transfer in flight. Chunks of a world drawn through ARB VBOs
+  lose their CPU copies (see ReleaseVBO()). Shall be called from the thread
+  that owns OpenGL.
+**/
+void CollectChunks() {
+    FJOB **fptr, *fjob, *fnxt;
+    UINT size = 0;
+
+    if (!nthr) return;
+
+    EnterCriticalSection(&jcrs);
+    fjob = jend;
+    jend = NULL;
+    LeaveCriticalSection(&jcrs);
+    for (fptr = &jupl; *fptr; fptr = &(*fptr)->next);
+    *fptr = fjob;
+
+    for (fptr = &jupl; (fjob = *fptr);) {
+        if (fjob->hgpu) {
+            if (size >= DEF_UPLB) break;
+            fjob->hgts = TextureChunk(fjob->wmap, fjob->xpos, fjob->ypos, &fjob->ihgt, &size);
+            fjob->hgpu = FALSE;
+            *fptr = fjob->next;
+            fjob->next = NULL;
+            PushJob(fjob);
+            continue;
+        }
+        if (!fjob->upld) {
+            if (size >= DEF_UPLB) break;
+            size += UploadVBO(fjob->vobj);
+            size += BatchObjects(fjob->wmap, fjob->fchk, fjob->vobj);
+            if (fjob->wmap->flgs & USE_ARBV) ReleaseVBO(fjob->vobj);
+            fjob->sync = (glFenceSync)? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : NULL;
+            fjob->upld = 1;
+        }
+        if (fjob->sync && (glClientWaitSync(fjob->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)) {
+            fptr = &fjob->next;
+            continue;
+        }
+        if (fjob->sync) glDeleteSync(fjob->sync);
+        fnxt = fjob->next;
+        fjob->fchk->vobj = fjob->vobj;
+        fjob->fchk->load = 0;
+        fjob->wmap->njob--;
+        free(fjob);
+        *fptr = fnxt;
+    }
+}
+
+
+
+/**
+  @brief CancelJobs
+  removes the jobs of a world that no worker has taken yet, then waits for
+  the rest to be done.
+
+  @param wmap - the world.
+**/
+void CancelJobs(FMAP *wmap) {
+    FJOB **fptr, *fjob;
+
+    if (!nthr) return;
+    EnterCriticalSection(&jcrs);
+    for (jtal = NULL, fptr = &jnew; (fjob = *fptr);)
+        if (fjob->wmap == wmap) {
+            *fptr = fjob->next;
+            PoolFree(fjob->hgts);
+            glDeleteTextures(1, &fjob->ihgt);
+            fjob->fchk->load = 0;
+            wmap->njob--;
+            free(fjob);
+        }
+        else {
+            jtal = fjob;
+            fptr = &fjob->next;
+        }
+    LeaveCriticalSection(&jcrs);
+
+    while (wmap->njob) {
+        Sleep(1);
+        CollectChunks();
+    }
+}
+
+
+
+/**
+  @brief MakeMap
+  creates an empty world; its chunks are generated later by StreamMap().
+  The range of raw heights of fBm noise is the sum of the amplitudes of its
+  octaves (as in RegionNoise()), since no octave exceeds 1 (see GradNoise());
+  octaves coarser than a chunk peak anywhere inside it, so sampling cannot
+  bound them. The diamond-square range is taken from the chunk corners, the
+  only points coarser levels reach, widened by all that the finer levels may
+  add. FillVBO() clamps whatever still gets out.
+
+  @param wchk - world size in chunks; any for fBm noise (USE_FBMN), rounded
+                up to a power of 2 for diamond-square.
+  @param cpwr - log2 of the chunk size.
+  @param flgs - display flags (see FVBO::flgs).
+  @param seed - random number generator seed.
+  @param grid - width and height of the elementary square.
+  @param fhei - height range.
+  @param wlvl - "sea level" within the range.
+  @param lscp - array of FHEIs for mapping colors to heights.
+  @param file - file into which the world shall be serialized.
+
+  @return FMAP on success, NULL on failure (wchk == 0, cpwr == 0, lscp == NULL, grid <= 0).
+**/
+FMAP *MakeMap(UINT wchk, UINT cpwr, UINT flgs, UINT seed, FLOAT grid, FLOAT fhei, FLOAT wlvl, FHEI *lscp, LPSTR file) {
+    if (!wchk || !cpwr || !lscp || grid <= 0.0) return NULL;
+    if (!glGenBuffersARB) flgs &= ~USE_ARBV;
+    if (!ishd) flgs &= ~USE_INST;
+    if (!dshd) flgs &= ~USE_DISP;
+    if (!blgt) flgs &= ~USE_BAKE;
+
+    FMAP *retn = (FMAP*)calloc(1, sizeof(FMAP));
+    FLOAT hdef, fsum, *farr;
+    LONG x;
+
+    for (x = 0; lscp[x].fhei > 0.0; x++);
+    retn->lscp = (FHEI*)malloc((x + 1) * sizeof(FHEI));
+    memcpy(retn->lscp, lscp, (x + 1) * sizeof(FHEI));
+
+    retn->flgs = flgs;
+    retn->seed = seed;
+    if (!(flgs & USE_FBMN))
+        for (x = wchk, wchk = 1; wchk < x; wchk <<= 1);
+    retn->cdim = pow(2.0, cpwr);
+    retn->wdim = wchk * retn->cdim;
+    retn->nchk = (retn->wdim == retn->cdim)? 1 : DEF_NCHK;
+    retn->chnk = (FCHK*)calloc(retn->nchk, sizeof(FCHK));
+    retn->cell = grid;
+    retn->grid = (FLOAT)retn->wdim * grid;
+    retn->wlvl = max(wlvl, -0.5 * (retn->fhei = fabs(fhei)));
+
+    if ((retn->wdim > retn->cdim) && (flgs & USE_FBMN)) {
+        for (fsum = 0.0, hdef = 1.0, x = 0; (x < DEF_NOCT) && (!x || ((DEF_NBAS << x) <= (retn->wdim >> 1)));
+             x++, hdef *= pow(2.0, -fabs(DEF_DMPF)))
+            fsum += hdef;
+        retn->hmin = -fsum;
+        retn->hmax =  fsum;
+    }
+    else if (retn->wdim > retn->cdim) {
+        x = retn->wdim / retn->cdim;
+        farr = SourceHeightmap(flgs, retn->wdim, seed, DEF_DMPF, 0, 0, x, retn->cdim);
+        retn->hmin = retn->hmax = farr[0];
+        for (x = (x + 1) * (x + 1) - 1; x >= 0; x--) {
+            retn->hmin = min(retn->hmin, farr[x]);
+            retn->hmax = max(retn->hmax, farr[x]);
+        }
+        PoolFree(farr);
+        for (hdef = pow(2.0, -fabs(DEF_DMPF)), x = retn->wdim >> 1; x; x >>= 1, hdef *= pow(2.0, -fabs(DEF_DMPF)))
+            if (x < retn->cdim) {
+                retn->hmin -= 0.500 * hdef;
+                retn->hmax += 0.500 * hdef;
+            }
+    }
+    if (file) Serialize(file, retn);
+    return retn;
+}
+
+
+
+/**
+  @brief FlushMap
+  drops all chunks of the world, so that they are created anew when needed,
+  e.g. after a change of the flags that only take effect on creation. This
+  includes the chunks that CollectChunks() has taken but not yet put into
+  their slots: they were made, and maybe released, under the old flags.
+
+  @param wmap - the world.
+**/
+void FlushMap(FMAP *wmap) {
+    FJOB **fptr, *fjob;
+    UINT i;
+
+    for (fptr = &jupl; (fjob = *fptr);)
+        if (fjob->wmap == wmap) {
+            *fptr = fjob->next;
+            if (fjob->sync) glDeleteSync(fjob->sync);
+            FreeVBO(&fjob->vobj);
+            fjob->fchk->load = 0;
+            wmap->njob--;
+            free(fjob);
+        }
+        else
+            fptr = &fjob->next;
+    for (i = 0; i < wmap->nchk; i++) {
+        FreeVBO(&wmap->chnk[i].vobj);
+        wmap->chnk[i].nobj = 0;
+    }
+}
+
+
+
+/**
+  @brief FreeMap
+  frees the world together with all the chunks it holds.
+
+  @param wmap - pointer to the location where the target FMAP is stored.
+**/
+void FreeMap(FMAP **wmap) {
+    if (wmap && *wmap) {
+        CancelJobs(*wmap);
+        FlushMap(*wmap);
+        if ((*wmap)->ivtx) {
+            glDelBuffersARB(1, &(*wmap)->ivtx);
+            glDelBuffersARB(1, &(*wmap)->iind);
+        }
+        free((*wmap)->chnk);
+        free((*wmap)->lscp);
+        free(*wmap);
+        *wmap = NULL;
+    }
+}
+
+
+
+/**
+  @brief ShowMap
+  makes the camera and the light of a world current; to be called when the
+  world is about to be shown for the first time.
+
+  @param wmap - the world.
+**/
+void ShowMap(FMAP *wmap) {
+    ftrn = wmap->ftrn;
+    fang = wmap->fang;
+    memcpy(lpos, wmap->lpos, sizeof(lpos));
+    memcpy(ldir, wmap->ldir, sizeof(ldir));
+}
+
+
+
+/**
+  @brief CamChunk
+  computes the position of the camera (see FMAP::ftrn) in chunk units,
+  relative to the corner of the chunk [0, 0].
+
+  @param wmap - the world.
+
+  @return horizontal (u) and vertical (v) camera position.
+**/
+FTEX CamChunk(FMAP *wmap) {
+    FTEX retn;
+
+    retn.u = (0.5 * wmap->grid - wmap->ftrn.x) / ((FLOAT)wmap->cdim * wmap->cell);
+    retn.v = (0.5 * wmap->grid - wmap->ftrn.y) / ((FLOAT)wmap->cdim * wmap->cell);
+    return retn;
+}
+
+
+
+/**
+  @brief FindChunk
+  looks for a chunk in the cache. Chunk indices wrap around the world.
+
+  @param wmap - the world.
+  @param xpos - horizontal index of the chunk.
+  @param ypos - vertical index of the chunk.
+
+  @return cache slot on success, NULL if the chunk is not in the cache.
+          The slot may have no VBO yet, if the chunk is still being generated.
+**/
+FCHK *FindChunk(FMAP *wmap, LONG xpos, LONG ypos) {
+    LONG i, nmax = wmap->wdim / wmap->cdim;
+
+    xpos = (xpos % nmax + nmax) % nmax;
+    ypos = (ypos % nmax + nmax) % nmax;
+    for (i = 0; i < wmap->nchk; i++)
+        if ((wmap->chnk[i].vobj || wmap->chnk[i].load) && (wmap->chnk[i].xpos == xpos) && (wmap->chnk[i].ypos == ypos))
+            return &wmap->chnk[i];
+    return NULL;
+}
+
+
+
+/**
+  @brief MapHeight
+  finds the height of the landscape at a point of the world, interpolating
+  the heights of the corners of the square the point is in.
+
+  @param wmap - the world.
+  @param xpos - X coordinate of the point; the world wraps around.
+  @param ypos - Y coordinate of the point; the world wraps around.
+
+  @return the height, or the "sea level" if the chunk that holds the point
+          is not generated yet.
+**/
+FLOAT MapHeight(FMAP *wmap, FLOAT xpos, FLOAT ypos) {
+    LONG x, y, ndim = wmap->cdim;
+    FCHK *fchk;
+    FLOAT *hgts;
+
+    xpos = (xpos + 0.5 * wmap->grid) / wmap->cell;
+    ypos = (ypos + 0.5 * wmap->grid) / wmap->cell;
+    x = floor(xpos / (FLOAT)ndim);
+    y = floor(ypos / (FLOAT)ndim);
+    if (!(fchk = FindChunk(wmap, x, y)) || !fchk->vobj || !(hgts = fchk->vobj->hgts))
+        return wmap->wlvl;
+
+    xpos -= (FLOAT)(x * ndim);
+    ypos -= (FLOAT)(y * ndim);
+    x = min(ndim - 1, max(0, tr(xpos)));
+    y = min(ndim - 1, max(0, tr(ypos)));
+    xpos -= (FLOAT)x;
+    ypos -= (FLOAT)y;
+    hgts += x + y * (ndim + 1);
+    return (hgts[0]        * (1.0 - xpos) + hgts[1]            * xpos) * (1.0 - ypos)
+         + (hgts[ndim + 1] * (1.0 - xpos) + hgts[ndim + 1 + 1] * xpos) * ypos;
+}
+
+
+
+/**
+  @brief BlockHeight
+  finds the highest corner of the block of 2^nlod x 2^nlod squares holding a
+  point of the world; a chunk drawn with LOD level nlod has no surface above
+  that height over the block.
+
+  @param wmap - the world.
+  @param xpos - X coordinate of the point; the world wraps around.
+  @param ypos - Y coordinate of the point; the world wraps around.
+  @param nlod - LOD level.
+
+  @return the height, or FLT_MAX if the chunk that holds the point is not
+          generated yet.
+**/
+FLOAT BlockHeight(FMAP *wmap, FLOAT xpos, FLOAT ypos, LONG nlod) {
+    LONG x, y, xcrn, ycrn, ndim = wmap->cdim, bdim = min(ndim, 1 << nlod);
+    FLOAT retn = -FLT_MAX;
+    FCHK *fchk;
+
+    xpos = (xpos + 0.5 * wmap->grid) / wmap->cell;
+    ypos = (ypos + 0.5 * wmap->grid) / wmap->cell;
+    x = floor(xpos / (FLOAT)ndim);
+    y = floor(ypos / (FLOAT)ndim);
+    if (!(fchk = FindChunk(wmap, x, y)) || !fchk->vobj || !fchk->vobj->hgts)
+        return FLT_MAX;
+
+    xcrn = min(ndim - 1, max(0, tr(xpos - (FLOAT)(x * ndim)))) & ~(bdim - 1);
+    ycrn = min(ndim - 1, max(0, tr(ypos - (FLOAT)(y * ndim)))) & ~(bdim - 1);
+    for (y = ycrn; y <= ycrn + bdim; y++)
+        for (x = xcrn; x <= xcrn + bdim; x++)
+            retn = max(retn, fchk->vobj->hgts[x + y * (ndim + 1)]);
+    return retn;
+}
+
+
+
+/**
+  @brief CornerHeight
+  returns the height of a square corner of the world, taken from the chunk
+  it belongs to.
+
+  @param wmap - the world.
+  @param xpos - horizontal index of the corner; the world wraps around.
+  @param ypos - vertical index of the corner; the world wraps around.
+  @param fdef - height to return if the chunk is not in the cache.
+
+  @return the height.
+**/
+FLOAT CornerHeight(FMAP *wmap, LONG xpos, LONG ypos, FLOAT fdef) {
+    LONG ndim = wmap->cdim, x = xpos & (ndim - 1), y = ypos & (ndim - 1);
+    FCHK *fchk;
+
+    if (!(fchk = FindChunk(wmap, (xpos - x) / ndim, (ypos - y) / ndim)) || !fchk->vobj || !fchk->vobj->hgts)
+        return fdef;
+    return fchk->vobj->hgts[x + y * (ndim + 1)];
+}
+
+
+
+/**
+  @brief EditRows
+  copies the rows of a window of a landscape made by FillRows() over the
+  same rows of the whole landscape: to its CPU array, its ARB buffer, or both.
+
+  @param ibuf - VBO ID of the buffer; 0 if there is none.
+  @param ddst - CPU array of the landscape; NULL if there is none.
+  @param dsrc - the same array of the window.
+  @param size - size of an element of the arrays.
+  @param ndim - horizontal and vertical dimension of the landscape.
+  @param rect - the window, see FillRows().
+**/
+void EditRows(UINT ibuf, LPVOID ddst, LPVOID dsrc, SIZE_T size, LONG ndim, LONG *rect) {
+    LONG y, nnum, strd = rect[2] - rect[0] + 1;
+    SIZE_T ipos, opos;
+
+    if (ibuf) glBindBufferARB(GL_ARRAY_BUFFER_ARB, ibuf);
+    for (y = rect[1] << 1; y <= rect[3] << 1; y++)
+        if ((nnum = strd - (y & 1))) {
+            ipos = (y - (rect[1] << 1)) * strd * size;
+            opos = (y * (ndim + 1) + rect[0]) * size;
+            if (ddst) memcpy((BYTE*)ddst + opos, (BYTE*)dsrc + ipos, nnum * size);
+            if (ibuf) glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, opos, nnum * size, (BYTE*)dsrc + ipos);
+        }
+    if (ibuf) glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+
+
+/**
+  @brief BakeLight
+  bakes the light of a chunk for the given light position into its light
+  texture (see FVBO::ilgt), which is shared by all of its LODs: the light of
+  every square corner is found by LightRows(), in parallel by SplitRows(),
+  after the ambient occlusion if the chunk has none yet (see MakeOcclusion()).
+  The shadows and the occlusion only come from the chunk itself.
+  The texture is made on the first bake and updated by the next ones.
+  Shall be called from the thread that owns OpenGL.
+
+  @param wmap - world that the chunk belongs to.
+  @param fchk - cache slot of the chunk; shall have FVBO::hgts.
+  @param lvec - light position relative to the center of the chunk.
+**/
+void BakeLight(FMAP *wmap, FCHK *fchk, FVEC lvec) {
+    FVBO *fobj, *vobj = fchk->vobj;
+    LONG ndim = wmap->cdim;
+    FBAK fbak;
+
+    if (!vobj->aocc)
+        vobj->aocc = MakeOcclusion(vobj->hgts, NULL, ndim, wmap->cell, 0, ndim + 1);
+    fbak.hgts = vobj->hgts;
+    fbak.aocc = vobj->aocc;
+    fbak.lpix = (BYTE*)PoolAlloc((ndim + 1) * (ndim + 1), FALSE);
+    fbak.ndim = ndim;
+    fbak.ybgn = 0;
+    fbak.cell = wmap->cell;
+    fbak.hmax = vobj->bmax.z;
+    fbak.lvec = lvec;
+    SplitRows(LightRows, &fbak, ndim + 1, ndim + 1);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (vobj->ilgt) {
+        glBindTexture(GL_TEXTURE_2D, vobj->ilgt);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ndim + 1, ndim + 1, GL_LUMINANCE, GL_UNSIGNED_BYTE, fbak.lpix);
+    }
+    else {
+        glGenTextures(1, &vobj->ilgt);
+        glBindTexture(GL_TEXTURE_2D, vobj->ilgt);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, ndim + 1, ndim + 1, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, fbak.lpix);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    PoolFree(fbak.lpix);
+    vobj->lbak = lvec;
+    for (fobj = vobj->next; fobj && fobj->nlod; fobj = fobj->next)
+        fobj->ilgt = vobj->ilgt;
+}
+
+
+
+/**
+  @brief BakeMap
+  keeps the light textures of the chunks in the cache up to date while
+  USE_BAKE is set: bakes the chunks that have not been baked yet, or were
+  baked for a light that has moved by DEF_BTOL squares since (see
+  BakeLight()), DEF_BAKN chunks per frame at most; the rest keep their old
+  texture, or GL lighting, until their turn comes. No chunk is baked anew
+  while the light stays where it is. The light position is taken from the
+  copy of the world nearest to the chunk, so in a world of a single chunk,
+  all of its copies share the light of the one nearest to the light.
+  Shall be called from the thread that owns OpenGL.
+
+  @param wmap - the world.
+**/
+void BakeMap(FMAP *wmap) {
+    FLOAT size = (FLOAT)wmap->cdim * wmap->cell, ftol = DEF_BTOL * wmap->cell;
+    FVBO *vobj;
+    FVEC lvec;
+    UINT i, nbak;
+
+    if (!blgt || !(wmap->flgs & USE_BAKE)) return;
+    for (nbak = i = 0; (i < wmap->nchk) && (nbak < DEF_BAKN); i++) {
+        if (!(vobj = wmap->chnk[i].vobj) || !vobj->hgts) continue;
+        lvec.x = lpos[0] - (((FLOAT)wmap->chnk[i].xpos + 0.5) * size - 0.5 * wmap->grid);
+        lvec.y = lpos[1] - (((FLOAT)wmap->chnk[i].ypos + 0.5) * size - 0.5 * wmap->grid);
+        lvec.x -= wmap->grid * floor(lvec.x / wmap->grid + 0.5);
+        lvec.y -= wmap->grid * floor(lvec.y / wmap->grid + 0.5);
+        lvec.z = lpos[2];
+        if (vobj->ilgt && (fabs(lvec.x - vobj->lbak.x) < ftol)
+        && (fabs(lvec.y - vobj->lbak.y) < ftol) && (fabs(lvec.z - vobj->lbak.z) < ftol)) continue;
+        BakeLight(wmap, &wmap->chnk[i], lvec);
+        nbak++;
+    }
+}
+
+
+
+/**
+  @brief EditChunk
+  updates a chunk after the heights of a rectangle of its corners have been
+  changed by EditMap(): remakes the vertices around the rectangle and passes
+  them to every copy the chunk keeps (the CPU arrays, the ARB buffers or the
+  height texture), then moves the firs standing there onto the new surface;
+  the firs that end up under water are collapsed into a point. A baked chunk
+  gets its ambient occlusion remade around the rectangle, and its light
+  baked anew for the same light position (see BakeLight()). The cost is
+  only that of the rectangle, plus a border 2 squares wide around it (rows
+  DEF_BAOR squares away for the occlusion); only the baked light and the
+  indices are remade in full, the latter only where water may have been
+  merged or has just appeared (see LandIndices()).
+  Shall be called from the thread that owns OpenGL.
+
+  @param wmap - world that the chunk belongs to.
+  @param fchk - cache slot of the chunk; shall have FVBO::hgts.
+  @param rect - the rectangle, in corners of the chunk: lower X, lower Y,
+                upper X, upper Y; the upper bounds are included. It may
+                reach beyond the chunk, changing the corners that its
+                normals and colors at the edges depend on.
+**/
+void EditChunk(FMAP *wmap, FCHK *fchk, LONG *rect) {
+    LONG i, x, y, vpos, strd, xdim, ydim, ndim = wmap->cdim, xorg = fchk->xpos * ndim, yorg = fchk->ypos * ndim,
+         slot = fchk - wmap->chnk, vrct[4];
+    FVBO *vobj = fchk->vobj, *fvtx, *fobj;
+    FLOAT *farr;
+    FTRI *indx;
+
+    vrct[0] = max(0, rect[0] - 2);
+    vrct[1] = max(0, rect[1] - 2);
+    vrct[2] = min(ndim, rect[2] + 2);
+    vrct[3] = min(ndim, rect[3] + 2);
+    if ((vrct[0] > vrct[2]) || (vrct[1] > vrct[3])) return;
+
+    #define EDT_HCLP(x, y) vobj->hgts[min(ndim, max(0, (x))) + min(ndim, max(0, (y))) * (ndim + 1)]
+    #define EDT_HGHT(x, y) ((((x) < 0) || ((x) > ndim) || ((y) < 0) || ((y) > ndim))? \
+                            CornerHeight(wmap, xorg + (x), yorg + (y), EDT_HCLP(x, y)) : EDT_HCLP(x, y))
+    strd = vrct[2] - vrct[0] + 1;
+    farr = (FLOAT*)PoolAlloc((strd + 2) * (vrct[3] - vrct[1] + 3) * sizeof(FLOAT), FALSE);
+    for (y = vrct[1] - 1; y <= vrct[3] + 1; y++)
+        for (x = vrct[0] - 1; x <= vrct[2] + 1; x++)
+            farr[(x - vrct[0] + 1) + (y - vrct[1] + 1) * (strd + 2)] = EDT_HGHT(x, y);
+
+    xdim = min(ndim + 1, rect[2]) - max(-1, rect[0]) + 1;
+    ydim = min(ndim + 1, rect[3]) - max(-1, rect[1]) + 1;
+    if (vobj->ihgt && (xdim > 0) && (ydim > 0)) {
+        FLOAT *fpix = (FLOAT*)PoolAlloc(xdim * ydim * sizeof(FLOAT), FALSE);
+
+        for (y = 0; y < ydim; y++)
+            for (x = 0; x < xdim; x++)
+                fpix[x + y * xdim] = EDT_HGHT(max(-1, rect[0]) + x, max(-1, rect[1]) + y);
+        glBindTexture(GL_TEXTURE_2D, vobj->ihgt);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, max(-1, rect[0]) + 1, max(-1, rect[1]) + 1,
+                        xdim, ydim, GL_LUMINANCE, GL_FLOAT, fpix);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        PoolFree(fpix);
+    }
+    #undef EDT_HGHT
+    #undef EDT_HCLP
+
+    fvtx = MakeVBO(strd * (vrct[3] - vrct[1] + 1) * 2);
+    fvtx->ndim = ndim;
+    fvtx->bmin = vobj->bmin;
+    fvtx->bmax = vobj->bmax;
+    fvtx->wmin = vobj->wmin;
+    fvtx->wmax = vobj->wmax;
+    FillRows(fvtx, farr, vrct, wmap->cell, wmap->fhei, wmap->wlvl, wmap->lscp);
+    PoolFree(farr);
+    for (fobj = vobj; fobj && (fobj == vobj || fobj->nlod); fobj = fobj->next) {
+        fobj->bmin = fvtx->bmin;
+        fobj->bmax = fvtx->bmax;
+        fobj->wmin = fvtx->wmin;
+        fobj->wmax = fvtx->wmax;
+    }
+    if (vobj->aocc)
+        MakeOcclusion(vobj->hgts, vobj->aocc, ndim, wmap->cell, vrct[1] - DEF_BAOR, vrct[3] + DEF_BAOR + 1);
+    if (vobj->ilgt)
+        BakeLight(wmap, fchk, vobj->lbak);
+    if (vobj->vtxs || vobj->ivtx) {
+        fvtx->vscl = vobj->vscl;
+        fvtx->vtxs = (FVTX*)PoolAlloc(fvtx->ndot * sizeof(FVTX), TRUE);
+        PackVerts(fvtx);
+    }
+    if (vobj->vtxs || vobj->ivtx)
+        EditRows(vobj->ivtx, vobj->vtxs, fvtx->vtxs, sizeof(FVTX), ndim, vrct);
+    if (vobj->vect || vobj->ivec) {
+        EditRows(vobj->ivec, vobj->vect, fvtx->vect, sizeof(FVEC), ndim, vrct);
+        EditRows(vobj->inrm, vobj->norm, fvtx->norm, sizeof(FVEC), ndim, vrct);
+        EditRows(vobj->iclr, vobj->clrs, fvtx->clrs, sizeof(FCLR), ndim, vrct);
+    }
+
+    for (i = 0, y = vrct[1]; !i && (y <= vrct[3]); y++)
+        for (x = vrct[0]; !i && (x <= vrct[2]); x++)
+            i = (vobj->hgts[x + y * (ndim + 1)] == wmap->wlvl);
+    if (i || (vobj->npol < 12 * ndim * ndim)) {
+        OwnArrays(vobj);
+        for (fobj = vobj; fobj && ((fobj == vobj) || fobj->nlod); fobj = fobj->next) {
+            x = ndim >> fobj->nlod;
+            if (!(indx = fobj->indx))
+                fobj->indx = (FTRI*)PoolAlloc((12 * x + 18) * x * sizeof(UINT), FALSE);
+            LandIndices(fobj, vobj->hgts);
+            if (fobj->iind) {
+                glBindBufferARB(GL_INDEX_BUFFER_ARB, fobj->iind);
+                glBufferDataARB(GL_INDEX_BUFFER_ARB, fobj->nind * ((fobj->ityp == GL_UNSIGNED_SHORT)? sizeof(WORD) : sizeof(UINT)),
+                                fobj->indx, GL_STATIC_DRAW_ARB);
+            }
+            if (!indx) {
+                PoolFree(fobj->indx);
+                fobj->indx = NULL;
+            }
+        }
+        if (glGenBuffersARB) glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
+    }
+
+    for (fobj = vobj->next; fobj && fobj->nlod; fobj = fobj->next);
+    if (fobj && fobj->ocel) {
+        FVBO *fsub = MakeVBO(3 * 5);
+
+        fsub->grid = fobj->grid;
+        fsub->vscl = fobj->vscl;
+        if (fobj->vtxs || fobj->ivtx || fchk->nobj)
+            fsub->vtxs = (FVTX*)PoolAlloc(fsub->ndot * sizeof(FVTX), TRUE);
+        for (i = fobj->ndot / fsub->ndot - 1; i >= 0; i--) {
+            x = (fobj->ocel[i] - (ndim + 1)) % ((ndim + 1) << 1);
+            y = (fobj->ocel[i] - (ndim + 1)) / ((ndim + 1) << 1);
+            if ((x < vrct[0]) || (x >= vrct[2]) || (y < vrct[1]) || (y >= vrct[3])) continue;
+
+            vpos = (((y - vrct[1]) << 1) + 1) * strd + (x - vrct[0]);
+            PlaceFir(fsub, 0, fvtx->vect, fvtx->norm, vpos, strd, vobj->seed);
+            for (x = fsub->ndot - 1; x >= 0; x--) {
+                if (fvtx->vect[vpos].z <= wmap->wlvl)
+                    fsub->vect[x] = fvtx->vect[vpos];
+                fobj->bmin.x = min(fobj->bmin.x, fsub->vect[x].x);
+                fobj->bmin.y = min(fobj->bmin.y, fsub->vect[x].y);
+                fobj->bmin.z = min(fobj->bmin.z, fsub->vect[x].z);
+                fobj->bmax.x = max(fobj->bmax.x, fsub->vect[x].x);
+                fobj->bmax.y = max(fobj->bmax.y, fsub->vect[x].y);
+                fobj->bmax.z = max(fobj->bmax.z, fsub->vect[x].z);
+            }
+            vpos = i * fsub->ndot;
+            if (fobj->vect) {
+                memcpy(fobj->vect + vpos, fsub->vect, fsub->ndot * sizeof(FVEC));
+                memcpy(fobj->norm + vpos, fsub->norm, fsub->ndot * sizeof(FVEC));
+            }
+            if (fsub->vtxs) {
+                PackVerts(fsub);
+                if (fobj->vtxs)
+                    memcpy(fobj->vtxs + vpos, fsub->vtxs, fsub->ndot * sizeof(FVTX));
+            }
+            if (fchk->nobj) {
+                for (x = fsub->ndot - 1; x >= 0; x--)
+                    fsub->vtxs[x].w = slot;
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, wmap->ivtx);
+                glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, (slot * 3 * 5 * DEF_NOBJ + vpos) * sizeof(FVTX),
+                                   fsub->ndot * sizeof(FVTX), fsub->vtxs);
+            }
+            else if (fobj->ivtx) {
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, fobj->ivtx);
+                glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vpos * sizeof(FVTX), fsub->ndot * sizeof(FVTX), fsub->vtxs);
+            }
+            else if (fobj->ivec) {
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, fobj->ivec);
+                glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vpos * sizeof(FVEC), fsub->ndot * sizeof(FVEC), fsub->vect);
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, fobj->inrm);
+                glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, vpos * sizeof(FVEC), fsub->ndot * sizeof(FVEC), fsub->norm);
+            }
+        }
+        if (glGenBuffersARB) glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+        FreeVBO(&fsub);
+    }
+    FreeVBO(&fvtx);
+}
+
+
+
+/**
+  @brief EditMap
+  changes the heights of a rectangle of square corners of the world, in all
+  the chunks of the cache that it touches, and updates only what depends on
+  them: the quadtrees, then the vertices and the firs (see EditChunk()).
+  The changes last while the chunks stay in the cache; a chunk made anew
+  (or mapped from the tile cache) is the original one again.
+  Shall be called from the thread that owns OpenGL.
+
+  @param wmap - the world.
+  @param rect - the rectangle, in corners of the world: lower X, lower Y,
+                upper X, upper Y; the upper bounds are included, and the
+                world wraps around.
+  @param fhgt - new heights, (rect[2] - rect[0] + 1) per row; they are
+                clamped to [wlvl; 0.5 * fhei], as in FillVBO().
+**/
+void EditMap(FMAP *wmap, LONG *rect, FLOAT *fhgt) {
+    if (!wmap || !rect || !fhgt || (rect[2] < rect[0]) || (rect[3] < rect[1])) return;
+
+    LONG i, j, x, y, xofs, yofs, ndim = wmap->cdim, wdim = wmap->wdim,
+         xdim = rect[2] - rect[0], ydim = rect[3] - rect[1], lrct[4];
+    FCHK *fchk;
+    FVBO *vobj;
+
+    for (j = 0; j < 2; j++)
+        for (i = 0; i < wmap->nchk; i++) {
+            fchk = &wmap->chnk[i];
+            if (!(vobj = fchk->vobj) || !vobj->hgts) continue;
+
+            xofs = rect[0] - fchk->xpos * ndim + xdim + 3;
+            yofs = rect[1] - fchk->ypos * ndim + ydim + 3;
+            xofs = (xofs % wdim + wdim) % wdim - xdim - 3;
+            yofs = (yofs % wdim + wdim) % wdim - ydim - 3;
+            for (lrct[1] = yofs; lrct[1] <= ndim + 3; lrct[1] += wdim)
+                for (lrct[0] = xofs; lrct[0] <= ndim + 3; lrct[0] += wdim) {
+                    lrct[2] = lrct[0] + xdim;
+                    lrct[3] = lrct[1] + ydim;
+                    if (j) {
+                        EditChunk(wmap, fchk, lrct);
+                        continue;
+                    }
+                    for (y = max(0, lrct[1]); y <= min(ndim, lrct[3]); y++)
+                        for (x = max(0, lrct[0]); x <= min(ndim, lrct[2]); x++)
+                            vobj->hgts[x + y * (ndim + 1)] = min(0.5 * wmap->fhei,
+                                                                 max(wmap->wlvl, fhgt[(x - lrct[0]) + (y - lrct[1]) * (xdim + 1)]));
+                    if (vobj->qtre && (max(0, lrct[0] - 1) < min(ndim, lrct[2] + 1))
+                                   && (max(0, lrct[1] - 1) < min(ndim, lrct[3] + 1))) {
+                        LONG qrct[4] = {max(0, lrct[0] - 1), max(0, lrct[1] - 1),
+                                        min(ndim, lrct[2] + 1), min(ndim, lrct[3] + 1)};
+
+                        QuadRect(vobj->qtre, vobj->hgts, ndim, qrct);
+                    }
+                }
+        }
+}
+
+
+
+/**
+  @brief CraterMap
+  digs a round crater into the world with EditMap(), the depth falling off
+  from the center to the rim as a cosine.
+
+  @param wmap - the world.
+  @param xpos - horizontal position of the center, as in MapHeight().
+  @param ypos - vertical position of the center, as in MapHeight().
+  @param rads - radius of the crater.
+  @param fdep - depth of the crater at its center.
+**/
+void CraterMap(FMAP *wmap, FLOAT xpos, FLOAT ypos, FLOAT rads, FLOAT fdep) {
+    LONG x, y, rect[4];
+    FLOAT fdst, *fhgt;
+
+    if (!wmap || (rads <= 0.0)) return;
+
+    xpos = (xpos + 0.5 * wmap->grid) / wmap->cell;
+    ypos = (ypos + 0.5 * wmap->grid) / wmap->cell;
+    rads /= wmap->cell;
+    rect[0] = ceil(xpos - rads);
+    rect[1] = ceil(ypos - rads);
+    rect[2] = floor(xpos + rads);
+    rect[3] = floor(ypos + rads);
+    if ((rect[0] > rect[2]) || (rect[1] > rect[3])) return;
+
+    fhgt = (FLOAT*)PoolAlloc((rect[2] - rect[0] + 1) * (rect[3] - rect[1] + 1) * sizeof(FLOAT), FALSE);
+    for (y = rect[1]; y <= rect[3]; y++)
+        for (x = rect[0]; x <= rect[2]; x++) {
+            fdst = min(1.0, sqrt(((FLOAT)x - xpos) * ((FLOAT)x - xpos) + ((FLOAT)y - ypos) * ((FLOAT)y - ypos)) / rads);
+            fhgt[(x - rect[0]) + (y - rect[1]) * (rect[2] - rect[0] + 1)] =
+                CornerHeight(wmap, x, y, wmap->wlvl) - fdep * 0.5 * (1.0 + cos(M_PI * fdst));
         }
-        fclose(filp);
-    }
+    EditMap(wmap, rect, fhgt);
+    PoolFree(fhgt);
 }
 
 
 
 /**
-  @brief ObjectVBO
-  generates a VBO filled with additional objects for a "parent" landscape VBO.
+  @brief LoadChunk
+  assigns a cache slot to a chunk and queues the chunk for generation,
+  evicting the least recently used chunk if there are no free slots left.
+  Slots whose chunks are still being generated are never evicted.
 
-  @param vobj - Parent VBO; the objects shall be situated on its surface.
-  @param inum - number of objects to create; may be overridden in case it
-                exceeds the count of spots that can actually hold an object.
+  @param wmap - the world.
+  @param xpos - horizontal index of the chunk.
+  @param ypos - vertical index of the chunk.
 
-  @return FVBO on success, NULL on failure (vobj == NULL or inum == 0).
+  @return cache slot on success, NULL on failure (all slots are in use).
 **/
-FVBO *ObjectVBO(FVBO *vobj, UINT inum) {
-    FVEC fbgn, fend, fv00, fv01, fv10, fv11;
-    LONG x, y, dpos, xl, xh, yh;
-    UINT *fobj, *farr;
-    FVBO *retn;
+FCHK *LoadChunk(FMAP *wmap, LONG xpos, LONG ypos) {
+    LONG i, nmax = wmap->wdim / wmap->cdim;
+    FCHK *retn = NULL;
+
+    for (i = 0; i < wmap->nchk; i++)
+        if (wmap->chnk[i].load)
+            continue;
+        else if (!wmap->chnk[i].vobj) {
+            retn = &wmap->chnk[i];
+            break;
+        }
+        else if ((wmap->chnk[i].used != wmap->nfrm) && (!retn || (wmap->chnk[i].used < retn->used)))
+            retn = &wmap->chnk[i];
+    if (!retn) return NULL;
+
+    FreeVBO(&retn->vobj);
+    retn->nobj = 0;
+    retn->xpos = (xpos % nmax + nmax) % nmax;
+    retn->ypos = (ypos % nmax + nmax) % nmax;
+    retn->used = wmap->nfrm;
+    QueueChunk(wmap, retn);
+    return retn;
+}
 
-    if (!vobj || !inum) return NULL;
 
-    for (xh = y = 0; y < vobj->ndim; y++)
-        for (dpos = vobj->ndim + (x = (vobj->ndim + 1) + (y * (vobj->ndim + 1) << 1)); x < dpos; x++)
-            if (vobj->vect[x].z > vobj->wlvl) xh++;
 
-    fobj = (UINT*)malloc((1 + (xl = min(xh, inum))) * sizeof(UINT));
-    fobj[0] = xl;
-    farr = (UINT*)malloc(xh * sizeof(UINT));
+/**
+  @brief StreamMap
+  collects the chunks generated so far, makes sure that all chunks to be
+  drawn are in the cache or on their way there, and prefetches the ring of
+  chunks around them, at most DEF_CGEN chunks per call.
+  Shall be called once per frame, before DrawMap().
 
-    yh = xh;
-    for (y = 0; y < vobj->ndim; y++)
-        for (dpos = vobj->ndim + (x = (vobj->ndim + 1) + (y * (vobj->ndim + 1) << 1)); x < dpos; x++)
-            if (vobj->vect[x].z > vobj->wlvl)
-                farr[--yh] = x;
+  @param wmap - the world.
 
-    for (; xl > 0; xl--) {
-        x = rand() % xh;
-        fobj[xl] = farr[x];
-        farr[x] = farr[--xh];
+  @return number of chunks to be drawn that are not ready yet.
+**/
+UINT StreamMap(FMAP *wmap) {
+    LONG x, y, xbgn, ybgn, xmin, ymin;
+    FTEX fcam = CamChunk(wmap);
+    FLOAT fdst, fmin;
+    FCHK *fchk;
+    UINT ngen;
+
+    CollectChunks();
+    wmap->nfrm++;
+    xbgn = floor(fcam.u - 0.5 * (FLOAT)DEF_DRAW + 0.5);
+    ybgn = floor(fcam.v - 0.5 * (FLOAT)DEF_DRAW + 0.5);
+    for (y = ybgn - 1; y <= ybgn + DEF_DRAW; y++)
+        for (x = xbgn - 1; x <= xbgn + DEF_DRAW; x++)
+            if ((fchk = FindChunk(wmap, x, y)))
+                fchk->used = wmap->nfrm;
+
+    for (y = ybgn; y < ybgn + DEF_DRAW; y++)
+        for (x = xbgn; x < xbgn + DEF_DRAW; x++)
+            if (!FindChunk(wmap, x, y))
+                LoadChunk(wmap, x, y);
+
+    for (ngen = 0; ngen < DEF_CGEN; ngen++) {
+        fmin = -1.0;
+        for (y = ybgn - 1; y <= ybgn + DEF_DRAW; y++)
+            for (x = xbgn - 1; x <= xbgn + DEF_DRAW; x++)
+                if (((y < ybgn) || (y == ybgn + DEF_DRAW) || (x < xbgn) || (x == xbgn + DEF_DRAW)) && !FindChunk(wmap, x, y)) {
+                    fdst = ((FLOAT)x + 0.5 - fcam.u) * ((FLOAT)x + 0.5 - fcam.u)
+                         + ((FLOAT)y + 0.5 - fcam.v) * ((FLOAT)y + 0.5 - fcam.v);
+                    if ((fmin < 0.0) || (fdst < fmin)) {
+                        fmin = fdst;
+                        xmin = x;
+                        ymin = y;
+                    }
+                }
+        if ((fmin < 0.0) || !LoadChunk(wmap, xmin, ymin)) break;
     }
-    free(farr);
 
-    retn = MakeVBO(3 * 5 * fobj[0]);
-    x = 64;
-//    x = -256;
-    retn->ntex = MakeFacetTex(x);
-    retn->grid = vobj->grid / (FLOAT)vobj->ndim;
+    for (ngen = 0, y = ybgn; y < ybgn + DEF_DRAW; y++)
+        for (x = xbgn; x < xbgn + DEF_DRAW; x++)
+            if (!(fchk = FindChunk(wmap, x, y)) || !fchk->vobj)
+                ngen++;
+    return ngen;
+}
 
-    #define FIR_TTEX  0.25
-    #define FIR_SIZE  0.75
-    #define FIR_FADE (0.25 * FIR_SIZE)
-    for (x = fobj[0] - 1; x >= 0; x--) {
-        fv00 = vobj->vect[fobj[x + 1] - (vobj->ndim + 1) + 0];
-        fv01 = vobj->vect[fobj[x + 1] - (vobj->ndim + 1) + 1];
-        fv11 = vobj->vect[fobj[x + 1] + (vobj->ndim + 1) + 1];
-        fv10 = vobj->vect[fobj[x + 1] + (vobj->ndim + 1) + 0];
 
-        fbgn = vobj->vect[fobj[x + 1]];
-        fend = vobj->norm[fobj[x + 1]];
 
-        fend.x *= 0.5 * retn->grid;
-        fend.y *= 0.5 * retn->grid;
-        fend.z *= 0.5 * retn->grid;
+/**
+  @brief MakeFrustum
+  extracts the clipping planes of the view frustum from the current
+  projection and modelview matrices, i.e. from the glFrustum() made in
+  WM_SIZE and everything applied to the camera after it, mirroring included.
 
-        for (y = 0; y < 3; y++) {
-            xl = x * 3 + y;
-            xh = xl * 5;
+  @param fpln - array to receive 6 planes (a, b, c, d); a point (x, y, z)
+                is inside a plane if a * x + b * y + c * z + d >= 0.
+**/
+void MakeFrustum(FLOAT fpln[6][4]) {
+    FLOAT proj[16], mdlv[16], clip[16];
+    LONG i, j;
+
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetFloatv(GL_MODELVIEW_MATRIX, mdlv);
+    for (i = 0; i < 4; i++)
+        for (j = 0; j < 4; j++)
+            clip[i * 4 + j] = mdlv[i * 4 + 0] * proj[0 * 4 + j] + mdlv[i * 4 + 1] * proj[1 * 4 + j]
+                            + mdlv[i * 4 + 2] * proj[2 * 4 + j] + mdlv[i * 4 + 3] * proj[3 * 4 + j];
+    for (i = 0; i < 6; i++)
+        for (j = 0; j < 4; j++)
+            fpln[i][j] = clip[j * 4 + 3] + ((i & 1)? -clip[j * 4 + (i >> 1)] : clip[j * 4 + (i >> 1)]);
+}
 
-            retn->indx[xl].a = xh + 0;
-            retn->indx[xl].b = xh + 4;
-            retn->indx[xl].c = xh + 1;
 
-            retn->indx[xl].d = xh + 0;
-            retn->indx[xl].e = xh + 1;
-            retn->indx[xl].f = xh + 2;
 
-            retn->indx[xl].g = xh + 0;
-            retn->indx[xl].h = xh + 2;
-            retn->indx[xl].i = xh + 3;
+/**
+  @brief CullBox
+  tells if an axis-aligned box lies entirely outside the view frustum.
 
-            retn->indx[xl].j = xh + 0;
-            retn->indx[xl].k = xh + 3;
-            retn->indx[xl].l = xh + 4;
+  @param fpln - frustum planes made by MakeFrustum().
+  @param bmin - lower corner of the box.
+  @param bmax - upper corner of the box.
+  @param fofs - offset to be added to both corners.
 
-            retn->clrs[xh + 4].RGBA =
-            retn->clrs[xh + 3].RGBA =
-            retn->clrs[xh + 2].RGBA =
-            retn->clrs[xh + 1].RGBA =
-            retn->clrs[xh + 0].RGBA = 0xFF00B000;
+  @return TRUE if the box is invisible, FALSE otherwise.
+**/
+BOOL CullBox(FLOAT fpln[6][4], FVEC bmin, FVEC bmax, FVEC fofs) {
+    LONG i;
+
+    for (i = 0; i < 6; i++)
+        if (fpln[i][0] * (fofs.x + ((fpln[i][0] > 0.0)? bmax.x : bmin.x))
+        +   fpln[i][1] * (fofs.y + ((fpln[i][1] > 0.0)? bmax.y : bmin.y))
+        +   fpln[i][2] * (fofs.z + ((fpln[i][2] > 0.0)? bmax.z : bmin.z))
+        +   fpln[i][3] < 0.0) return TRUE;
+    return FALSE;
+}
 
-            retn->norm[xh + 0] = vobj->norm[fobj[x + 1]];
 
-            retn->vect[xh + 0].x = fbgn.x + fend.x * (FLOAT)(y + 2);
-            retn->vect[xh + 0].y = fbgn.y + fend.y * (FLOAT)(y + 2);
-            retn->vect[xh + 0].z = fbgn.z + fend.z * (FLOAT)(y + 2);
 
-            retn->vect[xh + 1].x = fbgn.x + (fv00.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
-            retn->vect[xh + 1].y = fbgn.y + (fv00.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
-            retn->vect[xh + 1].z = fbgn.z + (fv00.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+/**
+  @brief HorizonSpan
+  measures an axis-aligned box as seen from above by the camera: the range
+  of azimuths it takes, and the nearest and the farthest horizontal
+  distances to it.
+
+  @param bmin - lower corner of the box.
+  @param bmax - upper corner of the box.
+  @param fofs - offset to be added to both corners.
+  @param span - where to put the lowest and the highest azimuths (the latter
+                is always greater, though it may exceed M_PI), then the
+                nearest and the farthest distances.
+
+  @return TRUE on success, FALSE if the camera is right above the box.
+**/
+BOOL HorizonSpan(FVEC bmin, FVEC bmax, FVEC fofs, FLOAT *span) {
+    FLOAT xcrn[2], ycrn[2], fctr, fang;
+    LONG i;
+
+    xcrn[0] = fofs.x + bmin.x + ftrn.x;
+    xcrn[1] = fofs.x + bmax.x + ftrn.x;
+    ycrn[0] = fofs.y + bmin.y + ftrn.y;
+    ycrn[1] = fofs.y + bmax.y + ftrn.y;
+    if ((xcrn[0] <= 0.0) && (xcrn[1] >= 0.0) && (ycrn[0] <= 0.0) && (ycrn[1] >= 0.0))
+        return FALSE;
+
+    fctr = atan2(ycrn[0] + ycrn[1], xcrn[0] + xcrn[1]);
+    span[0] = span[1] = fctr;
+    span[3] = 0.0;
+    for (i = 0; i < 4; i++) {
+        fang = atan2(ycrn[i >> 1], xcrn[i & 1]) - fctr;
+        fang += (fang > M_PI)? -2.0 * M_PI : (fang < -M_PI)? 2.0 * M_PI : 0.0;
+        span[0] = min(span[0], fctr + fang);
+        span[1] = max(span[1], fctr + fang);
+        span[3] = max(span[3], sqrt(xcrn[i & 1] * xcrn[i & 1] + ycrn[i >> 1] * ycrn[i >> 1]));
+    }
+    xcrn[0] = max(0.0, max(xcrn[0], -xcrn[1]));
+    ycrn[0] = max(0.0, max(ycrn[0], -ycrn[1]));
+    span[2] = sqrt(xcrn[0] * xcrn[0] + ycrn[0] * ycrn[0]);
+    return span[2] > 0.0;
+}
 
-            retn->vect[xh + 2].x = fbgn.x + (fv01.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
-            retn->vect[xh + 2].y = fbgn.y + (fv01.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
-            retn->vect[xh + 2].z = fbgn.z + (fv01.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
 
-            retn->vect[xh + 3].x = fbgn.x + (fv11.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
-            retn->vect[xh + 3].y = fbgn.y + (fv11.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
-            retn->vect[xh + 3].z = fbgn.z + (fv11.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
 
-            retn->vect[xh + 4].x = fbgn.x + (fv10.x - fbgn.x) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.x * (FLOAT)y;
-            retn->vect[xh + 4].y = fbgn.y + (fv10.y - fbgn.y) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.y * (FLOAT)y;
-            retn->vect[xh + 4].z = fbgn.z + (fv10.z - fbgn.z) * FIR_SIZE * (1.0 - FIR_FADE * (FLOAT)y) + fend.z * (FLOAT)y;
+/**
+  @brief HorizonHide
+  tells if an axis-aligned box lies entirely below the horizon, i.e. if no
+  ray from the camera to the box rises above the slopes that the horizon
+  keeps for the azimuths the box takes (see HorizonAdd()).
 
-            retn->texc[xh + 0].u = 0.5 * FIR_TTEX;
-            retn->texc[xh + 0].v = 0.5 * FIR_TTEX;
-            retn->texc[xh + 2].u = FIR_TTEX;
-            retn->texc[xh + 4].u = FIR_TTEX;
-        }
-    }
-    #undef FIR_FADE
-    #undef FIR_SIZE
-    #undef FIR_TTEX
+  @param hrzn - DEF_HBIN slopes, one per sector of azimuths.
+  @param bmin - lower corner of the box.
+  @param bmax - upper corner of the box.
+  @param fofs - offset to be added to both corners.
 
-    if (glGenBuffersARB) {
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, retn->iind);
-        glBufferDataARB(GL_INDEX_BUFFER_ARB, 3 * fobj[0] * sizeof(FTRI), retn->indx, GL_STATIC_DRAW_ARB);
+  @return TRUE if the box is hidden, FALSE otherwise.
+**/
+BOOL HorizonHide(FLOAT *hrzn, FVEC bmin, FVEC bmax, FVEC fofs) {
+    FLOAT span[4], fslp = fofs.z + bmax.z + ftrn.z;
+    LONG i, iend;
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->ivec);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FVEC), retn->vect, GL_STATIC_DRAW_ARB);
+    if (!HorizonSpan(bmin, bmax, fofs, span)) return FALSE;
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->iclr);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FCLR), retn->clrs, GL_STATIC_DRAW_ARB);
+    fslp /= (fslp > 0.0)? span[2] : span[3];
+    iend = floor((span[1] + M_PI) * DEF_HBIN / (2.0 * M_PI));
+    for (i = floor((span[0] + M_PI) * DEF_HBIN / (2.0 * M_PI)); i <= iend; i++)
+        if (hrzn[(i + DEF_HBIN) % DEF_HBIN] <= fslp) return FALSE;
+    return TRUE;
+}
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->inrm);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FVEC), retn->norm, GL_STATIC_DRAW_ARB);
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->itex);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FTEX), retn->texc, GL_STATIC_DRAW_ARB);
 
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-    }
+/**
+  @brief HorizonAdd
+  raises the horizon by the part of the landscape that lies under a drawn
+  box. The landscape is continuous, so a ray from a camera above it that
+  passes under the bottom of the box has hit the landscape before; the slope
+  of such rays is found for the farthest (if they go up) or the nearest (if
+  they go down) point of the box, as a bound for every ray of the sector.
+  Only the sectors covered by the box in full are raised.
+  The boxes shall be added from front to back, so that no box added can be
+  behind the boxes HorizonHide() is then asked about.
+
+  @param hrzn - DEF_HBIN slopes, one per sector of azimuths.
+  @param bmin - lower corner of the box.
+  @param bmax - upper corner of the box.
+  @param fofs - offset to be added to both corners.
+**/
+void HorizonAdd(FLOAT *hrzn, FVEC bmin, FVEC bmax, FVEC fofs) {
+    FLOAT span[4], fslp = fofs.z + bmin.z + ftrn.z;
+    LONG i, iend;
 
-    retn->flgs = USE_ARBV;
-    retn->npol = 3 * 3 * 4 * fobj[0];
-    free(fobj);
+    if (!HorizonSpan(bmin, bmax, fofs, span)) return;
 
-    return retn;
+    fslp /= (fslp > 0.0)? span[3] : span[2];
+    iend = floor((span[1] + M_PI) * DEF_HBIN / (2.0 * M_PI));
+    for (i = ceil((span[0] + M_PI) * DEF_HBIN / (2.0 * M_PI)); i < iend; i++)
+        hrzn[(i + DEF_HBIN) % DEF_HBIN] = max(hrzn[(i + DEF_HBIN) % DEF_HBIN], fslp);
 }
 
 
 
 /**
-  @brief LandscapeVBO
-  generates a landscape VBO.
-
-  @param ndim - log2 of the map size.
-  @param flgs - display flags (see FVBO::flgs).
-  @param seed - random number generator seed.
-  @param grid - width and height of the elementary square.
-  @param fhei - height range.
-  @param wlvl - "sea level" within the range.
-  @param lscp - array of FHEIs for mapping colors to heights.
-  @param file - file into which the VBO shall be serialized.
-
-  @return FVBO on success, NULL on failure (ndim == 0, lscp == NULL, grid <= 0).
+  @brief DrawBatch
+  renders a list of VBOs at their offsets. Equal VBOs (e.g. the copies of the
+  only chunk of a single tile world) with equal edge masks are drawn together
+  in one DrawVBO() call, which makes a single instanced draw if possible.
+
+  @param vobj - array of VBOs.
+  @param emsk - array of edge masks (see FVBO::emsk).
+  @param fofs - array of offsets.
+  @param nvbo - number of elements in each of the arrays.
+  @param flgs - flags to draw with (see FVBO::flgs).
 **/
-FVBO *LandscapeVBO(UINT ndim, UINT flgs, UINT seed, FLOAT grid, FLOAT fhei, FLOAT wlvl, FHEI *lscp, LPSTR file) {
-    if (!ndim || !lscp || grid <= 0.0) return NULL;
-    if (!glGenBuffersARB) flgs &= ~USE_ARBV;
-    ndim = pow(2.0, ndim);
-    wlvl = max(wlvl, -0.5 * (fhei = fabs(fhei)));
+void DrawBatch(FVBO **vobj, UINT *emsk, FVEC *fofs, UINT nvbo, UINT flgs) {
+    FVEC fgrp[DEF_DRAW * DEF_DRAW];
+    BYTE fdon[DEF_DRAW * DEF_DRAW] = {};
+    UINT i, j, ngrp;
+
+    for (i = 0; i < nvbo; i++)
+        if (!fdon[i]) {
+            for (ngrp = 0, j = i; j < nvbo; j++)
+                if ((vobj[j] == vobj[i]) && (emsk[j] == emsk[i])) {
+                    fgrp[ngrp++] = fofs[j];
+                    fdon[j] = 1;
+                }
+            vobj[i]->flgs = flgs;
+            vobj[i]->emsk = emsk[i];
+            DrawVBO(vobj[i], fgrp, ngrp);
+        }
+}
 
-    FVBO *retn = MakeVBO((ndim + 1) * (ndim + ndim + 2));
-    LONG i, x, y, xl, xh, yl, yh, dpos;
-    FLOAT fmin, fmax, *farr;
-    DWORD wclr;
-    BYTE wtrn;
 
-    for (i = y = 0; y < ndim; y++) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x < ndim; x++) {
-            retn->indx[i].a = dpos + (ndim + 1);
-            retn->indx[i].b = dpos;
-            retn->indx[i].c = dpos + 1;
 
-            retn->indx[i].d = dpos + (ndim + 1);
-            retn->indx[i].e = dpos + 1;
-            retn->indx[i].f = dpos + (ndim + ndim + 2) + 1;
+/**
+  @brief DrawObjects
+  renders the batched objects of the given chunks (see BatchObjects()) from
+  the shared buffers of the world; state is set up once for all of them, the
+  same way DrawVBO() does it. Only the index ranges of the given slots are
+  drawn, a call per run of adjacent slots, so that the vertex shader never
+  sees the others. A chunk given more than once, like the only chunk of a
+  single tile world, costs one more round of calls per copy.
+
+  @param wmap - the world.
+  @param fchk - array of cache slots whose objects are batched.
+  @param fofs - array of offsets of the chunks.
+  @param nchk - number of elements in each of the arrays.
+  @param flgs - flags to draw with (see FVBO::flgs).
+**/
+void DrawObjects(FMAP *wmap, FCHK **fchk, FVEC *fofs, UINT nchk, UINT flgs) {
+    FLOAT fslt[DEF_NCHK][4];
+    BYTE fdon[DEF_DRAW * DEF_DRAW] = {}, *vptr = NULL;
+    UINT i, slot, ndon, nind = 3 * 3 * 4 * DEF_NOBJ;
+    FVBO *fobj;
+    FGLS fgls;
+
+    if (!nchk) return;
+
+    fgls.pmod = (flgs & USE_FILL)? GL_FILL : GL_LINE;
+    fgls.arrs = flgs & (USE_NORM | USE_TEXC | USE_CLRS);
+    fgls.ntex = (flgs & USE_TEXC)? otex : 0;
+    fgls.prog = oshd;
+    fgls.nrmz = FALSE;
+    fgls.wclr = !(flgs & USE_CLRS);
+    fgls.tscl = (flgs & USE_TEXC)? 1.0 / DEF_PTEX : 1.0;
+    fgls.nlgt = 0;
+    fgls.lscl = glst.lscl;
+    StateApply(&fgls);
+    StateBind(GL_INDEX_BUFFER_ARB, wmap->iind);
+    StateBind(GL_ARRAY_BUFFER_ARB, wmap->ivtx);
+    glVertexPointer(4, GL_SHORT, sizeof(FVTX), vptr + offsetof(FVTX, x));
+    if (flgs & USE_NORM)
+        glNormalPointer(GL_BYTE, sizeof(FVTX), vptr + offsetof(FVTX, nx));
+    if (flgs & USE_TEXC)
+        glTexCoordPointer(2, GL_SHORT, sizeof(FVTX), vptr + offsetof(FVTX, u));
+    if (flgs & USE_CLRS)
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(FVTX), vptr + offsetof(FVTX, c));
+    for (ndon = 0; ndon < nchk;) {
+        memset(fslt, 0, sizeof(fslt));
+        for (i = 0; i < nchk; i++)
+            if (!fdon[i] && !fslt[slot = fchk[i] - wmap->chnk][3]) {
+                for (fobj = fchk[i]->vobj->next; fobj->nlod; fobj = fobj->next);
+                fslt[slot][0] = fofs[i].x;
+                fslt[slot][1] = fofs[i].y;
+                fslt[slot][2] = fofs[i].z;
+                fslt[slot][3] = fobj->vscl;
+                prof.ntri += fchk[i]->nind / 3;
+                fdon[i] = 1;
+                ndon++;
+            }
+        glUniform4fvARB(oofs, wmap->nchk, (FLOAT*)fslt);
+        for (slot = 0; slot < wmap->nchk; slot = i) {
+            for (; (slot < wmap->nchk) && !fslt[slot][3]; slot++);
+            for (i = slot; (i < wmap->nchk) && fslt[i][3]; i++);
+            if (i == slot) break;
+            glDrawElements(GL_TRIANGLES, (i - slot) * nind, GL_UNSIGNED_INT, vptr + slot * nind * sizeof(UINT));
+            prof.ndrw++;
+        }
+    }
+}
 
-            retn->indx[i].g = dpos + (ndim + 1);
-            retn->indx[i].h = dpos + (ndim + ndim + 2) + 1;
-            retn->indx[i].i = dpos + (ndim + ndim + 2);
 
-            retn->indx[i].j = dpos + (ndim + 1);
-            retn->indx[i].k = dpos + (ndim + ndim + 2);
-            retn->indx[i].l = dpos;
 
-            dpos++;
-            i++;
+/**
+  @brief DrawMap
+  renders DEF_DRAW x DEF_DRAW chunks nearest to the camera.
+  If USE_LODS is set, each chunk is drawn with a LOD level that grows with
+  the distance to the camera; the levels of adjacent chunks differ by 1 at
+  most, and the finer chunk of such a pair stitches its edge to the coarser.
+  Chunks and objects outside the view frustum are skipped; the rest are
+  drawn by DrawBatch(), all chunks first, then all objects, sharing the GL
+  state between them; it is reset once everything is drawn. Chunks go from
+  front to back, ring after ring of chunks around the one with the camera,
+  which is also the order every ray from the camera crosses them in. That
+  lets the depth test reject what lies behind, and lets the chunks already
+  drawn raise the horizon (see HorizonAdd()), so that the chunks and the
+  objects hidden below it are skipped altogether; this is only done when
+  all the chunks are there and the camera is above the landscape, and never
+  for the reflection. Outside of the reflection, chunks and objects are
+  profiled as PRF_LAND and PRF_OBJS.
+  The reflection of a chunk can only be seen through the water lying
+  between the chunk and the camera, so when drawing the reflection, a chunk
+  is also skipped if none of the visible water is within the rectangle they
+  span.
+  A reflection drawn to the texture (USE_REFL) is DEF_RLOD levels coarser.
+
+  @param wmap - the world.
+  @param refl - defines if the reflection is to be drawn.
+**/
+void DrawMap(FMAP *wmap, BOOL refl) {
+    FLOAT fdsx, fdsy, fpln[6][4], hrzn[DEF_HBIN], size = (FLOAT)wmap->cdim * wmap->cell;
+    LONG x, y, i, j, k, xbgn, ybgn, xcam, ycam, ichg, nlod[DEF_DRAW][DEF_DRAW], iord[DEF_DRAW * DEF_DRAW];
+    BOOL hocc = !refl;
+    FCHK *fchk[DEF_DRAW][DEF_DRAW];
+    BOOL fwtr[DEF_DRAW][DEF_DRAW];
+    FVEC fofs[DEF_DRAW][DEF_DRAW], tofs[DEF_DRAW * DEF_DRAW], vofs[DEF_DRAW * DEF_DRAW], bmin, bmax;
+    FVBO *fvbo, *fobj, *tvbo[DEF_DRAW * DEF_DRAW], *ovbo[DEF_DRAW * DEF_DRAW];
+    UINT ntil = 0, nobj = 0, nbat = 0, tmsk[DEF_DRAW * DEF_DRAW], omsk[DEF_DRAW * DEF_DRAW];
+    FCHK *bchk[DEF_DRAW * DEF_DRAW];
+    FVEC bofs[DEF_DRAW * DEF_DRAW];
+    FTEX fcam = CamChunk(wmap);
+
+    for (ichg = 0; (ichg < DEF_NLOD - 1) && ((wmap->cdim >> (ichg + 2)) > 0); ichg++);
+    xbgn = floor(fcam.u - 0.5 * (FLOAT)DEF_DRAW + 0.5);
+    ybgn = floor(fcam.v - 0.5 * (FLOAT)DEF_DRAW + 0.5);
+    for (y = 0; y < DEF_DRAW; y++)
+        for (x = 0; x < DEF_DRAW; x++) {
+            fdsx = max(0.0, max((FLOAT)(xbgn + x) - fcam.u, fcam.u - (FLOAT)(xbgn + x + 1)));
+            fdsy = max(0.0, max((FLOAT)(ybgn + y) - fcam.v, fcam.v - (FLOAT)(ybgn + y + 1)));
+            nlod[y][x] = min(ichg, ((wmap->flgs & USE_LODS)? tr(sqrt(fdsx * fdsx + fdsy * fdsy) / DEF_LODD) : 0)
+                                 + ((refl && (wmap->flgs & USE_REFL) && rfbo)? DEF_RLOD : 0));
+        }
+    do {
+        for (ichg = y = 0; y < DEF_DRAW; y++)
+            for (x = 0; x < DEF_DRAW; x++) {
+                #define CLAMP(c) if (nlod[y][x] > (c) + 1) { nlod[y][x] = (c) + 1; ichg = 1; }
+                if (x > 0)            CLAMP(nlod[y][x - 1]);
+                if (x < DEF_DRAW - 1) CLAMP(nlod[y][x + 1]);
+                if (y > 0)            CLAMP(nlod[y - 1][x]);
+                if (y < DEF_DRAW - 1) CLAMP(nlod[y + 1][x]);
+                #undef CLAMP
+            }
+    } while (ichg);
+
+    for (y = 0; y < DEF_DRAW; y++)
+        for (x = 0; x < DEF_DRAW; x++) {
+            if ((fchk[y][x] = FindChunk(wmap, xbgn + x, ybgn + y)) && !fchk[y][x]->vobj)
+                fchk[y][x] = NULL;
+            fofs[y][x].x = ((FLOAT)(xbgn + x) + 0.5) * size - 0.5 * wmap->grid;
+            fofs[y][x].y = ((FLOAT)(ybgn + y) + 0.5) * size - 0.5 * wmap->grid;
+            fofs[y][x].z = 0.0;
+            hocc = hocc && fchk[y][x];
         }
+    xcam = min(DEF_DRAW - 1, max(0, (LONG)floor(fcam.u) - xbgn));
+    ycam = min(DEF_DRAW - 1, max(0, (LONG)floor(fcam.v) - ybgn));
+    #define RING(i) (abs((i) % DEF_DRAW - xcam) + abs((i) / DEF_DRAW - ycam))
+    for (i = 0; i < DEF_DRAW * DEF_DRAW; i++) {
+        for (j = i; (j > 0) && (RING(iord[j - 1]) > RING(i)); j--)
+            iord[j] = iord[j - 1];
+        iord[j] = i;
     }
-
-    srand(seed);
-    BlurHeightmap(farr = MakeHeightmap(ndim, 1.0), ndim, 1.5);
-    fmin = fmax = farr[0];
-    for (x = (ndim + 1) * (ndim + 1); x >= 0; x--) {
-        fmin = min(fmin, farr[x]);
-        fmax = max(fmax, farr[x]);
+    #undef RING
+    if (hocc && (-ftrn.z <= BlockHeight(wmap, -ftrn.x, -ftrn.y, nlod[ycam][xcam])))
+        hocc = FALSE;
+    for (i = 0; i < DEF_HBIN; i++)
+        hrzn[i] = -FLT_MAX;
+    if (refl) {
+        MakeFrustum(fpln);
+        for (y = 0; y < DEF_DRAW; y++)
+            for (x = 0; x < DEF_DRAW; x++)
+                fwtr[y][x] = fchk[y][x] && (fchk[y][x]->vobj->wmin.x <= fchk[y][x]->vobj->wmax.x)
+                          && !CullBox(fpln, fchk[y][x]->vobj->wmin, fchk[y][x]->vobj->wmax, fofs[y][x]);
+        glPushMatrix();
+        glTranslatef(0.0, 0.0, 2.0 * wmap->wlvl);
+        glScalef(1.0, 1.0, -1.0);
     }
-    fmax = fhei / (fmax - fmin);
-    for (y = 0; y <= ndim; y++) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x <= ndim; x++) {
-            retn->vect[dpos].x = grid * (FLOAT)x - 0.5 * grid * (FLOAT)ndim;
-            retn->vect[dpos].y = grid * (FLOAT)y - 0.5 * grid * (FLOAT)ndim;
-            retn->vect[dpos].z = (farr[x + y*(ndim+1)] - fmin) * fmax - 0.5 * fhei;
-            if (retn->vect[dpos].z < wlvl) retn->vect[dpos].z = wlvl;
-            dpos++;
+    MakeFrustum(fpln);
+
+    for (k = 0; k < DEF_DRAW * DEF_DRAW; k++) {
+        x = iord[k] % DEF_DRAW;
+        y = iord[k] / DEF_DRAW;
+        if (!fchk[y][x]) continue;
+        for (fvbo = fchk[y][x]->vobj; fvbo->next && fvbo->next->nlod && (fvbo->nlod < nlod[y][x]); fvbo = fvbo->next);
+        if (CullBox(fpln, fvbo->bmin, fvbo->bmax, fofs[y][x])) continue;
+        if (refl) {
+            bmin.x = min(-ftrn.x, fofs[y][x].x + fvbo->bmin.x);
+            bmin.y = min(-ftrn.y, fofs[y][x].y + fvbo->bmin.y);
+            bmax.x = max(-ftrn.x, fofs[y][x].x + fvbo->bmax.x);
+            bmax.y = max(-ftrn.y, fofs[y][x].y + fvbo->bmax.y);
+            for (i = 0; i < DEF_DRAW * DEF_DRAW; i++)
+                if (fwtr[j = i / DEF_DRAW][i % DEF_DRAW]
+                &&  (fofs[j][i % DEF_DRAW].x + fchk[j][i % DEF_DRAW]->vobj->wmin.x <= bmax.x)
+                &&  (fofs[j][i % DEF_DRAW].x + fchk[j][i % DEF_DRAW]->vobj->wmax.x >= bmin.x)
+                &&  (fofs[j][i % DEF_DRAW].y + fchk[j][i % DEF_DRAW]->vobj->wmin.y <= bmax.y)
+                &&  (fofs[j][i % DEF_DRAW].y + fchk[j][i % DEF_DRAW]->vobj->wmax.y >= bmin.y)) break;
+            if (i >= DEF_DRAW * DEF_DRAW) continue;
+        }
+        for (fobj = fvbo->next; fobj && fobj->nlod; fobj = fobj->next);
+        if ((wmap->flgs & USE_OBJS) && fobj && !CullBox(fpln, fobj->bmin, fobj->bmax, fofs[y][x])
+        && !(hocc && HorizonHide(hrzn, fobj->bmin, fobj->bmax, fofs[y][x]))) {
+            if (fchk[y][x]->nobj) {
+                bofs[nbat] = fofs[y][x];
+                bchk[nbat++] = fchk[y][x];
+            }
+            else {
+                vofs[nobj] = fofs[y][x];
+                omsk[nobj] = 0;
+                ovbo[nobj++] = fobj;
+            }
         }
+        if (hocc) {
+            if (HorizonHide(hrzn, fvbo->bmin, fvbo->bmax, fofs[y][x])) continue;
+            HorizonAdd(hrzn, fvbo->bmin, fvbo->bmax, fofs[y][x]);
+        }
+        tmsk[ntil] = 0;
+        if ((y > 0)            && (nlod[y - 1][x] > fvbo->nlod)) tmsk[ntil] |= 1 << 0;
+        if ((x < DEF_DRAW - 1) && (nlod[y][x + 1] > fvbo->nlod)) tmsk[ntil] |= 1 << 1;
+        if ((y < DEF_DRAW - 1) && (nlod[y + 1][x] > fvbo->nlod)) tmsk[ntil] |= 1 << 2;
+        if ((x > 0)            && (nlod[y][x - 1] > fvbo->nlod)) tmsk[ntil] |= 1 << 3;
+        tofs[ntil] = fofs[y][x];
+        tvbo[ntil++] = fvbo;
+    }
+    if (!refl) ProfBegin(PRF_LAND);
+    DrawBatch(tvbo, tmsk, tofs, ntil, wmap->flgs & ~USE_OBJS);
+    if (!refl) {
+        ProfEnd(PRF_LAND);
+        ProfBegin(PRF_OBJS);
     }
-    free(farr);
+    DrawBatch(ovbo, omsk, vofs, nobj, wmap->flgs & ~USE_OBJS);
+    DrawObjects(wmap, bchk, bofs, nbat, wmap->flgs & ~USE_OBJS);
+    StateReset();
+    if (!refl) ProfEnd(PRF_OBJS);
+    if (refl) glPopMatrix();
+}
 
-    for (y = 0; y < ndim; y++) {
-        dpos = (ndim + 1) + (y * (ndim + 1) << 1);
-        for (x = 0; x < ndim; x++) {
-            retn->vect[dpos].x = grid * (FLOAT)(x + 0.5) - 0.5 * grid * (FLOAT)ndim;
-            retn->vect[dpos].y = grid * (FLOAT)(y + 0.5) - 0.5 * grid * (FLOAT)ndim;
-            retn->vect[dpos].z = 0.25 * (retn->vect[dpos - ndim - 1].z
-                                      +  retn->vect[dpos - ndim - 0].z
-                                      +  retn->vect[dpos + ndim + 1].z
-                                      +  retn->vect[dpos + ndim + 2].z);
-            dpos++;
-        }
+
+
+/**
+  @brief SizeReflection
+  (re)creates the reflection framebuffer rfbo for a new window size; its
+  texture is the power of 2 that holds the window size shrunk by DEF_RSHF.
+  If the framebuffer turns out to be incomplete, it is deleted and rfbo is
+  left 0, so that the reflection falls back to the framebuffer.
+
+  @param xdim - width of the window.
+  @param ydim - height of the window.
+**/
+void SizeReflection(LONG xdim, LONG ydim) {
+    if (!glGenFramebuffersEXT) return;
+
+    rvpt.x = max(1, xdim >> DEF_RSHF);
+    rvpt.y = max(1, ydim >> DEF_RSHF);
+    for (rtsz.x = 1; rtsz.x < rvpt.x; rtsz.x <<= 1);
+    for (rtsz.y = 1; rtsz.y < rvpt.y; rtsz.y <<= 1);
+    if (!rfbo) {
+        glGenFramebuffersEXT(1, &rfbo);
+        glGenRenderbuffersEXT(1, &rdep);
+        glGenTextures(1, &rtex);
+        glBindTexture(GL_TEXTURE_2D, rtex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
+    glBindTexture(GL_TEXTURE_2D, rtex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, rtsz.x, rtsz.y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, rdep);
+    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24_ARB, rtsz.x, rtsz.y);
+    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, rfbo);
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, rtex, 0);
+    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rdep);
+    if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) {
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+        glDeleteFramebuffersEXT(1, &rfbo);
+        glDeleteRenderbuffersEXT(1, &rdep);
+        glDeleteTextures(1, &rtex);
+        rfbo = rdep = rtex = 0;
+        return;
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+}
 
-    for (fmax = i = 0; lscp[i].fhei > 0.0; i++)
-        fmax += lscp[i].fhei;
-    wclr = lscp[i].fclr.RGBA & 0xFFFFFF;
-    wtrn = lscp[i].fclr.A;
 
-    for (y = 0; y <= ndim; y++) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x <= ndim; x++) {
 
-            fmin = fmax * (retn->vect[dpos + x].z - wlvl) / (0.5 * fhei - wlvl);
-            i = 0;
-            while (lscp[i].fhei > 0.0 && (fmin -= lscp[i].fhei) > 0.0) i++;
-            if (lscp[i].fhei <= 0.0) i--;
+/**
+  @brief DrawReflection
+  draws the reflection of the world to rfbo, then goes back to sfbo and
+  makes texture unit 2 map it onto the screen position of whatever is drawn
+  next, so that the water shows it (see the texture environment set up in
+  WM_INITDIALOG).
+  Everything the reflection holds lies under the surface of the water, so
+  the near clipping plane is made oblique to match that surface (raised by
+  DEF_ROFS): all that is in front of it gets clipped and culled for free,
+  and no extra clip plane is needed, which the vertex shaders would have
+  to support.
+
+  @param wmap - the world; the camera shall already be set up.
+**/
+void DrawReflection(FMAP *wmap) {
+    FLOAT fmdl[16], fprj[16], fobl[16], fpln[4], fvec[4], fdot;
+
+    glGetFloatv(GL_MODELVIEW_MATRIX, fmdl);
+    glGetFloatv(GL_PROJECTION_MATRIX, fprj);
+    memcpy(fobl, fprj, sizeof(fobl));
+
+    fpln[0] = -fmdl[8];
+    fpln[1] = -fmdl[9];
+    fpln[2] = -fmdl[10];
+    fpln[3] = wmap->wlvl + DEF_ROFS - fpln[0] * fmdl[12] - fpln[1] * fmdl[13] - fpln[2] * fmdl[14];
+    #define SGN(f) (((f) > 0.0)? 1.0 : ((f) < 0.0)? -1.0 : 0.0)
+    fvec[0] = (SGN(fpln[0]) + fobl[8]) / fobl[0];
+    fvec[1] = (SGN(fpln[1]) + fobl[9]) / fobl[5];
+    fvec[2] = -1.0;
+    fvec[3] = (1.0 + fobl[10]) / fobl[14];
+    #undef SGN
+    fdot = 2.0 / (fpln[0] * fvec[0] + fpln[1] * fvec[1] + fpln[2] * fvec[2] + fpln[3] * fvec[3]);
+    fobl[2]  = fpln[0] * fdot;
+    fobl[6]  = fpln[1] * fdot;
+    fobl[10] = fpln[2] * fdot + 1.0;
+    fobl[14] = fpln[3] * fdot;
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadMatrixf(fobl);
+    glMatrixMode(GL_MODELVIEW);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, rfbo);
+    glPushAttrib(GL_VIEWPORT_BIT);
+    glViewport(0, 0, rvpt.x, rvpt.y);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glCullFace(GL_FRONT);
+    DrawMap(wmap, TRUE);
+    glCullFace(GL_BACK);
+    glPopAttrib();
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, sfbo);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+
+    glActTextureARB(GL_TEXTURE2_ARB);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glScalef((FLOAT)rvpt.x / (FLOAT)rtsz.x, (FLOAT)rvpt.y / (FLOAT)rtsz.y, 1.0);
+    glTranslatef(0.5, 0.5, 0.5);
+    glScalef(0.5, 0.5, 0.5);
+    glMultMatrixf(fprj);
+    glMatrixMode(GL_MODELVIEW);
+    glBindTexture(GL_TEXTURE_2D, rtex);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_TEXTURE_GEN_S);
+    glEnable(GL_TEXTURE_GEN_T);
+    glEnable(GL_TEXTURE_GEN_R);
+    glEnable(GL_TEXTURE_GEN_Q);
+    glActTextureARB(GL_TEXTURE0_ARB);
+}
 
-            retn->clrs[dpos + x].RGBA = lscp[i].fclr.RGBA | 0xFF000000;
-            if (retn->vect[dpos + x].z == wlvl) {
-                xl = (x > 0)?    x - 1 : ndim - 1;
-                xh = (x < ndim)? x     : 0;
-                yl = (y > 0)?    dpos - (ndim + 1) : (ndim + 1) + ((ndim - 1) * (ndim + 1) << 1);
-                yh = (y < ndim)? dpos + (ndim + 1) : (ndim + 1);
-                if ((retn->vect[xl + yl].z == wlvl) &&
-                    (retn->vect[xl + yh].z == wlvl) &&
-                    (retn->vect[xh + yl].z == wlvl) &&
-                    (retn->vect[xh + yh].z == wlvl))
-                     retn->clrs[dpos + x].RGBA = wclr | (wtrn * 0x1000000);
-            }
-        }
+
+
+/**
+  @brief DrawScene
+  draws a frame without swapping buffers: the world as seen from the current
+  camera, and the minimap that shows where the camera is. The reflection is
+  either drawn right into the framebuffer, where the water blends over it,
+  or to a texture the water samples (USE_REFL).
+
+  @param wmap - the world.
+**/
+void DrawScene(FMAP *wmap) {
+    FVEC ftmp;
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glPushMatrix();
+    glPushMatrix();
+    glRotatef(fang.v, 1, 0, 0);
+    glRotatef(fang.u, 0, 0, 1);
+    glTranslatef(ftrn.x, ftrn.y, ftrn.z);
+
+    glLightfv(GL_LIGHT0, GL_POSITION, lpos);
+    glLightfv(GL_LIGHT0, GL_SPOT_DIRECTION, ldir);
+
+    wmap->ftrn = ftrn;
+    ProfBegin(PRF_STRM);
+    StreamMap(wmap);
+    BakeMap(wmap);
+    ProfEnd(PRF_STRM);
+    if ((wmap->flgs & USE_REFL) && rfbo) {
+        ProfBegin(PRF_REFL);
+        DrawReflection(wmap);
+        ProfEnd(PRF_REFL);
+        DrawMap(wmap, FALSE);
+        glActTextureARB(GL_TEXTURE2_ARB);
+        glDisable(GL_TEXTURE_GEN_Q);
+        glDisable(GL_TEXTURE_GEN_R);
+        glDisable(GL_TEXTURE_GEN_T);
+        glDisable(GL_TEXTURE_GEN_S);
+        glDisable(GL_TEXTURE_2D);
+        glActTextureARB(GL_TEXTURE0_ARB);
     }
-    for (y = 0; y <= ndim; y++) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x <= ndim; x++) {
-            xl = x;
-            xh = (x < ndim)? x + 1 : 0;
-            yl = dpos;
-            yh = (y < ndim)? dpos + ((ndim + 1) << 1) : 0;
-            retn->clrs[dpos + x + (ndim + 1)].R = (retn->clrs[xl + yl].R
-                                                +  retn->clrs[xl + yh].R
-                                                +  retn->clrs[xh + yl].R
-                                                +  retn->clrs[xh + yh].R) >> 2;
-            retn->clrs[dpos + x + (ndim + 1)].G = (retn->clrs[xl + yl].G
-                                                +  retn->clrs[xl + yh].G
-                                                +  retn->clrs[xh + yl].G
-                                                +  retn->clrs[xh + yh].G) >> 2;
-            retn->clrs[dpos + x + (ndim + 1)].B = (retn->clrs[xl + yl].B
-                                                +  retn->clrs[xl + yh].B
-                                                +  retn->clrs[xh + yl].B
-                                                +  retn->clrs[xh + yh].B) >> 2;
-            retn->clrs[dpos + x + (ndim + 1)].A = 255;
-            if (retn->vect[dpos + x + (ndim + 1)].z == wlvl) {
-                i = (((retn->clrs[xl + yl].A == wtrn)? 0 : 1)  +
-                     ((retn->clrs[xl + yh].A == wtrn)? 0 : 1)  +
-                     ((retn->clrs[xh + yl].A == wtrn)? 0 : 1)  +
-                     ((retn->clrs[xh + yh].A == wtrn)? 0 : 1)) * (255 - wtrn);
-                if (!i) retn->clrs[dpos + x + (ndim + 1)].RGBA = wclr;
-                retn->clrs[dpos + x + (ndim + 1)].A = wtrn + (i >> 2);
-            }
-        }
+    else {
+        ProfBegin(PRF_REFL);
+        glCullFace(GL_FRONT);
+        DrawMap(wmap, TRUE);
+        glCullFace(GL_BACK);
+        ProfEnd(PRF_REFL);
+        DrawMap(wmap, FALSE);
     }
 
-    for (y = 0; y <= ndim; y++) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x <= ndim; x++) {
-            retn->norm[dpos + x].x = retn->vect[dpos + ((x > 0)?    x - 1 : ndim - 1)].z
-                                   - retn->vect[dpos + ((x < ndim)? x + 1 : 1)].z;
-            retn->norm[dpos + x].y = retn->vect[   x + ((y > 0)?    dpos - ((ndim + 1) << 1) : (ndim - 1) * (ndim + 1) << 1)].z
-                                   - retn->vect[   x + ((y < ndim)? dpos + ((ndim + 1) << 1) : (ndim + 1) << 1)].z;
-        }
-    }
-    for (y = 0; y < ndim; y++) {
-        dpos = (ndim + 1) + (y * (ndim + 1) << 1);
-        for (x = 0; x < ndim; x++) {
-            retn->norm[dpos + x].x = retn->vect[dpos + ((x > 0)?        x - 1 : ndim - 1)].z
-                                   - retn->vect[dpos + ((x < ndim - 1)? x + 1 : 0)].z;
-            retn->norm[dpos + x].y = retn->vect[   x + ((y > 0)?        dpos - ((ndim + 1) << 1) : (ndim + 1) + ((ndim - 1) * (ndim + 1) << 1))].z
-                                   - retn->vect[   x + ((y < ndim - 1)? dpos + ((ndim + 1) << 1) : (ndim + 1))].z;
-        }
-    }
-    for (y = ndim << 1; y >= 0; y--)
-        for (dpos = ndim + (x = y * (ndim + 1)); x <= dpos; x++) {
-            retn->norm[x].z = 2.0 * grid;
-            fmax = 1.0 / sqrt(retn->norm[x].x * retn->norm[x].x
-                            + retn->norm[x].y * retn->norm[x].y
-                            + retn->norm[x].z * retn->norm[x].z);
-            retn->norm[x].x *= fmax;
-            retn->norm[x].y *= fmax;
-            retn->norm[x].z *= fmax;
-        }
-
-    retn->ntex = MakeFacetTex(64);
-    for (y = ndim; y >= 0; y--) {
-        dpos = y * (ndim + 1) << 1;
-        for (x = 0; x <= ndim; x++) {
-            retn->texc[dpos].u = (FLOAT)x;
-            retn->texc[dpos].v = (FLOAT)y;
-            retn->texc[dpos + (ndim + 1)].u = (FLOAT)x + 0.5;
-            retn->texc[dpos + (ndim + 1)].v = (FLOAT)y + 0.5;
-            dpos++;
-        }
-    }
-    if (glGenBuffersARB) {
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, retn->iind);
-        glBufferDataARB(GL_INDEX_BUFFER_ARB, (1 + (retn->ndot >> 1)) * sizeof(FTRI), retn->indx, GL_STATIC_DRAW_ARB);
+    glPopMatrix();
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->ivec);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FVEC), retn->vect, GL_STATIC_DRAW_ARB);
+    ProfBegin(PRF_MINI);
+    glDisable(GL_FOG);
+    glDisable(GL_LIGHTING);
+    glClear(GL_DEPTH_BUFFER_BIT);
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->iclr);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FCLR), retn->clrs, GL_STATIC_DRAW_ARB);
+    #define DEF_QUAD 5.0
+    ftmp.x = -ftrn.x * DEF_QUAD / wmap->grid;
+    ftmp.y = -ftrn.y * DEF_QUAD / wmap->grid;
+    ftmp.z = -(ftrn.z + wmap->wlvl) * DEF_QUAD / wmap->grid;
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->inrm);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FVEC), retn->norm, GL_STATIC_DRAW_ARB);
+    glTranslatef(0.0, -10.0, -50.0);
+    glRotatef(fang.v, 1, 0, 0);
+    glRotatef(fang.u, 0, 0, 1);
+    glTranslatef(-ftmp.x, -ftmp.y, 0.0);
 
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, retn->itex);
-        glBufferDataARB(GL_ARRAY_BUFFER_ARB, retn->ndot * sizeof(FTEX), retn->texc, GL_STATIC_DRAW_ARB);
+    glBegin(GL_LINES);
+        glColor4ub(255, 255, 255, 255);
+        glVertex3f(-DEF_QUAD, -DEF_QUAD, 0.0);
+        glVertex3f(-DEF_QUAD, DEF_QUAD, 0.0);
 
-        glBindBufferARB(GL_INDEX_BUFFER_ARB, 0);
-        glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-    }
+        glVertex3f(DEF_QUAD, -DEF_QUAD, 0.0);
+        glVertex3f(DEF_QUAD, DEF_QUAD, 0.0);
 
-    retn->wlvl = wlvl;
-    retn->seed = seed;
-    retn->flgs = flgs;
-    retn->ndim = ndim;
-    retn->grid = (FLOAT)ndim * grid;
-    retn->npol = 3 * 4 * ndim * ndim;
-    retn->next = ObjectVBO(retn, DEF_NOBJ);
+        glVertex3f(-DEF_QUAD, -DEF_QUAD, 0.0);
+        glVertex3f(DEF_QUAD,  -DEF_QUAD, 0.0);
 
-    if (file) Serialize(file, retn);
-    return retn;
+        glVertex3f(-DEF_QUAD, DEF_QUAD, 0.0);
+        glVertex3f(DEF_QUAD,  DEF_QUAD, 0.0);
+
+        glVertex3f(-DEF_QUAD, 0.0, 0.0);
+        glVertex3f(DEF_QUAD,  0.0, 0.0);
+
+        glVertex3f(0.0, -DEF_QUAD, 0.0);
+        glVertex3f(0.0, DEF_QUAD,  0.0);
+
+        glVertex3f(0.0, 0.0, 0.0);
+        glVertex3f(0.0, 0.0, 0.5 * DEF_QUAD);
+
+        glColor4ub(255, 0, 0, 255);
+        glVertex3f(ftmp.x, ftmp.y, 0.0);
+        glVertex3f(ftmp.x, ftmp.y, ftmp.z);
+    glEnd();
+
+    glBegin(GL_POINTS);
+        glVertex3f(ftmp.x, ftmp.y, ftmp.z);
+    glEnd();
+    #undef DEF_QUAD
+
+    glEnable(GL_LIGHTING);
+    glEnable(GL_FOG);
+    ProfEnd(PRF_MINI);
+
+    glPopMatrix();
 }
 
 
 
 /**
   @brief Deserialize
-  reads VBO creation parameters from a file, then creates the VBO.
+  reads world creation parameters from a file, then creates the world.
   May skip the reading part and use preloaded values instead.
   Both flgs and seed are overridden by the values read from the file.
+  The camera and the light (either read or reset) are stored in the world
+  and do not become current until ShowMap() is called.
 
-  @param file - file from which the VBO shall be deserialized.
+  @param file - file from which the world shall be deserialized.
   @param open - defines if reading is necessary.
   @param flgs - flags (see FVBO::flgs).
   @param seed - PRNG seed; 0 means "not specified, needs to be generated now".
 
-  @return FVBO on success, NULL on failure.
+  @return FMAP on success, NULL on failure.
 **/
-FVBO *Deserialize(LPSTR file, BOOL open, UINT flgs, UINT seed) {
+FMAP *Deserialize(LPSTR file, BOOL open, UINT flgs, UINT seed) {
+    FLOAT cpos[4], cdir[4];
+    FVEC ctrn = ftrn;
+    FTEX cang = fang;
+    FMAP *retn;
     FILE *filp;
-    FHEI lscp[] = {{.fhei = 0.1, .fclr.RGBA = 0xFF76DDFC},
-                   {.fhei = 8.0, .fclr.RGBA = 0xFF30A15D},
-                   {.fhei = 6.5, .fclr.RGBA = 0xFF808080},
-                   {.fhei = 5.0, .fclr.RGBA = 0xFFFFFFFF},
-                   {.fhei = 0.0, .fclr.RGBA = 0x80AC630D}};
 
+    memcpy(cpos, lpos, sizeof(lpos));
+    memcpy(cdir, ldir, sizeof(ldir));
     CamLightReset();
     if (!seed) seed = rand() * time(0);
     if (open && (filp = fopen(file, "rb"))) {
@@ -1107,30 +6907,47 @@ FVBO *Deserialize(LPSTR file, BOOL open, UINT flgs, UINT seed) {
         fclose(filp);
         file = NULL;
     }
-    return LandscapeVBO(DEF_LPWR, flgs, seed, DEF_GRID, DEF_FHEI, DEF_WLVL, lscp, file);
+    if ((retn = MakeMap(DEF_WCHK, DEF_LPWR, flgs, seed, DEF_GRID, DEF_FHEI, DEF_WLVL, dlsc, file))) {
+        retn->ftrn = ftrn;
+        retn->fang = fang;
+        memcpy(retn->lpos, lpos, sizeof(lpos));
+        memcpy(retn->ldir, ldir, sizeof(ldir));
+    }
+    ftrn = ctrn;
+    fang = cang;
+    memcpy(lpos, cpos, sizeof(lpos));
+    memcpy(ldir, cdir, sizeof(ldir));
+    return retn;
 }
 
 
 
 /**
-  @brief tmrcount
-  handles the timer that recomputes the scene.
-  No parameters except pUsr are used.
-
-  @param pUsr - handle of the main drawing surface.
+  @brief MoveCamera
+  moves the camera according to the keys pressed, keeping it DEF_FCAM above
+  the landscape (see MapHeight()), and shows the frame rate in the window
+  title once a second. Called by the render loop before each frame, on the
+  same thread that handles input and draws.
+
+  @param hDlg - handle of the main drawing surface.
+  @param fdlt - time elapsed since the previous frame, in seconds.
 **/
-void CALLBACK tmrcount(UINT uTmr, UINT uMsg, DWORD pUsr, DWORD pdR1, DWORD pdR2) {
+void MoveCamera(HWND hDlg, FLOAT fdlt) {
     UINT tnew = GetTickCount();
+    FLOAT fdst = DEF_FTRN * fdlt;
 
     if (keys['S'] | keys['W']) {
-        ftrn.x += ((keys['W'])? DEF_FTRN : -DEF_FTRN) * sin(fang.u * DEG_CRAD) * sin(fang.v * DEG_CRAD);
-        ftrn.y += ((keys['W'])? DEF_FTRN : -DEF_FTRN) * cos(fang.u * DEG_CRAD) * sin(fang.v * DEG_CRAD);
-        ftrn.z += ((keys['W'])? DEF_FTRN : -DEF_FTRN) * cos(fang.v * DEG_CRAD);
+        ftrn.x += ((keys['W'])? fdst : -fdst) * sin(fang.u * DEG_CRAD) * sin(fang.v * DEG_CRAD);
+        ftrn.y += ((keys['W'])? fdst : -fdst) * cos(fang.u * DEG_CRAD) * sin(fang.v * DEG_CRAD);
+        ftrn.z += ((keys['W'])? fdst : -fdst) * cos(fang.v * DEG_CRAD);
     }
     if (keys['D'] | keys['A']) {
-        ftrn.x += ((keys['A'])? DEF_FTRN : -DEF_FTRN) * cos(fang.u * DEG_CRAD);
-        ftrn.y -= ((keys['A'])? DEF_FTRN : -DEF_FTRN) * sin(fang.u * DEG_CRAD);
+        ftrn.x += ((keys['A'])? fdst : -fdst) * cos(fang.u * DEG_CRAD);
+        ftrn.y -= ((keys['A'])? fdst : -fdst) * sin(fang.u * DEG_CRAD);
     }
+    fdst = MapHeight(land, -ftrn.x, -ftrn.y) + DEF_FCAM;
+    if (-ftrn.z < fdst)
+        ftrn.z = -fdst;
     if (ftrn.x >  0.5 * land->grid) {
         ftrn.x -= land->grid;
         lpos[0]+= land->grid;
@@ -1155,21 +6972,200 @@ void CALLBACK tmrcount(UINT uTmr, UINT uMsg, DWORD pUsr, DWORD pdR1, DWORD pdR2)
                 1000.0 * (FLOAT)fram / (FLOAT)(tnew - tick));
         tick = tnew;
         fram = 0;
-        SendMessage((HWND)pUsr, WM_SETTEXT, 0, (LPARAM)fstr);
+        SendMessage(hDlg, WM_SETTEXT, 0, (LPARAM)fstr);
     }
 }
 
 
 
 /**
-  @brief tmrpaint
-  handles the timer that repaints the scene.
-  No parameters except pUsr are used.
+  @brief RunBenchmark
+  generates a single tile map of every size from 2^DEF_BPMN to 2^DEF_BPMX for
+  each of the DEF_BNUM seeds, timing every stage of generation, then flies
+  the camera around each map for DEF_BFRM frames, timing every frame.
+  Shall be called before the worker threads are started, so that all the
+  stages run on this thread and are timed one after another.
+
+  @param hDlg - handle of the main drawing surface.
+  @param file - file to write the results to; JSON if it ends with DEF_BJSN,
+                CSV otherwise.
+**/
+void RunBenchmark(HWND hDlg, LPSTR file) {
+    LARGE_INTEGER freq, tbgn, tend;
+    LONGLONG tres[BEN_NSTG];
+    FLOAT ftim[DEF_BFRM], fmsc;
+    UINT x, seed, lpwr, nrun;
+    BOOL json;
+    FMAP *wmap;
+    FILE *filp;
+    RECT rect;
+
+    if (!(filp = fopen(file, "w"))) return;
+    json = (file = strstr(file, DEF_BJSN)) && (strlen(file) == strlen(DEF_BJSN));
+
+    QueryPerformanceFrequency(&freq);
+    fmsc = 1000.0 / (FLOAT)freq.QuadPart;
+    ShowWindow(hDlg, SW_SHOW);
+    GetClientRect(hDlg, &rect);
+    SendMessage(hDlg, WM_SIZE, SIZE_RESTORED, MAKELPARAM(rect.right, rect.bottom));
+
+    fprintf(filp, (json)? "[" : "seed,ndim,hmap_ms,blur_ms,surf_ms,objs_ms,upld_ms,p50_ms,p90_ms,p99_ms,pmax_ms\n");
+    btim = tres;
+    for (nrun = 0, seed = 1; seed <= DEF_BNUM; seed++)
+        for (lpwr = DEF_BPMN; lpwr <= DEF_BPMX; lpwr++) {
+            memset(tres, 0, sizeof(tres));
+            CamLightReset();
+            if (!(wmap = MakeMap(1, lpwr, DEF_FLGS, seed, DEF_GRID, DEF_FHEI, DEF_WLVL, dlsc, NULL)))
+                continue;
+            wmap->ftrn = ftrn;
+            while (StreamMap(wmap));
+            glFinish();
+
+            for (x = 0; x < DEF_BFRM; x++) {
+                fang.u = 360.0 * (FLOAT)x / (FLOAT)DEF_BFRM;
+                ftrn.x = DEF_TRNX - 0.25 * wmap->grid * sin(fang.u * DEG_CRAD);
+                ftrn.y = DEF_TRNY - 0.25 * wmap->grid * cos(fang.u * DEG_CRAD);
+                QueryPerformanceCounter(&tbgn);
+                DrawScene(wmap);
+                SwapBuffers(DC);
+                glFinish();
+                QueryPerformanceCounter(&tend);
+                ftim[x] = (FLOAT)(tend.QuadPart - tbgn.QuadPart) * fmsc;
+            }
+            FreeMap(&wmap);
+            qsort(ftim, DEF_BFRM, sizeof(FLOAT), FloatOrder);
+
+            #define PCT(p) ftim[(DEF_BFRM - 1) * (p) / 100]
+            #define STG(s) ((FLOAT)tres[s] * fmsc)
+            fprintf(filp, (json)? "%s\n  {\"seed\": %u, \"ndim\": %u, \"hmap_ms\": %0.3f, \"blur_ms\": %0.3f, "
+                                    "\"surf_ms\": %0.3f, \"objs_ms\": %0.3f, \"upld_ms\": %0.3f, "
+                                    "\"p50_ms\": %0.3f, \"p90_ms\": %0.3f, \"p99_ms\": %0.3f, \"pmax_ms\": %0.3f}"
+                                : "%s%u,%u,%0.3f,%0.3f,%0.3f,%0.3f,%0.3f,%0.3f,%0.3f,%0.3f,%0.3f\n",
+                   (json && nrun)? "," : "", seed, 1 << lpwr,
+                    STG(BEN_HMAP), STG(BEN_BLUR), STG(BEN_SURF), STG(BEN_OBJS), STG(BEN_UPLD),
+                    PCT(50), PCT(90), PCT(99), PCT(100));
+            #undef STG
+            #undef PCT
+            nrun++;
+        }
+    btim = NULL;
+    if (json) fprintf(filp, "\n]\n");
+    fclose(filp);
+    CamLightReset();
+}
+
+
 
-  @param pUsr - handle of the main drawing surface.
+/**
+  @brief RunBatch
+  generates a world for every seed in the list, DEF_GMAP at a time, so that
+  the workers go on with the chunks of the next world while the previous one
+  is finished. Once all chunks around the start camera (the ones StreamMap()
+  draws and prefetches) are done, and thus stored to the tile cache, the
+  world is drawn to an offscreen framebuffer as seen from that camera, and
+  the image goes to DEF_GDIR as a DEF_GDIM x DEF_GDIM BMP named after the
+  seed. Without EXT_framebuffer_object only the tiles are made, since the
+  window is never shown and its pixels cannot be read back.
+  Shall be called after the worker threads are started.
+
+  @param hDlg - handle of the main drawing surface.
+  @param file - text file with a seed per line, decimal or 0x-prefixed hex;
+                lines that do not start with a number are skipped, and so
+                are seeds equal to 0, which Deserialize() would randomize;
+                the latter are reported to DEF_GLOG.
 **/
-void CALLBACK tmrpaint(UINT uTmr, UINT uMsg, DWORD pUsr, DWORD pdR1, DWORD pdR2) {
-    if (paint) InvalidateRect((HWND)pUsr, NULL, FALSE);
+void RunBatch(HWND hDlg, LPSTR file) {
+    FMAP *wmap[DEF_GMAP] = {};
+    BITMAPFILEHEADER bfhd = {};
+    BITMAPINFOHEADER bihd = {};
+    CHAR line[MAX_PATH], *lend;
+    UINT seed, rclr, rdpt, nlin = 0, i;
+    FILE *filp, *fimg;
+    BOOL fend, busy;
+    BYTE *bits;
+
+    if (!(filp = fopen(file, "r"))) return;
+    if (glGenFramebuffersEXT) {
+        glGenFramebuffersEXT(1, &sfbo);
+        glGenRenderbuffersEXT(1, &rclr);
+        glGenRenderbuffersEXT(1, &rdpt);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, rclr);
+        glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_RGB8, DEF_GDIM, DEF_GDIM);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, rdpt);
+        glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24_ARB, DEF_GDIM, DEF_GDIM);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, sfbo);
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, rclr);
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rdpt);
+        i = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+        if (i != GL_FRAMEBUFFER_COMPLETE_EXT) {
+            glDeleteFramebuffersEXT(1, &sfbo);
+            sfbo = 0;
+        }
+    }
+    SendMessage(hDlg, WM_SIZE, SIZE_RESTORED, MAKELPARAM(DEF_GDIM, DEF_GDIM));
+    CreateDirectory(DEF_GDIR, NULL);
+
+    bits = (BYTE*)malloc(DEF_GDIM * DEF_GDIM * 3);
+    bfhd.bfType = 0x4D42;
+    bfhd.bfOffBits = sizeof(bfhd) + sizeof(bihd);
+    bfhd.bfSize = bfhd.bfOffBits + DEF_GDIM * DEF_GDIM * 3;
+    bihd.biSize = sizeof(bihd);
+    bihd.biWidth = bihd.biHeight = DEF_GDIM;
+    bihd.biPlanes = 1;
+    bihd.biBitCount = 24;
+    bihd.biCompression = BI_RGB;
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    fend = FALSE;
+    do {
+        for (busy = FALSE, i = 0; i < DEF_GMAP; i++) {
+            while (!wmap[i] && !fend)
+                if (!(fend = !fgets(line, MAX_PATH, filp))) {
+                    nlin++;
+                    seed = strtoul(line, &lend, 0);
+                    if ((lend != line) && seed)
+                        wmap[i] = Deserialize(NULL, FALSE, DEF_FLGS, seed);
+                    else if ((lend != line) && (fimg = fopen(DEF_GDIR "\\" DEF_GLOG, "a"))) {
+                        fprintf(fimg, "%s, line %u: seed 0 stands for a random one, skipped\n", file, nlin);
+                        fclose(fimg);
+                    }
+                }
+            if (!wmap[i]) continue;
+            busy = TRUE;
+            if (StreamMap(wmap[i]) || wmap[i]->njob) continue;
+
+            if (sfbo) {
+                ShowMap(wmap[i]);
+                glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, sfbo);
+                DrawScene(wmap[i]);
+                glReadPixels(0, 0, DEF_GDIM, DEF_GDIM, GL_BGR_EXT, GL_UNSIGNED_BYTE, bits);
+                glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+                sprintf(line, "%s\\%08X.bmp", DEF_GDIR, wmap[i]->seed);
+                if ((fimg = fopen(line, "wb"))) {
+                    fwrite(&bfhd, sizeof(bfhd), 1, fimg);
+                    fwrite(&bihd, sizeof(bihd), 1, fimg);
+                    fwrite(bits, 1, DEF_GDIM * DEF_GDIM * 3, fimg);
+                    fclose(fimg);
+                }
+            }
+            FreeMap(&wmap[i]);
+        }
+        Sleep(1);
+    } while (busy);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    free(bits);
+    fclose(filp);
+    if (glGenFramebuffersEXT) {
+        glDeleteRenderbuffersEXT(1, &rclr);
+        glDeleteRenderbuffersEXT(1, &rdpt);
+    }
+    if (sfbo) glDeleteFramebuffersEXT(1, &sfbo);
+    sfbo = 0;
+    CamLightReset();
 }
 
 
@@ -1190,6 +7186,9 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
         case WM_INITDIALOG: {
             PIXELFORMATDESCRIPTOR pfd = {sizeof(pfd), 1, PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER, PFD_TYPE_RGBA, 32};
             FLOAT fogc[] = {0.75, 0.75, 1.0, 1.0};
+            LARGE_INTEGER freq;
+            GLint vtxu = 0, ntxu = 0;
+            FCLR *ctex;
 
             paint = FALSE;
             DC = GetDC(hDlg);
@@ -1227,23 +7226,204 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
                 glGenBuffersARB = wglGetProcAddress("glGenBuffersARB");
                 glBindBufferARB = wglGetProcAddress("glBindBufferARB");
                 glBufferDataARB = wglGetProcAddress("glBufferDataARB");
+                glBufferSubDataARB = wglGetProcAddress("glBufferSubDataARB");
                 glDelBuffersARB = wglGetProcAddress("glDeleteBuffersARB");
+                glMapBufferARB = wglGetProcAddress("glMapBufferARB");
+                glUnmapBufferARB = wglGetProcAddress("glUnmapBufferARB");
+                if (strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_map_buffer_range "))
+                    glMapBufferRange = wglGetProcAddress("glMapBufferRange");
             }
-            land = Deserialize(path, TRUE, USE_ARBV | USE_FILL | USE_NORM | USE_TEXC | USE_CLRS | USE_OBJS, 0);
-
-            tmrc = timeSetEvent(DEF_TMRC, 0, tmrcount, (DWORD)hDlg, TIME_PERIODIC);
-            tmrp = timeSetEvent(DEF_TMRP, 0, tmrpaint, (DWORD)hDlg, TIME_PERIODIC);
+            if (strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_sync ")) {
+                glFenceSync = wglGetProcAddress("glFenceSync");
+                glClientWaitSync = wglGetProcAddress("glClientWaitSync");
+                glDeleteSync = wglGetProcAddress("glDeleteSync");
+            }
+            if (strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_shader_objects ")
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_vertex_shader ")) {
+                glCreateShaderObjectARB    = wglGetProcAddress("glCreateShaderObjectARB");
+                glShaderSourceARB          = wglGetProcAddress("glShaderSourceARB");
+                glCompileShaderARB         = wglGetProcAddress("glCompileShaderARB");
+                glCreateProgramObjectARB   = wglGetProcAddress("glCreateProgramObjectARB");
+                glAttachObjectARB          = wglGetProcAddress("glAttachObjectARB");
+                glLinkProgramARB           = wglGetProcAddress("glLinkProgramARB");
+                glUseProgramObjectARB      = wglGetProcAddress("glUseProgramObjectARB");
+                glGetObjectParameterivARB  = wglGetProcAddress("glGetObjectParameterivARB");
+                glDeleteObjectARB          = wglGetProcAddress("glDeleteObjectARB");
+                glGetUniformLocationARB    = wglGetProcAddress("glGetUniformLocationARB");
+                glUniform1fARB             = wglGetProcAddress("glUniform1fARB");
+                glUniform3fvARB            = wglGetProcAddress("glUniform3fvARB");
+                glUniform1iARB             = wglGetProcAddress("glUniform1iARB");
+                glUniform2fARB             = wglGetProcAddress("glUniform2fARB");
+                glUniform3fARB             = wglGetProcAddress("glUniform3fARB");
+                glUniform1fvARB            = wglGetProcAddress("glUniform1fvARB");
+                glUniform4fvARB            = wglGetProcAddress("glUniform4fvARB");
+                glUniform4iARB             = wglGetProcAddress("glUniform4iARB");
+                glActTextureARB            = wglGetProcAddress("glActiveTextureARB");
+            }
+            if (strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_EXT_framebuffer_object ")
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_texture_env_combine ")
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_multitexture ")) {
+                FLOAT fpln[4][4] = {{1.0, 0.0, 0.0, 0.0}, {0.0, 1.0, 0.0, 0.0}, {0.0, 0.0, 1.0, 0.0}, {0.0, 0.0, 0.0, 1.0}};
+                FLOAT fone[4] = {0.0, 0.0, 0.0, 1.0};
+
+                glGenFramebuffersEXT         = wglGetProcAddress("glGenFramebuffersEXT");
+                glBindFramebufferEXT         = wglGetProcAddress("glBindFramebufferEXT");
+                glFramebufferTexture2DEXT    = wglGetProcAddress("glFramebufferTexture2DEXT");
+                glFramebufferRenderbufferEXT = wglGetProcAddress("glFramebufferRenderbufferEXT");
+                glCheckFramebufferStatusEXT  = wglGetProcAddress("glCheckFramebufferStatusEXT");
+                glDeleteFramebuffersEXT      = wglGetProcAddress("glDeleteFramebuffersEXT");
+                glGenRenderbuffersEXT        = wglGetProcAddress("glGenRenderbuffersEXT");
+                glBindRenderbufferEXT        = wglGetProcAddress("glBindRenderbufferEXT");
+                glRenderbufferStorageEXT     = wglGetProcAddress("glRenderbufferStorageEXT");
+                glDeleteRenderbuffersEXT     = wglGetProcAddress("glDeleteRenderbuffersEXT");
+                glActTextureARB              = wglGetProcAddress("glActiveTextureARB");
+
+                glActTextureARB(GL_TEXTURE2_ARB);
+                glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE_ARB);
+                glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB_ARB, GL_INTERPOLATE_ARB);
+                glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB_ARB, GL_PREVIOUS_ARB);
+                glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB_ARB, GL_TEXTURE);
+                glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE2_RGB_ARB, GL_PRIMARY_COLOR_ARB);
+                glTexEnvi(GL_TEXTURE_ENV, GL_OPERAND2_RGB_ARB, GL_SRC_ALPHA);
+                glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_ALPHA_ARB, GL_REPLACE);
+                glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_ALPHA_ARB, GL_CONSTANT_ARB);
+                glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, fone);
+                glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+                glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+                glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+                glTexGeni(GL_Q, GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+                glTexGenfv(GL_S, GL_EYE_PLANE, fpln[0]);
+                glTexGenfv(GL_T, GL_EYE_PLANE, fpln[1]);
+                glTexGenfv(GL_R, GL_EYE_PLANE, fpln[2]);
+                glTexGenfv(GL_Q, GL_EYE_PLANE, fpln[3]);
+                glActTextureARB(GL_TEXTURE0_ARB);
+            }
+            glGetIntegerv(GL_MAX_TEXTURE_UNITS_ARB, &ntxu);
+            if (glActTextureARB && (ntxu > 3)
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_texture_non_power_of_two ")) {
+                glActTextureARB(GL_TEXTURE3_ARB);
+                glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
+                glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
+                glActTextureARB(GL_TEXTURE0_ARB);
+                blgt = TRUE;
+            }
+            QueryPerformanceFrequency(&freq);
+            prof.fmsc = 1000.0 / (FLOAT)freq.QuadPart;
+            if (strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_timer_query ")
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_occlusion_query ")) {
+                glGenQueriesARB       = wglGetProcAddress("glGenQueriesARB");
+                glDeleteQueriesARB    = wglGetProcAddress("glDeleteQueriesARB");
+                glBeginQueryARB       = wglGetProcAddress("glBeginQueryARB");
+                glEndQueryARB         = wglGetProcAddress("glEndQueryARB");
+                glGetQueryObjectui64v = wglGetProcAddress("glGetQueryObjectui64v");
+                if (glGenQueriesARB && glGetQueryObjectui64v)
+                    glGenQueriesARB(DEF_PQRY * PRF_NPHS, prof.iqry[0]);
+            }
+            if (glCreateShaderObjectARB && strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_draw_instanced ")) {
+                glDrawElementsInstancedARB = wglGetProcAddress("glDrawElementsInstancedARB");
+                if ((ishd = MakeProgram(vins, NULL))) {
+                    iofs = glGetUniformLocationARB(ishd, "fofs");
+                    iscl = glGetUniformLocationARB(ishd, "fscl");
+                    ibak = glGetUniformLocationARB(ishd, "lbak");
+                }
+            }
+            if (glCreateShaderObjectARB && glGenBuffersARB && (oshd = MakeProgram(vobs, NULL)))
+                oofs = glGetUniformLocationARB(oshd, "oofs");
+            fgmp = !!strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_SGIS_generate_mipmap ");
+            fdxt = !!strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_EXT_texture_compression_s3tc ");
+            otex = LoadFacetTex(ctex = MakeFacetTex(64, DEF_KOBJ), FALSE);
+            PoolFree(ctex);
+            glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS_ARB, &vtxu);
+            if (glCreateShaderObjectARB && glGenBuffersARB && (vtxu > 0)
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_texture_float ")
+            && (dshd = MakeProgram(vdsp, NULL))) {
+                dprm = glGetUniformLocationARB(dshd, "dprm");
+                dflg = glGetUniformLocationARB(dshd, "dflg");
+                dhei = glGetUniformLocationARB(dshd, "dhei");
+                dclr = glGetUniformLocationARB(dshd, "dclr");
+                dnum = glGetUniformLocationARB(dshd, "dnum");
+                dbak = glGetUniformLocationARB(dshd, "lbak");
+                glUseProgramObjectARB(dshd);
+                glUniform1iARB(glGetUniformLocationARB(dshd, "hmap"), 1);
+                glUseProgramObjectARB(0);
+            }
+            if (dshd && glGenFramebuffersEXT && glUniform4iARB
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_EXT_gpu_shader4 ")
+            &&  strstr((LPSTR)glGetString(GL_EXTENSIONS), "GL_ARB_fragment_shader ")
+            && (hshd = MakeProgram(NULL, fgen))) {
+                hmod = glGetUniformLocationARB(hshd, "gmod");
+                hsed = glGetUniformLocationARB(hshd, "gsed");
+                hcur = glGetUniformLocationARB(hshd, "gcur");
+                hpre = glGetUniformLocationARB(hshd, "gpre");
+                hhdf = glGetUniformLocationARB(hshd, "ghdf");
+                hblr = glGetUniformLocationARB(hshd, "gblr");
+                hnbl = glGetUniformLocationARB(hshd, "gnbl");
+                hnrm = glGetUniformLocationARB(hshd, "gnrm");
+                glUseProgramObjectARB(hshd);
+                glUniform1iARB(glGetUniformLocationARB(hshd, "hsrc"), 0);
+                glUseProgramObjectARB(0);
+                ResizeHeightmap(1);
+                glGenFramebuffersEXT(1, &hfbo);
+                glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, hfbo);
+                glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, htex[0], 0);
+                if (glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) != GL_FRAMEBUFFER_COMPLETE_EXT) {
+                    glDeleteFramebuffersEXT(1, &hfbo);
+                    glDeleteTextures(2, htex);
+                    glDeleteObjectARB(hshd);
+                    hfbo = htex[0] = htex[1] = hshd = 0;
+                }
+                glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, sfbo);
+            }
+            if (bout) {
+                RunBenchmark(hDlg, bout);
+                StartWorkers();
+                PostMessage(hDlg, WM_CLOSE, 0, 0);
+                return TRUE;
+            }
+            if (slst) {
+                StartWorkers();
+                RunBatch(hDlg, slst);
+                PostMessage(hDlg, WM_CLOSE, 0, 0);
+                return TRUE;
+            }
+            if ((wglSwapIntervalEXT = wglGetProcAddress("wglSwapIntervalEXT")))
+                wglSwapIntervalEXT(1);
+            StartWorkers();
+            land = Deserialize(path, TRUE, DEF_FLGS, 0);
+            ShowMap(land);
+            while (StreamMap(land))
+                Sleep(1);
             return paint = TRUE;
         }
 
 
         case WM_CLOSE:
             paint = FALSE;
-            timeKillEvent(tmrp);
-            timeKillEvent(tmrc);
             if (land) {
                 Serialize(path, land);
-                FreeVBO(&land);
+                FreeMap(&land);
+            }
+            FreeMap(&lnew);
+            StopWorkers();
+            if (ishd) glDeleteObjectARB(ishd);
+            if (oshd) glDeleteObjectARB(oshd);
+            glDeleteTextures(1, &otex);
+            ClearFacetTex();
+            if (prof.iqry[0][0]) glDeleteQueriesARB(DEF_PQRY * PRF_NPHS, prof.iqry[0]);
+            if (prof.font) glDeleteLists(prof.font, 128);
+            if (rfbo) {
+                glDeleteFramebuffersEXT(1, &rfbo);
+                glDeleteRenderbuffersEXT(1, &rdep);
+                glDeleteTextures(1, &rtex);
+            }
+            if (dshd) {
+                glDeleteObjectARB(dshd);
+                glDelBuffersARB(32, dgrd);
+            }
+            if (hshd) {
+                glDeleteObjectARB(hshd);
+                glDeleteFramebuffersEXT(1, &hfbo);
+                glDeleteTextures(2, htex);
             }
             wglMakeCurrent(NULL, NULL);
             wglDeleteContext(RC);
@@ -1272,7 +7452,10 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
                     break;
 
                 case 'Z':
-                    if (glGenBuffersARB) land->flgs ^= USE_ARBV;
+                    if (glGenBuffersARB) {
+                        land->flgs ^= USE_ARBV;
+                        if (!(land->flgs & USE_ARBV)) FlushMap(land);
+                    }
                     break;
 
                 case 'X':
@@ -1294,6 +7477,55 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
                 case 'N':
                     land->flgs ^= USE_OBJS;
                     break;
+
+                case 'L':
+                    land->flgs ^= USE_LODS;
+                    break;
+
+                case 'P':
+                    land->flgs ^= USE_PACK;
+                    FlushMap(land);
+                    break;
+
+                case 'I':
+                    if (ishd) land->flgs ^= USE_INST;
+                    break;
+
+                case 'H':
+                    if (dshd) {
+                        land->flgs ^= USE_DISP;
+                        FlushMap(land);
+                    }
+                    break;
+
+                case 'R':
+                    if (rfbo) land->flgs ^= USE_REFL;
+                    break;
+
+                case 'J':
+                    if (blgt) land->flgs ^= USE_BAKE;
+                    break;
+
+                case 'M':
+                    FreeMap(&lnew);
+                    lnew = Deserialize(path, FALSE, land->flgs ^ USE_FBMN, land->seed);
+                    break;
+
+                case 'O':
+                    memset(prof.fmsk, 0, sizeof(prof.fmsk));
+                    memset(prof.fcpu, 0, sizeof(prof.fcpu));
+                    prof.nfrm = 0;
+                    prof.text[0][0] = 0;
+                    prof.used = !prof.used;
+                    break;
+
+                case 'K':
+                    ProfDump();
+                    break;
+
+                case 'G':
+                    CraterMap(land, -ftrn.x, -ftrn.y, DEF_CRAD * land->cell, DEF_CDEP * land->fhei);
+                    break;
             }
             return FALSE;
 
@@ -1319,108 +7551,28 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
 
         case WM_PAINT: {
             PAINTSTRUCT pstr;
-            FVEC ftmp;
-            LONG x, y;
 
             if (keys[VK_SPACE]) {
                 keys[VK_SPACE] = FALSE;
-                x = land->flgs;
-                FreeVBO(&land);
-                land = Deserialize(path, keys[0], x, 0);
+                FreeMap(&lnew);
+                lnew = Deserialize(path, keys[0], land->flgs, 0);
                 keys[0] = FALSE;
             }
+            if (lnew && !StreamMap(lnew)) {
+                FreeMap(&land);
+                land = lnew;
+                lnew = NULL;
+                ShowMap(land);
+            }
             BeginPaint(hDlg, &pstr);
             if (paint) {
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-                glPushMatrix();
-                glPushMatrix();
-                glRotatef(fang.v, 1, 0, 0);
-                glRotatef(fang.u, 0, 0, 1);
-                glTranslatef(ftrn.x, ftrn.y, ftrn.z);
-
-                glLightfv(GL_LIGHT0, GL_POSITION, lpos);
-                glLightfv(GL_LIGHT0, GL_SPOT_DIRECTION, ldir);
-
-                #define DEF_DRAW 4
-                glTranslatef(-0.5 * (FLOAT)(DEF_DRAW >> 1) * land->grid, -0.5 * (FLOAT)(DEF_DRAW >> 1) * land->grid, 0.0);
-                glCullFace(GL_FRONT);
-                glPushMatrix();
-                glTranslatef(0.0, 0.0, 2.0 * land->wlvl);
-                glScalef(1.0, 1.0, -1.0);
-                for (y = 0; y < DEF_DRAW; y++) {
-                    for (x = 0; x < DEF_DRAW; x++) {
-                        DrawVBO(land);
-                        glTranslatef(land->grid, 0.0, 0.0);
-                    }
-                    glTranslatef(-(FLOAT)DEF_DRAW * land->grid, land->grid, 0.0);
-                }
-                glPopMatrix();
-                glCullFace(GL_BACK);
-                for (y = 0; y < DEF_DRAW; y++) {
-                    for (x = 0; x < DEF_DRAW; x++) {
-                        DrawVBO(land);
-                        glTranslatef(land->grid, 0.0, 0.0);
-                    }
-                    glTranslatef(-(FLOAT)DEF_DRAW * land->grid, land->grid, 0.0);
-                }
-                #undef DEF_DRAW
-
-                glPopMatrix();
-
-                glDisable(GL_FOG);
-                glDisable(GL_LIGHTING);
-                glClear(GL_DEPTH_BUFFER_BIT);
-
-                #define DEF_QUAD 5.0
-                ftmp.x = -ftrn.x * DEF_QUAD / land->grid;
-                ftmp.y = -ftrn.y * DEF_QUAD / land->grid;
-                ftmp.z = -(ftrn.z + land->wlvl) * DEF_QUAD / land->grid;
-
-                glTranslatef(0.0, -10.0, -50.0);
-                glRotatef(fang.v, 1, 0, 0);
-                glRotatef(fang.u, 0, 0, 1);
-                glTranslatef(-ftmp.x, -ftmp.y, 0.0);
-
-                glBegin(GL_LINES);
-                    glColor4ub(255, 255, 255, 255);
-                    glVertex3f(-DEF_QUAD, -DEF_QUAD, 0.0);
-                    glVertex3f(-DEF_QUAD, DEF_QUAD, 0.0);
-
-                    glVertex3f(DEF_QUAD, -DEF_QUAD, 0.0);
-                    glVertex3f(DEF_QUAD, DEF_QUAD, 0.0);
-
-                    glVertex3f(-DEF_QUAD, -DEF_QUAD, 0.0);
-                    glVertex3f(DEF_QUAD,  -DEF_QUAD, 0.0);
-
-                    glVertex3f(-DEF_QUAD, DEF_QUAD, 0.0);
-                    glVertex3f(DEF_QUAD,  DEF_QUAD, 0.0);
-
-                    glVertex3f(-DEF_QUAD, 0.0, 0.0);
-                    glVertex3f(DEF_QUAD,  0.0, 0.0);
-
-                    glVertex3f(0.0, -DEF_QUAD, 0.0);
-                    glVertex3f(0.0, DEF_QUAD,  0.0);
-
-                    glVertex3f(0.0, 0.0, 0.0);
-                    glVertex3f(0.0, 0.0, 0.5 * DEF_QUAD);
-
-                    glColor4ub(255, 0, 0, 255);
-                    glVertex3f(ftmp.x, ftmp.y, 0.0);
-                    glVertex3f(ftmp.x, ftmp.y, ftmp.z);
-                glEnd();
-
-                glBegin(GL_POINTS);
-                    glVertex3f(ftmp.x, ftmp.y, ftmp.z);
-                glEnd();
-                #undef DEF_QUAD
-
-                glEnable(GL_LIGHTING);
-                glEnable(GL_FOG);
-
-                glPopMatrix();
+                DrawScene(land);
 
+                ProfBegin(PRF_SWAP);
+                ProfShow(hDlg);
                 SwapBuffers(DC);
+                ProfEnd(PRF_SWAP);
+                ProfFrame();
                 fram++;
             }
             EndPaint(hDlg, &pstr);
@@ -1435,6 +7587,7 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
                 FLOAT y = DEF_ZNEA * tan(0.5 * DEF_FFOV * DEG_CRAD), x = y * (FLOAT)LOWORD(lPrm)/(FLOAT)HIWORD(lPrm);
 
                 glViewport(0, 0, LOWORD(lPrm), HIWORD(lPrm));
+                SizeReflection(LOWORD(lPrm), HIWORD(lPrm));
                 glMatrixMode(GL_PROJECTION);
                 glLoadIdentity();
                 glFrustum(-x, x, -y, y, DEF_ZNEA, DEF_ZFAR);
@@ -1467,16 +7620,40 @@ BOOL CALLBACK DialogProc(HWND hDlg, UINT uMsg, WPARAM wPrm, LPARAM lPrm) {
   @brief WinMain:
   analogue of main() for a Windows application.
   All parameters except inst and cmdl are ignored.
+  Runs the render loop: when there are no messages to process, moves the
+  camera by the real time elapsed and draws a frame. Frames are paced by the
+  vertical sync if WGL_EXT_swap_control is there, or by DEF_FMIN otherwise;
+  nothing is drawn while the window is minimized or drawing is prohibited.
 
   @param inst - base address of the process.
-  @param cmdl - command line; may substitute the default config file.
+  @param cmdl - command line; may substitute the default config file, or
+                start the benchmark (see DEF_BARG) or the batch mode
+                (see DEF_GARG).
 
   @return 0 (default process exit code).
 **/
 int CALLBACK WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdl, int show) {
+    LARGE_INTEGER freq, tpre, tcur;
+    HWND hDlg;
     MSG pmsg;
 
     srand(time(0));
+    InitializeCriticalSection(&pcrs);
+    while (*cmdl == ' ') cmdl++;
+    if (!strncmp(cmdl, DEF_BARG, strlen(DEF_BARG))) {
+        cmdl += strlen(DEF_BARG);
+        while (*cmdl == ' ' || *cmdl == '"') cmdl++;
+        bout = strdup((*cmdl)? cmdl : DEF_BOUT);
+        if ((cmdl = strchr(bout, '"'))) *cmdl = 0;
+        cmdl = "";
+    }
+    if (!strncmp(cmdl, DEF_GARG, strlen(DEF_GARG))) {
+        cmdl += strlen(DEF_GARG);
+        while (*cmdl == ' ' || *cmdl == '"') cmdl++;
+        slst = strdup((*cmdl)? cmdl : DEF_GLST);
+        if ((cmdl = strchr(slst, '"'))) *cmdl = 0;
+        cmdl = "";
+    }
     if (strlen(cmdl)) {
         while (*cmdl == ' ' || *cmdl == '"') cmdl++;
         path = strdup(cmdl);
@@ -1485,11 +7662,37 @@ int CALLBACK WinMain(HINSTANCE inst, HINSTANCE prev, LPSTR cmdl, int show) {
     else
         path = strdup(DEF_FILE);
 
-    CreateDialogParam(inst, MAKEINTRESOURCE(1), NULL, (DLGPROC)DialogProc, (LPARAM)inst);
-    while (GetMessage(&pmsg, NULL, 0, 0)) {
-        TranslateMessage(&pmsg);
-        DispatchMessage(&pmsg);
+    timeBeginPeriod(1);
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&tpre);
+    hDlg = CreateDialogParam(inst, MAKEINTRESOURCE(1), NULL, (DLGPROC)DialogProc, (LPARAM)inst);
+    while (TRUE) {
+        if (PeekMessage(&pmsg, NULL, 0, 0, PM_REMOVE)) {
+            if (pmsg.message == WM_QUIT) break;
+            TranslateMessage(&pmsg);
+            DispatchMessage(&pmsg);
+            continue;
+        }
+        if (!paint || IsIconic(hDlg)) {
+            WaitMessage();
+            QueryPerformanceCounter(&tpre);
+            continue;
+        }
+        QueryPerformanceCounter(&tcur);
+        MoveCamera(hDlg, min(DEF_FDLT, (FLOAT)(tcur.QuadPart - tpre.QuadPart) / (FLOAT)freq.QuadPart));
+        tpre = tcur;
+        RedrawWindow(hDlg, NULL, NULL, RDW_INVALIDATE | RDW_UPDATENOW);
+        if (!wglSwapIntervalEXT) {
+            QueryPerformanceCounter(&tcur);
+            tcur.QuadPart = DEF_FMIN - 1000 * (tcur.QuadPart - tpre.QuadPart) / freq.QuadPart;
+            if (tcur.QuadPart > 0) Sleep(tcur.QuadPart);
+        }
     }
+    timeEndPeriod(1);
+    PoolFlush();
+    DeleteCriticalSection(&pcrs);
+    free(bout);
+    free(slst);
     free(path);
     return 0;
 }